@@ -5,6 +5,7 @@
 #include <iostream>
 #include <algorithm>
 #include <librbp++/rbp.h>
+#include <librbp++/metrics.h>
 
 extern "C" {
 #include <unistd.h>
@@ -14,23 +15,108 @@ extern "C" {
 
 const unsigned default_depth = 1000;
 const double default_discounting_base = 2;
+const double default_persist = 0.95;
+const unsigned default_prec_k = 10;
 
 using namespace rbp;
 using namespace std;
 
+/* the metrics reported by -E */
+typedef Metrics<PrecisionMetric, Metrics<ApMetric, Metrics<RrMetric> > >
+    SetMetrics;
+typedef Metrics<RbpMetric, SetMetrics> OtherMetrics;
+typedef Metrics<DcgMetric, OtherMetrics> AllMetrics;
+
 void usage_and_exit(std::ostream & out, const char * progname, int exit_code) {
-    out << "USAGE: " << progname 
-        << " [-R] [-b base] [-r depth] [-n|N] [-d|D] [-m|M] <qrels> <run>" 
+    out << "USAGE: " << progname
+        << " [-R] [-b base] [-r depth[,depth...]] [-n|N] [-d|D] [-m|M]"
+        << " [-E [-p persist] [-k k]] <qrels> <run> [<run>...]" << std::endl;
+    out << "  -r gives one or more depths to evaluate to, all in the same"
+        << std::endl << "     pass; 0 means the full ranking." << std::endl;
+    out << "  -E reports rbp (to full depth), P@k, AP and RR alongside dcg,"
+        << std::endl << "     all from a single pass over each ranking."
         << std::endl;
+    out << "  If more than one run is given, each line of output is"
+        << " labelled" << std::endl << "     with the name of its run file"
+        << " (runs often share a runid)." << std::endl;
     exit(exit_code);
 }
 
-#define ERR_BUF_LEN 1024
+/*
+ *  Parse a comma-separated list of depths into $depths$.  Returns
+ *  false if it is not one.
+ */
+bool parse_depths(const char * spec, std::vector<unsigned> &depths) {
+    char * end;
+
+    depths.clear();
+    for (;;) {
+        if (*spec < '0' || *spec > '9')
+            return false;
+        depths.push_back(strtoul(spec, &end, 10));
+        if (*end != ',')
+            return *end == '\0';
+        spec = end + 1;
+    }
+}
+
+/* output is written a topic at a time, but only flushed at the end,
+ * so that it keeps up with evaluating many runs */
+void print_dcg(const DcgMetric &m) {
+    unsigned c;
+
+    for (c = 0; c < m.dcg_num_cutoffs(); c++)
+        std::cout << " " << m.dcg(c);
+}
+
+void print_metrics(const char * qid, const DcgMetric &m) {
+    std::cout << qid;
+    print_dcg(m);
+    std::cout << '\n';
+}
+
+void print_metrics(const char * qid, const AllMetrics &m) {
+    std::cout << qid;
+    print_dcg(m);
+    std::cout << " " << m.rbp() << " +" << m.rbp_residual() << " "
+        << m.precision() << " " << m.ap() << " " << m.rr() << '\n';
+}
 
-/* #define VERBOSE */
+/*
+ *  Evaluate each topic of $run$ by $metrics$, printing their values
+ *  (labelled by $label$ if it is not NULL), then their means.
+ */
+template <class M>
+void evaluate(M metrics, qrels_t * qrels, run_t * run, const char * label) {
+    M mean(metrics);
+    unsigned num_queries = 0;
+    unsigned q;
+
+    mean.clear();
+    for (q = 0; q < run_num_qdocs(run); q++) {
+        qdocs_t * qdocs = run_get_qdocs_by_index(run, q);
+
+        if (!evaluate_topic(metrics, qrels, qdocs)) {
+            std::cerr << "No judgments for query " << qdocs_qid(qdocs)
+                << "; ignoring" << std::endl;
+            continue;
+        }
+        num_queries++;
+        mean.sum(metrics);
+        if (label != NULL)
+            std::cout << label << " ";
+        print_metrics(qdocs_qid(qdocs), metrics);
+    }
+    mean.divide(num_queries);
+    if (label != NULL)
+        std::cout << label << " ";
+    print_metrics("all", mean);
+}
+
+#define ERR_BUF_LEN 1024
 
 int main(int argc, char ** argv) {
-    int ret;
+    int ret = 0;
     FILE * qrels_fp = NULL;
     FILE * run_fp = NULL;
     run_t * run = NULL;
@@ -40,18 +126,20 @@ int main(int argc, char ** argv) {
     double discounting_base = default_discounting_base;
     char * qrels_fname, * run_fname;
     const char * progname;
-    unsigned q;
-    unsigned depth = default_depth;
-    double log_e_b;
+    const char * label;
+    std::vector<unsigned> depths(1, default_depth);
     bool normalised = true;
     bool discounted = true;
     enum reltype_t reltype = RELTYPE_AUTO;
-    double tot_score = 0.0;
-    unsigned num_queries = 0;
     unsigned rank_adjust = 0;
+    bool all_metrics = false;
+    double persist = default_persist;
+    unsigned prec_k = default_prec_k;
+    unsigned c;
+    int r;
 
     progname = argv[0];
-    while ( (optflag = getopt(argc, argv, "b:Rr:hnNdDmM")) != -1) {
+    while ( (optflag = getopt(argc, argv, "b:Rr:hnNdDmMEp:k:")) != -1) {
         switch (optflag) {
         case 'R':
             /* add 1 to rank before discounting.  This is the MS (aka
@@ -62,7 +150,11 @@ int main(int argc, char ** argv) {
             discounting_base = atof(optarg);
             break;
         case 'r':
-            depth = atoi(optarg);
+            if (!parse_depths(optarg, depths)) {
+                std::cerr << "Invalid depths '" << optarg << "'"
+                    << std::endl;
+                usage_and_exit(std::cerr, progname, 1);
+            }
             break;
         case 'n':
             normalised = true;
@@ -82,40 +174,33 @@ int main(int argc, char ** argv) {
         case 'D':
             discounted = false;
             break;
+        case 'E':
+            all_metrics = true;
+            break;
+        case 'p':
+            persist = atof(optarg);
+            break;
+        case 'k':
+            prec_k = atoi(optarg);
+            break;
         case 'h':
             usage_and_exit(std::cout, progname, 0);
             break;
         }
     }
 
-    if (argc - optind != 2) {
+    if (argc - optind < 2) {
         usage_and_exit(std::cerr, argv[0], 1);
     }
 
     qrels_fname = argv[optind];
-    run_fname = argv[optind + 1];
 
     qrels_fp = fopen(qrels_fname, "r");
     if (qrels_fp == NULL) {
-        std::cerr << "Unable to open qrels file '" << qrels_fname 
+        std::cerr << "Unable to open qrels file '" << qrels_fname
             << "' for reading" << std::endl;
         usage_and_exit(std::cerr, progname, 1);
     }
-    run_fp = fopen(run_fname, "r");
-    if (run_fp == NULL) {
-        std::cerr << "Unable to open run file '" << run_fname 
-            << "' for reading" << std::endl;
-        usage_and_exit(std::cerr, progname, 1);
-    }
-
-    run = load_run(run_fp, err_buf, ERR_BUF_LEN);
-    fclose(run_fp);
-    if (run == NULL) {
-        std::cerr << "Error loading run file '" << run_fname << "': "
-            << err_buf << std::endl;
-        usage_and_exit(std::cerr, progname, 1);
-    }
-
     qrels = load_qrels(qrels_fp, err_buf, ERR_BUF_LEN);
     fclose(qrels_fp);
     if (qrels == NULL) {
@@ -126,89 +211,53 @@ int main(int argc, char ** argv) {
 
     qrels_set_reltype(qrels, reltype, 1.0);
 
-    log_e_b = log(discounting_base);
+    std::ios::sync_with_stdio(false);
+    DcgMetric dcg(depths, discounting_base, rank_adjust, normalised,
+      discounted);
+    if (all_metrics) {
+        std::cout << "# qid";
+        for (c = 0; c < dcg.dcg_num_cutoffs(); c++) {
+            std::cout << " dcg";
+            if (dcg.dcg_cutoff(c) != UINT_MAX)
+                std::cout << "@" << dcg.dcg_cutoff(c);
+        }
+        std::cout << " rbp +res p@" << prec_k << " ap rr\n";
+    }
 
-    for (q = 0; q < run_num_qdocs(run); q++) {
-        qdocs_t * qdocs;
-        qid_qrels_t * qq;
-        const char * qid;
-        doc_score_t * ds;
-        unsigned run_length;
-        unsigned r;
-        double score;
-
-        qdocs = run_get_qdocs_by_index(run, q);
-        qid = qdocs_qid(qdocs);
-        qq = qrels_get_qid_qrels(qrels, qid);
-        if (qq == NULL) {
-            std::cerr << "No judgments for query " << qid 
-                << "; ignoring" << std::endl;
+    /* the qrels, and the ideal rankings of their topics, are shared
+     * by all the runs */
+    for (r = optind + 1; r < argc; r++) {
+        run_fname = argv[r];
+        run_fp = fopen(run_fname, "r");
+        if (run_fp == NULL) {
+            std::cerr << "Unable to open run file '" << run_fname
+                << "' for reading" << std::endl;
+            ret = 1;
             continue;
         }
-        num_queries++;
-        ds = qdocs_get_scores(qdocs, QDOCS_ORD_SCORE);
-        run_length = qdocs_num_scores(qdocs);
-        if (run_length > depth) {
-            run_length = depth;
-        }
-        score = 0.0;
-        for (r = 0; r < run_length; r++) {
-            rel_t rel;
-
-            rel = qid_qrels_get_rel(qq, ds[r].docid);
-            if (rel > 0.0) {
-                if (discounted && (r + 1 + rank_adjust >= discounting_base)) {
-#ifdef VERBOSE
-                    fprintf(stderr, "Discounting %lf at rank %u to ", rel, 
-                      r + 1);
-#endif /* VERBOSE */
-                    rel /= (log(r + 1 + rank_adjust) / log_e_b);
-#ifdef VERBOSE
-                    fprintf(stderr, "%lf\n", rel);
-#endif /* VERBOSE */
-                }
-                score += rel;
-            }
+        run = load_run(run_fp, err_buf, ERR_BUF_LEN);
+        fclose(run_fp);
+        if (run == NULL) {
+            std::cerr << "Error loading run file '" << run_fname << "': "
+                << err_buf << std::endl;
+            ret = 1;
+            continue;
         }
-        if (normalised) {
-            std::vector<rel_t> optimal_rel;
-            qrels_iterator_t * qit;
-            rel_t rel;
-            double optimal_score = 0.0;
-            unsigned r;
-
-            qit = qid_qrels_get_iterator(qq);
-            while ( (qrel_iter_next(qit, &rel)) != NULL) {
-                if (rel > 0.0) {
-                    optimal_rel.push_back(rel);
-                }
-            }
-            qrel_iter_delete(&qit);
-            sort(optimal_rel.begin(), optimal_rel.end());
-            reverse(optimal_rel.begin(), optimal_rel.end());
-            r = 0;
-            for (std::vector<rel_t>::iterator it = optimal_rel.begin();
-                it != optimal_rel.end(); it++, r++) {
-                rel_t rel = *it;
-                if (discounted && (r + 1 + rank_adjust >= discounting_base)) {
-                    rel /= (log(r + 1 + rank_adjust) / log_e_b);
-                }
-                optimal_score += rel;
-            }
-#ifdef VERBOSE
-            fprintf(stderr, "Normalising %lf to ", score);
-#endif /* VERBOSE */
-            if (optimal_score > 0) {
-                score /= optimal_score;
-            }
-#ifdef VERBOSE
-            fprintf(stderr, "%lf\n", score);
-#endif /* VERBOSE */
+
+        /* by file name rather than runid, which runs often share */
+        label = argc - optind > 2 ? run_fname : NULL;
+        if (all_metrics) {
+            /* the other metrics come from the same pass as dcg */
+            evaluate(AllMetrics(dcg, OtherMetrics(RbpMetric(persist),
+                    SetMetrics(PrecisionMetric(prec_k)))), qrels, run,
+              label);
+        } else {
+            evaluate(dcg, qrels, run, label);
         }
-        tot_score += score;
-        std::cout << qid << " " << score << std::endl;
+        run_delete(&run);
     }
-    std::cout << "all " << tot_score / num_queries << std::endl;
+    std::cout.flush();
+    qrels_delete(&qrels);
 
-    return 0;
+    return ret;
 }
@@ -0,0 +1,571 @@
+#ifndef RBPCC_METRICS_H
+#define RBPCC_METRICS_H
+
+#include <cassert>
+#include <cmath>
+#include <climits>
+#include <vector>
+#include <list>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+extern "C" {
+#include <librbp/qrels.h>
+#include <librbp/qdocs.h>
+#include <librbp/run.h>
+#include <librbp/wgttab.h>
+}
+
+namespace rbp {
+
+/*
+ *  Evaluation of a run by several metrics in a single pass.
+ *
+ *  The metrics of a topic are calculated together, from one walk
+ *  down its ranking's relevance vector (see qdocs_get_rels), so
+ *  that the run and qrels are loaded, sorted and joined only once
+ *  however many metrics are wanted.  The metrics are chosen at
+ *  compile time, by listing them as the template arguments of
+ *  Metrics, which nests to give any number of them:
+ *
+ *    Metrics<DcgMetric, Metrics<RbpMetric, Metrics<ApMetric> > > m;
+ *
+ *  Calls to a Metrics are passed on to each metric in turn, and
+ *  are inlined, so a metric not listed costs nothing.  Each metric
+ *  gives its value by an accessor of its own name (m.dcg(),
+ *  m.rbp(), m.ap() above); a metric can be listed only once.
+ *
+ *  A metric provides:
+ *
+ *    unsigned depth() const;     how many documents it looks at
+ *    void begin(const Topic &);  start on a topic
+ *    void add(unsigned rank, rel_t rel);
+ *                                the document at $rank$ (counting
+ *                                from 0), in rank order; $rel$ is
+ *                                REL_UNJUDGED if it is not judged
+ *    void end(const Topic &);    finish the topic
+ *    void clear();               zero the values, for summing
+ *    void sum(const M &);        add the values of another topic
+ *    void divide(unsigned n);    divide the values by $n$
+ *
+ *  A document is counted as relevant if its relevance is greater
+ *  than 0; how graded relevances are treated is otherwise up to
+ *  the qrels' reltype (see qrels_set_reltype).  Tied documents are
+ *  taken in the order qdocs_get_rels gives them; unlike rbp_eval,
+ *  no metric here averages across ties.
+ */
+
+/*
+ *  A topic being evaluated.
+ */
+struct Topic {
+    const char * qid;
+    qrels_t * qrels;
+    qid_qrels_t * qq;
+    /* the relevance of each of the $num_ret$ documents ranked */
+    const rel_t * rels;
+    unsigned num_ret;
+};
+
+/*
+ *  The empty metric, which ends a list of Metrics.
+ */
+class NoMetric {
+    public:
+        unsigned depth() const { return 0; }
+        void begin(const Topic &) { }
+        void add(unsigned, rel_t) { }
+        void end(const Topic &) { }
+        void clear() { }
+        void sum(const NoMetric &) { }
+        void divide(unsigned) { }
+};
+
+/*
+ *  A list of metrics, calculated together.
+ */
+template <class Head, class Tail = NoMetric>
+class Metrics : public Head, public Tail {
+    public:
+        Metrics(const Head &head = Head(), const Tail &tail = Tail()) :
+            Head(head), Tail(tail) { }
+        unsigned depth() const {
+            return std::max(Head::depth(), Tail::depth());
+        }
+        void begin(const Topic &t) { Head::begin(t); Tail::begin(t); }
+        void add(unsigned rank, rel_t rel) {
+            Head::add(rank, rel);
+            Tail::add(rank, rel);
+        }
+        void end(const Topic &t) { Head::end(t); Tail::end(t); }
+        void clear() { Head::clear(); Tail::clear(); }
+        void sum(const Metrics &other) {
+            Head::sum(other);
+            Tail::sum(other);
+        }
+        void divide(unsigned n) { Head::divide(n); Tail::divide(n); }
+};
+
+/*
+ *  Rank-biased precision, as a base plus residual, to $depth$
+ *  documents (0 for the full ranking).  The residual is the weight
+ *  of the unjudged documents, plus that of those beyond the
+ *  ranking's end.
+ */
+class RbpMetric {
+    private:
+        double persist_;
+        unsigned depth_;
+        const wgttab_t * tab_;
+        double rbp_;
+        double residual_;
+
+    public:
+        RbpMetric(double persist = 0.95, unsigned depth = 0) :
+            persist_(persist), depth_(depth == 0 ? UINT_MAX : depth),
+            tab_(NULL), rbp_(0.0), residual_(0.0) { }
+        double rbp() const { return rbp_; }
+        double rbp_residual() const { return residual_; }
+        double rbp_persist() const { return persist_; }
+
+        unsigned depth() const { return depth_; }
+        void begin(const Topic &t) {
+            tab_ = wgttab_get(persist_, std::min(t.num_ret, depth_));
+            rbp_ = residual_ = 0.0;
+        }
+        void add(unsigned rank, rel_t rel) {
+            if (rank >= depth_)
+                return;
+            if (rel < 0.0)
+                residual_ += wgttab_wgt(tab_, rank);
+            else
+                rbp_ += rel * wgttab_wgt(tab_, rank);
+        }
+        void end(const Topic &t) {
+            residual_ += wgttab_resid(tab_, std::min(t.num_ret, depth_));
+        }
+        void clear() { rbp_ = residual_ = 0.0; }
+        void sum(const RbpMetric &other) {
+            rbp_ += other.rbp_;
+            residual_ += other.residual_;
+        }
+        void divide(unsigned n) { rbp_ /= n; residual_ /= n; }
+};
+
+/*
+ *  Tables for (n)DCG with a given discount: the divisor of the gain
+ *  at each rank, and the cumulative gains of each topic's ideal
+ *  ranking.  Tables are shared by every DcgMetric with the same
+ *  discount, and last as long as the process; see get().  As with
+ *  wgttab, a lock guards them, so that DcgMetrics can be used in
+ *  several threads at once, and a table once handed out is never
+ *  changed: a deeper one is added alongside it.  As for
+ *  qdocs_get_rels, the qrels must not have their reltype set while
+ *  they are being evaluated.
+ */
+class DcgTable {
+    private:
+        struct Ideal {
+            /* how deep the ideal ranking was wanted, and its
+             * cumulative gain at each rank to there */
+            unsigned depth;
+            std::vector<double> cum;
+        };
+
+        double base_;
+        unsigned rank_adjust_;
+        bool discounted_;
+        double log_e_b_;
+        /* deepest first */
+        std::list<std::vector<double> > divs_;
+        /* the ideal rankings of the topics of the qrels whose serial
+         * (qrels_get_serial) is $serial_$, deepest first */
+        unsigned long serial_;
+        std::map<const qid_qrels_t *, std::list<Ideal> > ideal_;
+        std::vector<rel_t> gains_;
+
+        DcgTable(double base, unsigned rank_adjust, bool discounted) :
+            base_(base), rank_adjust_(rank_adjust), discounted_(discounted),
+            log_e_b_(log(base)), serial_(0) { }
+
+        static std::mutex &lock() {
+            static std::mutex m;
+
+            return m;
+        }
+
+        /* tables of divisors are no shallower than this, and
+         * otherwise a power of two (as for wgttab) */
+        enum { MIN_DEPTH = 1024 };
+
+        /* divisors(), with the lock held */
+        const double * divisors_locked(unsigned depth) {
+            unsigned tab_depth, r;
+
+            if (!divs_.empty() && divs_.front().size() >= depth)
+                return &divs_.front()[0];
+            for (tab_depth = MIN_DEPTH; tab_depth < depth
+              && tab_depth <= UINT_MAX / 2; tab_depth *= 2)
+                ;
+            if (tab_depth < depth)
+                tab_depth = depth;
+            divs_.push_front(std::vector<double>());
+            std::vector<double> &div = divs_.front();
+            div.reserve(tab_depth);
+            for (r = 0; r < tab_depth; r++) {
+                if (discounted_ && (r + 1 + rank_adjust_ >= base_))
+                    div.push_back(log(r + 1 + rank_adjust_) / log_e_b_);
+                else
+                    div.push_back(1.0);
+            }
+            return &div[0];
+        }
+
+    public:
+        /* the table for the discount given by $base$, $rank_adjust$
+         * and $discounted$ (see DcgMetric). */
+        static DcgTable * get(double base, unsigned rank_adjust,
+          bool discounted) {
+            static std::list<DcgTable> tables;
+            std::lock_guard<std::mutex> guard(lock());
+            std::list<DcgTable>::iterator it;
+
+            for (it = tables.begin(); it != tables.end(); it++) {
+                if (it->base_ == base && it->rank_adjust_ == rank_adjust
+                  && it->discounted_ == discounted)
+                    return &*it;
+            }
+            tables.push_front(DcgTable(base, rank_adjust, discounted));
+            return &tables.front();
+        }
+
+        /* the divisors of the gains at ranks [0, $depth$) (counting
+         * from 0).  Each is computed once; the gain is divided, not
+         * multiplied, so that the result is exactly that of dividing
+         * by the logarithm directly. */
+        const double * divisors(unsigned depth) {
+            std::lock_guard<std::mutex> guard(lock());
+
+            return divisors_locked(depth);
+        }
+
+        /* the cumulative gain of the ideal ranking of $qq$, of
+         * $qrels$, at each rank to $depth$ (or to the last of its
+         * relevant documents, if that is sooner).  Only the top
+         * $depth$ gains are selected, by partial sort, and the
+         * result is kept for later calls. */
+        const std::vector<double> &ideal(qrels_t * qrels, qid_qrels_t * qq,
+          unsigned depth) {
+            std::lock_guard<std::mutex> guard(lock());
+            qrels_iterator_t * qit;
+            rel_t rel;
+            unsigned r, k;
+            const double * div;
+            double cum = 0.0;
+            Ideal id;
+
+            if (serial_ != qrels_get_serial(qrels)) {
+                ideal_.clear();
+                serial_ = qrels_get_serial(qrels);
+            }
+            std::list<Ideal> &ids = ideal_[qq];
+            if (!ids.empty() && (ids.front().depth >= depth
+                  || ids.front().cum.size() < ids.front().depth))
+                return ids.front().cum;
+
+            gains_.clear();
+            qit = qid_qrels_get_iterator(qq);
+            while (qrel_iter_next(qit, &rel) != NULL) {
+                if (rel > 0.0)
+                    gains_.push_back(rel);
+            }
+            qrel_iter_delete(&qit);
+            k = std::min((unsigned) gains_.size(), depth);
+            std::partial_sort(gains_.begin(), gains_.begin() + k,
+              gains_.end(), std::greater<rel_t>());
+            div = divisors_locked(k);
+            id.depth = depth;
+            for (r = 0; r < k; r++) {
+                cum += gains_[r] / div[r];
+                id.cum.push_back(cum);
+            }
+            ids.push_front(id);
+            return ids.front().cum;
+        }
+};
+
+/*
+ *  (Normalised) discounted cumulative gain, to one or more cutoff
+ *  depths.
+ *
+ *  The gain of the document at rank r (counting from 1) is
+ *  divided by log_base(r + rank_adjust) once r + rank_adjust
+ *  reaches $base$.  A $rank_adjust$ of 1 gives the variant of
+ *  Burges et al., in which no document goes undiscounted.  If
+ *  normalised, the score at each cutoff is divided by that of the
+ *  ideal ranking of the topic's relevant documents, to the same
+ *  cutoff.  A cutoff of 0 means the full ranking.
+ */
+class DcgMetric {
+    private:
+        /* ascending; the last is the deepest */
+        std::vector<unsigned> cutoffs_;
+        bool normalised_;
+        DcgTable * table_;
+        const double * div_;
+        double sum_;
+        unsigned next_;
+        std::vector<double> dcg_;
+
+        void init(bool discounted, double base, unsigned rank_adjust) {
+            unsigned c;
+
+            for (c = 0; c < cutoffs_.size(); c++) {
+                if (cutoffs_[c] == 0)
+                    cutoffs_[c] = UINT_MAX;
+            }
+            std::sort(cutoffs_.begin(), cutoffs_.end());
+            cutoffs_.erase(std::unique(cutoffs_.begin(), cutoffs_.end()),
+              cutoffs_.end());
+            dcg_.resize(cutoffs_.size());
+            table_ = DcgTable::get(base, rank_adjust, discounted);
+        }
+
+    public:
+        DcgMetric(unsigned depth = 1000, double base = 2.0,
+          unsigned rank_adjust = 0, bool normalised = true,
+          bool discounted = true) :
+            cutoffs_(1, depth), normalised_(normalised), div_(NULL),
+            sum_(0.0), next_(0) {
+            init(discounted, base, rank_adjust);
+        }
+        DcgMetric(const std::vector<unsigned> &cutoffs, double base = 2.0,
+          unsigned rank_adjust = 0, bool normalised = true,
+          bool discounted = true) :
+            cutoffs_(cutoffs), normalised_(normalised), div_(NULL),
+            sum_(0.0), next_(0) {
+            assert(!cutoffs.empty());
+            init(discounted, base, rank_adjust);
+        }
+        /* the score at the shallowest cutoff */
+        double dcg() const { return dcg_[0]; }
+        /* the score at the $c$'th cutoff, shallowest first */
+        double dcg(unsigned c) const { return dcg_[c]; }
+        unsigned dcg_num_cutoffs() const { return cutoffs_.size(); }
+        /* the $c$'th cutoff, UINT_MAX for the full ranking */
+        unsigned dcg_cutoff(unsigned c) const { return cutoffs_[c]; }
+
+        unsigned depth() const { return cutoffs_.back(); }
+        void begin(const Topic &t) {
+            div_ = table_->divisors(std::min(t.num_ret, depth()));
+            sum_ = 0.0;
+            next_ = 0;
+        }
+        void add(unsigned rank, rel_t rel) {
+            while (next_ < cutoffs_.size() && rank >= cutoffs_[next_])
+                dcg_[next_++] = sum_;
+            if (next_ < cutoffs_.size() && rel > 0.0)
+                sum_ += rel / div_[rank];
+        }
+        void end(const Topic &t) {
+            unsigned c;
+
+            for (; next_ < cutoffs_.size(); next_++)
+                dcg_[next_] = sum_;
+            if (!normalised_)
+                return;
+            const std::vector<double> &ideal = table_->ideal(t.qrels, t.qq,
+              depth());
+            for (c = 0; c < cutoffs_.size(); c++) {
+                unsigned k = std::min((size_t) cutoffs_[c], ideal.size());
+
+                if (k > 0 && ideal[k - 1] > 0)
+                    dcg_[c] /= ideal[k - 1];
+            }
+        }
+        void clear() { std::fill(dcg_.begin(), dcg_.end(), 0.0); }
+        void sum(const DcgMetric &other) {
+            unsigned c;
+
+            for (c = 0; c < dcg_.size(); c++)
+                dcg_[c] += other.dcg_[c];
+        }
+        void divide(unsigned n) {
+            unsigned c;
+
+            for (c = 0; c < dcg_.size(); c++)
+                dcg_[c] /= n;
+        }
+};
+
+/*
+ *  Precision at $k$ documents.  A ranking shorter than $k$ is
+ *  counted as though filled out with irrelevant documents.
+ */
+class PrecisionMetric {
+    private:
+        unsigned k_;
+        double precision_;
+
+    public:
+        PrecisionMetric(unsigned k = 10) : k_(k), precision_(0.0) { }
+        double precision() const { return precision_; }
+        unsigned precision_k() const { return k_; }
+
+        unsigned depth() const { return k_; }
+        void begin(const Topic &) { precision_ = 0.0; }
+        void add(unsigned rank, rel_t rel) {
+            if (rank < k_ && rel > 0.0)
+                precision_ += 1.0;
+        }
+        void end(const Topic &) {
+            if (k_ > 0)
+                precision_ /= k_;
+        }
+        void clear() { precision_ = 0.0; }
+        void sum(const PrecisionMetric &other) {
+            precision_ += other.precision_;
+        }
+        void divide(unsigned n) { precision_ /= n; }
+};
+
+/*
+ *  Average precision, to $depth$ documents (0 for the full
+ *  ranking).  The precision at each relevant document retrieved
+ *  is summed, and divided by the number of documents judged
+ *  relevant.
+ */
+class ApMetric {
+    private:
+        unsigned depth_;
+        unsigned found_;
+        double ap_;
+
+    public:
+        ApMetric(unsigned depth = 0) :
+            depth_(depth == 0 ? UINT_MAX : depth), found_(0), ap_(0.0) { }
+        double ap() const { return ap_; }
+
+        unsigned depth() const { return depth_; }
+        void begin(const Topic &) { found_ = 0; ap_ = 0.0; }
+        void add(unsigned rank, rel_t rel) {
+            if (rank < depth_ && rel > 0.0)
+                ap_ += (double) ++found_ / (rank + 1);
+        }
+        void end(const Topic &t) {
+            qrels_iterator_t * qit;
+            rel_t rel;
+            unsigned num_rel = 0;
+
+            qit = qid_qrels_get_iterator(t.qq);
+            while (qrel_iter_next(qit, &rel) != NULL) {
+                if (rel > 0.0)
+                    num_rel++;
+            }
+            qrel_iter_delete(&qit);
+            if (num_rel > 0)
+                ap_ /= num_rel;
+        }
+        void clear() { ap_ = 0.0; }
+        void sum(const ApMetric &other) { ap_ += other.ap_; }
+        void divide(unsigned n) { ap_ /= n; }
+};
+
+/*
+ *  Reciprocal rank of the first relevant document, within $depth$
+ *  documents (0 for the full ranking); 0 if there is none.
+ */
+class RrMetric {
+    private:
+        unsigned depth_;
+        double rr_;
+
+    public:
+        RrMetric(unsigned depth = 0) :
+            depth_(depth == 0 ? UINT_MAX : depth), rr_(0.0) { }
+        double rr() const { return rr_; }
+
+        unsigned depth() const { return depth_; }
+        void begin(const Topic &) { rr_ = 0.0; }
+        void add(unsigned rank, rel_t rel) {
+            if (rank < depth_ && rel > 0.0 && rr_ == 0.0)
+                rr_ = 1.0 / (rank + 1);
+        }
+        void end(const Topic &) { }
+        void clear() { rr_ = 0.0; }
+        void sum(const RrMetric &other) { rr_ += other.rr_; }
+        void divide(unsigned n) { rr_ /= n; }
+};
+
+/*
+ *  Evaluate the ranking $qdocs$, in order $ord$, by the metrics
+ *  $m$, whose values are then those of the topic.  Returns false,
+ *  leaving $m$ untouched, if the topic has no judgments in $qrels$.
+ */
+template <class M>
+bool evaluate_topic(M &m, qrels_t * qrels, qdocs_t * qdocs,
+  enum qdocs_ord_t ord = QDOCS_ORD_SCORE) {
+    Topic t;
+    unsigned depth;
+    unsigned r;
+
+    t.qid = qdocs_qid(qdocs);
+    t.qrels = qrels;
+    t.qq = qrels_get_qid_qrels(qrels, t.qid);
+    if (t.qq == NULL)
+        return false;
+    t.rels = qdocs_get_rels(qdocs, qrels, ord);
+    t.num_ret = qdocs_num_scores(qdocs);
+    depth = std::min(t.num_ret, m.depth());
+    m.begin(t);
+    for (r = 0; r < depth; r++)
+        m.add(r, t.rels[r]);
+    m.end(t);
+    return true;
+}
+
+/*
+ *  The metrics of one topic of a run.  $qid$ belongs to the run.
+ */
+template <class M>
+struct TopicMetrics {
+    const char * qid;
+    M metrics;
+};
+
+/*
+ *  Evaluate each judged topic of $run$ by copies of $proto$,
+ *  appending the results to $out$, and returning their mean.
+ *  Topics without judgments are passed over.
+ */
+template <class M>
+M evaluate_run(const M &proto, qrels_t * qrels, run_t * run,
+  std::vector<TopicMetrics<M> > &out,
+  enum qdocs_ord_t ord = QDOCS_ORD_SCORE) {
+    M mean(proto);
+    TopicMetrics<M> tm;
+    unsigned num_topics = 0;
+    unsigned q;
+
+    mean.clear();
+    tm.metrics = proto;
+    for (q = 0; q < run_num_qdocs(run); q++) {
+        qdocs_t * qdocs = run_get_qdocs_by_index(run, q);
+
+        if (evaluate_topic(tm.metrics, qrels, qdocs, ord)) {
+            tm.qid = qdocs_qid(qdocs);
+            out.push_back(tm);
+            mean.sum(tm.metrics);
+            num_topics++;
+        }
+    }
+    if (num_topics > 0)
+        mean.divide(num_topics);
+    return mean;
+}
+
+}
+
+#endif /* RBPCC_METRICS_H */
@@ -8,76 +8,48 @@ void librbpxx_is_present(void) {
 }
 }
 
-RbpScore RbpScorer::score(const std::vector<double> &inrels) {
-    std::vector<double> filtered;
-    const std::vector<double> * the_rels;
-    if (filter_rels(inrels, filtered))
-        the_rels = &filtered;
-    else
-        the_rels = &inrels;
-
-    RbpScore score(0.0, 1.0);
-    for (unsigned i = 0; i < the_rels->size(); i++) {
-        double wgt;
-        double rel = (*the_rels)[i];
-        if (rel > 1.0)
-            rel = 1.0;
-        if (rel >= 0.0) {
-            wgt = weight(i);
-            score.incr(rel, wgt);
-        }
-    }
-    return adjust_score(score);
+RbpScore RbpScorer::score(const std::vector<double> &rels) {
+    return score(rels.begin(), rels.end());
 }
 
 RbpScore RbpScorer::score(const Qrels &qrels,
   const std::vector<std::string> &docs) {
-    /* convert list of docs into list of relevancies. */
-    std::vector<double> rels;
-    for (std::vector<std::string>::const_iterator cit = docs.begin();
-      cit != docs.end(); cit++) {
-        double rel = qrels.get(*cit);
-        rels.push_back(rel);
-    }
-    return score(rels);
+    return score_docids(qrels, docs.begin(), docs.end());
 }
 
 RbpScore RbpScorer::score(const Qrels &qrels, qdocs_t * qdocs) {
     doc_score_t * ds;
     unsigned num_scores, c;
-    std::vector<std::string> rdocs;
+    Pass pass;
 
     num_scores = qdocs_num_scores(qdocs);
     ds = qdocs_get_scores(qdocs, QDOCS_ORD_SCORE);
+    begin_pass(pass);
     for (c = 0; c < num_scores; c++) {
-        rdocs.push_back(std::string(ds[c].docid));
+        add_rel(pass, qrels.get(key(ds[c].docid)));
     }
-    return score(qrels, rdocs);
+    return end_pass(pass);
 }
 
-RbpScore RbpScorer::score(const Qrels &qrels, const Run &run) {
-    /* convert list of RunDocs into list of relevancies. */
-    std::vector<double> rels;
-    for (Run::ConstIterator it = run.begin(); it != run.end(); it++) {
-        double rel = qrels.get(it->get_docid());
-        rels.push_back(rel);
-    }
-    return score(rels);
+RbpScore RbpScorer::score(qrels_t * qrels, qdocs_t * qdocs) {
+    const rel_t * rels = qdocs_get_rels(qdocs, qrels, QDOCS_ORD_SCORE);
+    return score(rels, qdocs_num_scores(qdocs));
 }
 
-bool InducedRbpScorer::filter_rels(const std::vector<double> &in,
-  std::vector<double> &out) {
-    last_unfiltered_length = in.size();
-    for (std::vector<double>::const_iterator cit = in.begin();
-      cit != in.end(); cit++) {
-        if (*cit >= 0.0)
-            out.push_back(*cit);
+RbpScore RbpScorer::score(const Qrels &qrels, const Run &run) {
+    Pass pass;
+
+    begin_pass(pass);
+    for (Run::ConstIterator it = run.begin(); it != run.end(); it++) {
+        add_rel(pass, qrels.get(it->get_docid()));
     }
-    last_filtered_length = out.size();
-    return true;
+    return end_pass(pass);
 }
 
-RbpScore InducedRbpScorer::adjust_score(RbpScore score) {
+RbpScore InducedRbpScorer::adjust_score(RbpScore score, unsigned ranked,
+  unsigned given) {
+    last_filtered_length = ranked;
+    last_unfiltered_length = given;
     if (smear_residual_) {
         unsigned num_judged_in_run = last_filtered_length;
         unsigned num_rel_in_run = (unsigned) score.get_nrel();
@@ -13,6 +13,7 @@
 
 extern "C" {
 #include <librbp/qdocs.h>
+#include <librbp/wgttab.h>
 }
 
 extern "C" {
@@ -79,22 +80,75 @@ class RbpScoreList {
 class RbpScorer {
     private:
         double persist_;
+        /* the shared weight table, replaced by a deeper one as
+         * needed.  Note that this makes the class non-reentrant. */
+        const wgttab_t * tab_;
+        /* reused to look up docids given as C strings, so that doing
+         * so does not allocate once it is long enough. */
+        std::string key_;
 
     protected:
-        /* filter list of rels just before performing the 
-         * calculation.  If this method returns false, then
-         * the original list of rels is used unchanged; otherwise,
-         * the filtered in $out$ is used.  This method gets
-         * called at the start of score(rels). */
-        virtual bool filter_rels(const std::vector<double> &in,
-          std::vector<double> &out) { return false; }
+        /* the weight table, deep enough for $depth$ documents, or as
+         * deep as tables go (see wgttab_wgt). */
+        const wgttab_t * table(unsigned depth) {
+            if (tab_ == NULL || (tab_->depth < depth
+                  && tab_->depth < WGTTAB_MAX_DEPTH))
+                tab_ = wgttab_get(persist_, depth);
+            return tab_;
+        }
+        /* whether unjudged documents take up a rank of the ranking
+         * being scored; if not, they are passed over, and the
+         * documents after them move up.  A flag rather than a
+         * virtual call, as it is asked of every document. */
+        bool rank_unjudged_;
+        /* adjust the score of a ranking of $given$ documents, of
+         * which $ranked$ took up a rank.  Called at the end of each
+         * score(); by default, calls adjust_score(score). */
+        virtual RbpScore adjust_score(RbpScore score, unsigned ranked,
+          unsigned given) { return adjust_score(score); }
+        /* the older form of adjust_score, for scorers that need not
+         * know the length of the ranking. */
         virtual RbpScore adjust_score(RbpScore score) { return score; }
 
+        /* the state of a ranking being scored, a document at a time,
+         * with begin_pass, add_rel and end_pass. */
+        struct Pass {
+            RbpScore score;
+            unsigned ranked;
+            unsigned given;
+            const wgttab_t * tab;
+        };
+        void begin_pass(Pass &pass) {
+            pass.score = RbpScore(0.0, 1.0);
+            pass.ranked = pass.given = 0;
+            pass.tab = table(1);
+        }
+        void add_rel(Pass &pass, double rel) {
+            pass.given++;
+            if (rel < 0.0 && !rank_unjudged_)
+                return;
+            if (pass.ranked >= pass.tab->depth)
+                pass.tab = table(pass.ranked + 1);
+            if (rel > 1.0)
+                rel = 1.0;
+            if (rel >= 0.0)
+                pass.score.incr(rel, wgttab_wgt(pass.tab, pass.ranked));
+            pass.ranked++;
+        }
+        RbpScore end_pass(Pass &pass) {
+            return adjust_score(pass.score, pass.ranked, pass.given);
+        }
+        const std::string &key(const std::string &docid) { return docid; }
+        const std::string &key(const char * docid) {
+            key_.assign(docid);
+            return key_;
+        }
+
     public:
         virtual ~RbpScorer() {};
         /* RBP weight at depth $rank$ (counting from 0). */
         double weight(unsigned rank) {
-            double wgt = (1 - persist_) * pow(persist_, rank);
+            double wgt = wgttab_wgt(table(rank + 1), rank);
             assert(wgt <= 1.0);
             assert(wgt >= 0.0);
             return wgt;
@@ -102,19 +156,60 @@ class RbpScorer {
         /* residual remaining after judging $depth$ documents (counting
          * from 1). */
         double residual(unsigned depth) {
-            return pow(persist_, depth);
+            return wgttab_resid(table(depth), depth);
         }
 
     public:
-        RbpScorer(double persist) : persist_(persist) { }
+        RbpScorer(double persist) : persist_(persist), tab_(NULL),
+            rank_unjudged_(true) { }
+        /* score the relevances [$first$, $last$), in rank order, with
+         * negative values meaning unjudged.  Nothing is copied or
+         * allocated, so this (like the overloads that follow) is
+         * cheap to call many times over. */
+        template <typename RelIterator>
+        RbpScore score(RelIterator first, RelIterator last);
+        /* score the $num_rels$ relevances at $rels$. */
+        RbpScore score(const double * rels, unsigned num_rels) {
+            return score(rels, rels + num_rels);
+        }
+        /* score the docids [$first$, $last$), as std::strings or
+         * C strings, in rank order. */
+        template <typename DocidIterator>
+        RbpScore score_docids(const Qrels &qrels, DocidIterator first,
+          DocidIterator last);
         RbpScore score(const std::vector<double> &rels);
         RbpScore score(const Qrels &qrels, 
           const std::vector<std::string> &docs);
         RbpScore score(const Qrels &qrels, qdocs_t * qdocs);
+        /* score by the relevance vector cached on $qdocs$ (see
+         * qdocs_get_rels), so that scoring again, as at another
+         * persistence, does not repeat the join with the qrels. */
+        RbpScore score(qrels_t * qrels, qdocs_t * qdocs);
         RbpScore score(const Qrels &qrels, const Run &run);
 
 };
 
+template <typename RelIterator>
+RbpScore RbpScorer::score(RelIterator first, RelIterator last) {
+    Pass pass;
+
+    begin_pass(pass);
+    for (; first != last; ++first)
+        add_rel(pass, *first);
+    return end_pass(pass);
+}
+
+template <typename DocidIterator>
+RbpScore RbpScorer::score_docids(const Qrels &qrels, DocidIterator first,
+  DocidIterator last) {
+    Pass pass;
+
+    begin_pass(pass);
+    for (; first != last; ++first)
+        add_rel(pass, qrels.get(key(*first)));
+    return end_pass(pass);
+}
+
 class InducedRbpScorer : public RbpScorer {
     public:
         /* length of the filtered and unfiltered ranking lists for
@@ -134,10 +229,13 @@ class InducedRbpScorer : public RbpScorer {
         InducedRbpScorer(double persist, bool smear_residual=false,
           unsigned judgments=0, unsigned num_rel=0) 
             : RbpScorer(persist), smear_residual_(smear_residual),
-              judgments_(judgments), num_rel_(num_rel) { }
-        virtual bool filter_rels(const std::vector<double> &in,
-          std::vector<double> &out);
-        virtual RbpScore adjust_score(RbpScore score);
+              judgments_(judgments), num_rel_(num_rel) {
+            /* unjudged documents are dropped from the ranking */
+            rank_unjudged_ = false;
+        }
+        using RbpScorer::adjust_score;
+        virtual RbpScore adjust_score(RbpScore score, unsigned ranked,
+          unsigned given) override;
 };
 
 
@@ -0,0 +1,100 @@
+/*
+ *  Check kendpenalty against kendpenalty_pairwise, and compare their
+ *  speeds across list lengths.
+ */
+
+#include "kendpenalty.h"
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <ctime>
+#include <stdlib.h>
+
+using namespace rbp;
+
+/* a list of $len$ distinct elements, drawn from $universe$ */
+static std::vector<int> random_list(unsigned len, unsigned universe) {
+    std::vector<int> all;
+    unsigned i;
+
+    for (i = 0; i < universe; i++)
+        all.push_back(i);
+    for (i = 0; i < len && i < universe; i++)
+        std::swap(all[i], all[i + random() % (universe - i)]);
+    all.resize(len < universe ? len : universe);
+    return all;
+}
+
+static void check(const std::vector<int> &a, const std::vector<int> &b,
+  double penalty, int depth) {
+    double fast = kendpenalty(a.begin(), a.end(), b.begin(), b.end(),
+      penalty, depth);
+    double slow = kendpenalty_pairwise(a.begin(), a.end(), b.begin(),
+      b.end(), penalty, depth);
+
+    /* with an empty list, both divide by 0 */
+    if (std::isnan(slow))
+        assert(std::isnan(fast));
+    /* a penalty of a multiple of a power of two is exact */
+    else if (penalty * 4 == floor(penalty * 4))
+        assert(fast == slow);
+    else
+        assert(fabs(fast - slow) < 1e-12);
+}
+
+static double seconds(std::vector<int> &a, std::vector<int> &b,
+  bool pairwise, unsigned reps) {
+    clock_t start = clock();
+    double sum = 0.0;
+    unsigned r;
+
+    for (r = 0; r < reps; r++) {
+        if (pairwise)
+            sum += kendpenalty_pairwise(a.begin(), a.end(), b.begin(),
+              b.end(), 0.5);
+        else
+            sum += kendpenalty(a.begin(), a.end(), b.begin(), b.end(),
+              0.5);
+    }
+    assert(sum == sum);
+    return (double) (clock() - start) / CLOCKS_PER_SEC / reps;
+}
+
+int main(int argc, char ** argv) {
+    const double penalties[] = { 0.0, 0.5, 1.0, 0.3 };
+    const unsigned lengths[] = { 10, 100, 1000, 5000, 20000 };
+    unsigned t, p, l;
+
+    srandom(1);
+    /* lists from small universes overlap a lot, from large ones
+     * little, so giving all four kinds of pair */
+    for (t = 0; t < 2000; t++) {
+        unsigned universe = 1 + random() % 60;
+        std::vector<int> a = random_list(random() % 30, universe);
+        std::vector<int> b = random_list(random() % 30, universe);
+        int depth = random() % 4 == 0 ? random() % 20 : -1;
+
+        for (p = 0; p < sizeof(penalties) / sizeof(penalties[0]); p++)
+            check(a, b, penalties[p], depth);
+    }
+    std::cout << "agreement checked" << std::endl;
+
+    if (argc > 1 && std::string(argv[1]) == "-b") {
+        std::cout << "length pairwise(s) fenwick(s)" << std::endl;
+        for (l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            std::vector<int> a = random_list(lengths[l], lengths[l] * 2);
+            std::vector<int> b = random_list(lengths[l], lengths[l] * 2);
+            unsigned reps = 100000 / lengths[l] + 1;
+
+            std::cout << lengths[l] << " ";
+            if (lengths[l] <= 5000)
+                std::cout << seconds(a, b, true, reps > 10 ? 10 : reps);
+            else
+                std::cout << "-";
+            std::cout << " " << seconds(a, b, false, reps) << std::endl;
+        }
+    }
+    return 0;
+}
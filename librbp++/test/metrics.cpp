@@ -0,0 +1,98 @@
+#include "rbp.h"
+#include "metrics.h"
+
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <stdio.h>
+
+using namespace rbp;
+
+#define ERR_BUF_LEN 1024
+
+typedef Metrics<DcgMetric, Metrics<RbpMetric, Metrics<PrecisionMetric,
+        Metrics<ApMetric, Metrics<RrMetric> > > > > AllMetrics;
+
+static bool near(double a, double b) {
+    return fabs(a - b) < 1e-12;
+}
+
+int main(int argc, char ** argv) {
+    FILE * fp;
+    qrels_t * qrels;
+    run_t * run;
+    char err_buf[ERR_BUF_LEN];
+    std::vector<TopicMetrics<AllMetrics> > topics;
+    AllMetrics mean;
+    RbpScorer scorer(0.95);
+    std::vector<unsigned> cutoffs;
+    unsigned t;
+
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <qrels> <run>" << std::endl;
+        exit(1);
+    }
+    fp = fopen(argv[1], "r");
+    assert(fp != NULL);
+    qrels = load_qrels(fp, err_buf, ERR_BUF_LEN);
+    fclose(fp);
+    assert(qrels != NULL);
+    qrels_set_reltype(qrels, RELTYPE_BINARY, 1.0);
+    fp = fopen(argv[2], "r");
+    assert(fp != NULL);
+    run = load_run(fp, err_buf, ERR_BUF_LEN);
+    fclose(fp);
+    assert(run != NULL);
+
+    cutoffs.push_back(5);
+    cutoffs.push_back(0);
+    cutoffs.push_back(1);
+    mean = evaluate_run(AllMetrics(), qrels, run, topics);
+    for (t = 0; t < topics.size(); t++) {
+        const AllMetrics &m = topics[t].metrics;
+        qdocs_t * qdocs = run_get_qdocs_by_qid(run,
+          (char *) topics[t].qid);
+        DcgMetric dcg;
+        DcgMetric dcg_cutoffs(cutoffs), dcg_1(1), dcg_5(5), dcg_full(0);
+        Metrics<RbpMetric> rbp;
+        Metrics<PrecisionMetric> prec;
+        Metrics<ApMetric, Metrics<RrMetric> > ap_rr;
+        RbpScore score = scorer.score(qrels, qdocs);
+
+        /* each metric is the same calculated with others as alone */
+        assert(evaluate_topic(dcg, qrels, qdocs));
+        assert(evaluate_topic(rbp, qrels, qdocs));
+        assert(evaluate_topic(prec, qrels, qdocs));
+        assert(evaluate_topic(ap_rr, qrels, qdocs));
+        assert(evaluate_topic(dcg_cutoffs, qrels, qdocs));
+        assert(evaluate_topic(dcg_1, qrels, qdocs));
+        assert(evaluate_topic(dcg_5, qrels, qdocs));
+        assert(evaluate_topic(dcg_full, qrels, qdocs));
+        assert(m.dcg() == dcg.dcg());
+        /* several cutoffs in one pass give what each does alone */
+        assert(dcg_cutoffs.dcg_num_cutoffs() == 3);
+        assert(dcg_cutoffs.dcg(0) == dcg_1.dcg());
+        assert(dcg_cutoffs.dcg(1) == dcg_5.dcg());
+        assert(dcg_cutoffs.dcg(2) == dcg_full.dcg());
+        assert(dcg_1.dcg() <= 1.0 && dcg_5.dcg() <= 1.0);
+        assert(m.rbp() == rbp.rbp());
+        assert(m.rbp_residual() == rbp.rbp_residual());
+        assert(m.precision() == prec.precision());
+        assert(m.ap() == ap_rr.ap());
+        assert(m.rr() == ap_rr.rr());
+        /* and rbp agrees with the scorer's */
+        assert(near(m.rbp(), score.get_base()));
+        assert(near(m.rbp_residual(), score.get_residual()));
+        assert(m.dcg() >= 0.0 && m.dcg() <= 1.0);
+        assert(m.ap() >= 0.0 && m.ap() <= 1.0);
+        std::cout << topics[t].qid << " " << m.dcg() << " " << m.rbp()
+            << " +" << m.rbp_residual() << " " << m.precision() << " "
+            << m.ap() << " " << m.rr() << std::endl;
+    }
+    std::cout << "all " << mean.dcg() << " " << mean.rbp() << " +"
+        << mean.rbp_residual() << " " << mean.precision() << " "
+        << mean.ap() << " " << mean.rr() << std::endl;
+    run_delete(&run);
+    qrels_delete(&qrels);
+    return 0;
+}
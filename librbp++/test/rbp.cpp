@@ -4,9 +4,20 @@
 
 #include <iostream>
 #include <fstream>
+#include <cassert>
 
 using namespace rbp;
 
+/* a scorer that adjusts its scores by the older form of adjust_score */
+class HalvingRbpScorer : public RbpScorer {
+    public:
+        HalvingRbpScorer(double persist) : RbpScorer(persist) { }
+    protected:
+        virtual RbpScore adjust_score(RbpScore score) override {
+            return RbpScore(score.get_base() / 2, score.get_residual());
+        }
+};
+
 int main(int argc, char ** argv) {
     System system;
     Qrelset qrelset;
@@ -30,6 +41,39 @@ int main(int argc, char ** argv) {
         const Run &run = it->second;
         const Qrels &qrels = qrelset.get(topicid);
         RbpScore score = scorer.score(qrels, run);
+
+        /* the other ways of scoring the same ranking agree */
+        std::vector<std::string> docids;
+        std::vector<const char *> c_docids;
+        std::vector<double> rels, judged_rels;
+        for (Run::ConstIterator rit = run.begin(); rit != run.end();
+          rit++) {
+            double rel = qrels.get(rit->get_docid());
+            docids.push_back(rit->get_docid());
+            rels.push_back(rel);
+            if (rel >= 0.0)
+                judged_rels.push_back(rel);
+        }
+        for (unsigned d = 0; d < docids.size(); d++)
+            c_docids.push_back(docids[d].c_str());
+        assert(scorer.score(rels).get_base() == score.get_base());
+        assert(scorer.score(qrels, docids).get_residual()
+          == score.get_residual());
+        assert(scorer.score_docids(qrels, c_docids.begin(),
+              c_docids.end()).get_base() == score.get_base());
+        if (!rels.empty()) {
+            assert(scorer.score(&rels[0], rels.size()).get_base()
+              == score.get_base());
+        }
+        HalvingRbpScorer halving(0.95);
+        assert(halving.score(rels).get_base() == score.get_base() / 2);
+        /* induced rbp scores the judged documents alone */
+        InducedRbpScorer induced(0.95);
+        RbpScore induced_score = induced.score(rels);
+        assert(induced.last_unfiltered_length == (int) rels.size());
+        assert(induced.last_filtered_length == (int) judged_rels.size());
+        assert(induced_score.get_base()
+          == scorer.score(judged_rels).get_base());
         std::cout << topicid << " " << score.get_base()
             << " +" << score.get_residual() << std::endl;
     }
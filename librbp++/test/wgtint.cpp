@@ -0,0 +1,83 @@
+/*
+ *  Check wgtint against wgtint_search, and wgtint_matrix against
+ *  wgtint of each pair of runs.
+ */
+
+#include "wgtint.h"
+#include "runlist.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <stdlib.h>
+
+extern "C" {
+#include <librbp/run.h>
+}
+
+using namespace rbp;
+
+static std::vector<int> random_list(unsigned len, unsigned universe) {
+    std::vector<int> list;
+
+    while (list.size() < len)
+        list.push_back(random() % universe);
+    return list;
+}
+
+static bool same(double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+}
+
+int main(int argc, char ** argv) {
+    RunList runs;
+    unsigned t;
+
+    srandom(1);
+    /* with repeated elements, too, as wgtint_search allows them */
+    for (t = 0; t < 2000; t++) {
+        unsigned universe = 1 + random() % 40;
+        std::vector<int> a = random_list(random() % 30, universe);
+        std::vector<int> b = random_list(random() % 30, universe);
+        int depth = random() % 4 == 0 ? random() % 20 : -1;
+
+        assert(same(wgtint(a.begin(), a.end(), b.begin(), b.end(), depth),
+              wgtint_search(a.begin(), a.end(), b.begin(), b.end(),
+                depth)));
+    }
+    std::cout << "agreement checked" << std::endl;
+
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] << " <qid> <run> [<run>...]"
+            << std::endl;
+        return 1;
+    }
+    runs.load_runs(argv + 2, argc - 2);
+    std::vector<std::vector<double> > matrix = wgtint_matrix(runs,
+      argv[1]);
+    std::vector<std::vector<std::string> > rankings;
+    for (RunList::Iterator it = runs.begin(); it != runs.end(); it++) {
+        qdocs_t * qdocs = run_get_qdocs_by_qid(*it, argv[1]);
+        std::vector<std::string> ranking;
+
+        if (qdocs != NULL) {
+            doc_score_t * scores = qdocs_get_scores(qdocs, QDOCS_ORD_SCORE);
+            for (unsigned d = 0; d < qdocs_num_scores(qdocs); d++)
+                ranking.push_back(scores[d].docid);
+        }
+        rankings.push_back(ranking);
+    }
+    for (unsigned i = 0; i < matrix.size(); i++) {
+        for (unsigned j = 0; j < matrix.size(); j++) {
+            assert(same(matrix[i][j], matrix[j][i]));
+            assert(same(matrix[i][j], wgtint(rankings[i].begin(),
+                    rankings[i].end(), rankings[j].begin(),
+                    rankings[j].end())));
+            std::cout << (j > 0 ? " " : "") << matrix[i][j];
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
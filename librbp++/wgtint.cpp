@@ -0,0 +1,45 @@
+#include "wgtint.h"
+
+extern "C" {
+#include <librbp/strid.h>
+}
+
+using namespace rbp;
+
+std::vector<std::vector<double> > rbp::wgtint_matrix(RunList &runs,
+  const char * qid, int depth, enum qdocs_ord_t ord) {
+    std::vector<std::vector<unsigned> > lists;
+    std::vector<std::vector<double> > matrix(runs.num_runs(),
+      std::vector<double>(runs.num_runs()));
+    strid_t * ids = new_strid();
+
+    /* each run's ranking for the topic, as dense ids */
+    for (RunList::Iterator it = runs.begin(); it != runs.end(); it++) {
+        qdocs_t * qdocs = run_get_qdocs_by_qid(*it, (char *) qid);
+        std::vector<unsigned> list;
+
+        if (qdocs != NULL) {
+            doc_score_t * scores = qdocs_get_scores(qdocs, ord);
+            unsigned num_scores = qdocs_num_scores(qdocs);
+
+            if (depth >= 0 && num_scores > (unsigned) depth)
+                num_scores = depth;
+            for (unsigned d = 0; d < num_scores; d++)
+                list.push_back(strid_get_id(ids, scores[d].docid));
+        }
+        lists.push_back(list);
+    }
+
+    WgtintIdSet seen_a(strid_num_ids(ids)), seen_b(strid_num_ids(ids));
+    for (unsigned i = 0; i < lists.size(); i++) {
+        for (unsigned j = i; j < lists.size(); j++) {
+            matrix[i][j] = matrix[j][i] = wgtint_with(lists[i].begin(),
+              lists[i].end(), lists[j].begin(), lists[j].end(), depth,
+              seen_a, seen_b);
+            seen_a.clear();
+            seen_b.clear();
+        }
+    }
+    strid_delete(&ids);
+    return matrix;
+}
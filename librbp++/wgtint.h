@@ -2,6 +2,15 @@
 #define RBPCC_WGTINT_H
 
 #include <algorithm>
+#include <iterator>
+#include <vector>
+#include <unordered_set>
+
+#include "runlist.h"
+
+extern "C" {
+#include <librbp/qdocs.h>
+}
 
 namespace rbp {
 
@@ -20,18 +29,128 @@ namespace rbp {
  *  unspecified, then it is the shorter of the two lists.
  *  In any case, evaluation never goes deeper than the shorter
  *  list.
+ *
+ *  The elements of the prefixes are kept in hash sets, so the
+ *  calculation takes O(k) time, for any elements that std::hash
+ *  can hash.
  */
 template<class In> double wgtint(In start_a, In end_a, In start_b,
   In end_b, int depth=-1);
 
+/**
+ *  Calculate wgtint by searching the prefixes of the lists at each
+ *  rank, in O(k^2) time.  This is the original implementation, kept
+ *  as a reference for wgtint.
+ */
+template<class In> double wgtint_search(In start_a, In end_a,
+  In start_b, In end_b, int depth=-1);
+
+/**
+ *  Calculate wgtint between each pair of runs in $runs$ for the
+ *  topic $qid$, taking each run's documents in order $ord$.  Returns
+ *  the RxR matrix, with the distance between the i'th and j'th runs
+ *  at [i][j] (and [j][i]).  A run without the topic has no
+ *  documents, and so its distances are NaN.
+ *
+ *  The docids of the topic are mapped once to dense ids, which are
+ *  then compared by a flag array rather than hashed, so that each
+ *  pair takes O(k) time.
+ */
+std::vector<std::vector<double> > wgtint_matrix(RunList &runs,
+  const char * qid, int depth=-1, enum qdocs_ord_t ord=QDOCS_ORD_SCORE);
+
+/*
+ *  The set of the elements seen so far in a list, for wgtint.
+ */
+template<class T> class WgtintHashSet {
+    private:
+        std::unordered_set<T> set_;
+
+    public:
+        bool contains(const T &elem) const {
+            return set_.find(elem) != set_.end();
+        }
+        void insert(const T &elem) { set_.insert(elem); }
+};
+
+/*
+ *  The set of the dense ids, all less than $universe$, seen so far in
+ *  a list.  Clearing it takes time only for the ids inserted, so it
+ *  can be reused cheaply across many lists.
+ */
+class WgtintIdSet {
+    private:
+        std::vector<unsigned char> member_;
+        std::vector<unsigned> inserted_;
+
+    public:
+        WgtintIdSet(unsigned universe) : member_(universe, 0) { }
+        bool contains(unsigned id) const { return member_[id]; }
+        void insert(unsigned id) {
+            if (!member_[id]) {
+                member_[id] = 1;
+                inserted_.push_back(id);
+            }
+        }
+        void clear() {
+            for (unsigned i = 0; i < inserted_.size(); i++)
+                member_[inserted_[i]] = 0;
+            inserted_.clear();
+        }
+};
+
+/*
+ *  Calculate wgtint, with $seen_a$ and $seen_b$ (initially empty)
+ *  holding the elements seen so far of each list.
+ */
+template<class In, class Set> double wgtint_with(In start_a, In end_a,
+  In start_b, In end_b, int depth, Set &seen_a, Set &seen_b) {
+    int disjunction_size = 0;
+    int rank;
+    In a, b;
+    double disj_sum = 0.0;
+
+    for (a = start_a, b = start_b, rank = 0;
+      (depth < 0 || rank < depth) && a != end_a && b != end_b;
+      a++, b++, rank++) {
+        if (*a == *b) {
+            /* no change */
+        } else {
+            if (!seen_b.contains(*a)) {
+                disjunction_size++; /* one more disjoint */
+            } else {
+                disjunction_size--; /* existing partner is matched */
+            }
+            if (!seen_a.contains(*b)) {
+                disjunction_size++; /* one more disjoint */
+            } else {
+                disjunction_size--; /* existing partner is matched */
+            }
+        }
+        seen_a.insert(*a);
+        seen_b.insert(*b);
+        disj_sum += (double) disjunction_size / ((rank + 1) * 2);
+    }
+    return disj_sum / rank;
+}
+
 template<class In> double wgtint(In start_a, In end_a, In start_b,
-  In end_b, int depth=-1) {
+  In end_b, int depth) {
+    typedef typename std::iterator_traits<In>::value_type Elem;
+    WgtintHashSet<Elem> seen_a, seen_b;
+
+    return wgtint_with(start_a, end_a, start_b, end_b, depth, seen_a,
+      seen_b);
+}
+
+template<class In> double wgtint_search(In start_a, In end_a,
+  In start_b, In end_b, int depth) {
     int disjunction_size = 0;
     int rank;
     In a, b;
     double disj_sum = 0.0;
 
-    for (a = start_a, b = start_b, rank = 0; 
+    for (a = start_a, b = start_b, rank = 0;
       (depth < 0 || rank < depth) && a != end_a && b != end_b;
       a++, b++, rank++) {
         if (*a == *b) {
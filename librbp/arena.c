@@ -0,0 +1,190 @@
+#include <string.h>
+#include "arena.h"
+#include "util.h"
+
+#define ARENA_DEFAULT_BLOCK_SZ (64 * 1024)
+#define ARENA_ALIGN sizeof(double)
+
+typedef struct arena_block {
+    struct arena_block * next;
+    size_t size;
+    size_t used;
+    /* block memory follows, suitably aligned */
+} arena_block_t;
+
+#define BLOCK_HDR_SZ ((sizeof(arena_block_t) + ARENA_ALIGN - 1) \
+  & ~(ARENA_ALIGN - 1))
+#define BLOCK_MEM(b) ((char *) (b) + BLOCK_HDR_SZ)
+
+struct arena {
+    arena_block_t * blocks;
+    size_t block_size;
+    size_t total;
+};
+
+static arena_block_t * _new_block(arena_t * arena, size_t size);
+static void * _arena_bump(arena_t * arena, size_t size);
+
+arena_t * new_arena(size_t block_size) {
+    arena_t * arena;
+
+    arena = util_malloc_or_die(sizeof(*arena));
+    arena->blocks = NULL;
+    arena->block_size = block_size > 0 ? block_size : ARENA_DEFAULT_BLOCK_SZ;
+    arena->total = 0;
+    return arena;
+}
+
+void arena_delete(arena_t ** arena_p) {
+    arena_t * arena = *arena_p;
+    arena_block_t * b;
+
+    while ((b = arena->blocks) != NULL) {
+        arena->blocks = b->next;
+        free(b);
+    }
+    free(arena);
+    *arena_p = NULL;
+}
+
+void * arena_alloc(arena_t * arena, size_t size) {
+    arena_block_t * b = arena->blocks;
+
+    if (b != NULL)
+        b->used = (b->used + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+    return _arena_bump(arena, (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1));
+}
+
+char * arena_strndup(arena_t * arena, const char * str, size_t len) {
+    /* strings need no alignment, so are packed end to end */
+    char * dup = _arena_bump(arena, len + 1);
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+char * arena_strdup(arena_t * arena, const char * str) {
+    return arena_strndup(arena, str, strlen(str));
+}
+
+void arena_absorb(arena_t * arena, arena_t ** src_p) {
+    arena_t * src = *src_p;
+    arena_block_t * tail;
+
+    if (src->blocks != NULL) {
+        /* splice SRC's blocks in behind our current block */
+        for (tail = src->blocks; tail->next != NULL; tail = tail->next)
+            ;
+        if (arena->blocks != NULL) {
+            tail->next = arena->blocks->next;
+            arena->blocks->next = src->blocks;
+        } else {
+            arena->blocks = src->blocks;
+        }
+        arena->total += src->total;
+    }
+    free(src);
+    *src_p = NULL;
+}
+
+size_t arena_size(arena_t * arena) {
+    return arena->total;
+}
+
+static void * _arena_bump(arena_t * arena, size_t size) {
+    arena_block_t * b = arena->blocks;
+    void * mem;
+
+    if (b == NULL || b->used > b->size || b->size - b->used < size) {
+        if (size > arena->block_size / 4) {
+            /* oversized objects get a block of their own, placed behind
+             * the current block so its free space is not abandoned. */
+            b = _new_block(arena, size);
+            if (arena->blocks != NULL) {
+                b->next = arena->blocks->next;
+                arena->blocks->next = b;
+            } else {
+                arena->blocks = b;
+            }
+            b->used = size;
+            return BLOCK_MEM(b);
+        }
+        b = _new_block(arena, arena->block_size);
+        b->next = arena->blocks;
+        arena->blocks = b;
+        /* small arenas grow their blocks as they fill, so that a
+         * caller can start small without paying for it later. */
+        if (arena->block_size < ARENA_DEFAULT_BLOCK_SZ)
+            arena->block_size *= 2;
+    }
+    mem = BLOCK_MEM(b) + b->used;
+    b->used += size;
+    return mem;
+}
+
+static arena_block_t * _new_block(arena_t * arena, size_t size) {
+    arena_block_t * b;
+
+    b = util_malloc_or_die(BLOCK_HDR_SZ + size);
+    b->next = NULL;
+    b->size = size;
+    b->used = 0;
+    arena->total += size;
+    return b;
+}
+
+#ifdef ARENA_MAIN
+
+#include <assert.h>
+#include <stdio.h>
+
+int main(void) {
+    arena_t * arena, * other;
+    char * s1, * s2, * big;
+    size_t total;
+    double * d;
+    unsigned i;
+
+    arena = new_arena(64);
+    s1 = arena_strdup(arena, "abc");
+    s2 = arena_strndup(arena, "defghi", 3);
+    assert(strcmp(s1, "abc") == 0);
+    assert(strcmp(s2, "def") == 0);
+    d = arena_alloc(arena, sizeof(*d));
+    assert(((size_t) d) % ARENA_ALIGN == 0);
+    assert(s2 == s1 + 4);
+    *d = 1.5;
+
+    /* oversized allocation must not disturb the current block */
+    big = arena_alloc(arena, 1000);
+    memset(big, 'x', 1000);
+    s1 = arena_strdup(arena, "ghi");
+    assert(s1 - s2 < 64);
+    assert(strcmp(s2, "def") == 0);
+    assert(*d == 1.5);
+
+    for (i = 0; i < 1000; i++) {
+        char buf[16];
+        sprintf(buf, "%u", i);
+        s1 = arena_strdup(arena, buf);
+        assert(strcmp(s1, buf) == 0);
+    }
+    assert(arena_size(arena) >= 1000 + 3890);
+    /* blocks have doubled from 64 bytes */
+    assert(arena_size(arena) < 1000 + 3 * 3890);
+
+    other = new_arena(0);
+    s2 = arena_strdup(other, "jkl");
+    total = arena_size(arena) + arena_size(other);
+    arena_absorb(arena, &other);
+    assert(other == NULL);
+    assert(arena_size(arena) == total);
+    assert(strcmp(s2, "jkl") == 0);
+    s1 = arena_strdup(arena, "mno");
+    assert(strcmp(s1, "mno") == 0);
+    arena_delete(&arena);
+    assert(arena == NULL);
+    return 0;
+}
+
+#endif /* ARENA_MAIN */
@@ -0,0 +1,46 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/*
+ *  Bump allocator for many small objects that share a lifetime, such
+ *  as the docids of a run.  Memory is handed out from large blocks,
+ *  and is only released, all at once, when the arena is deleted.
+ */
+
+typedef struct arena arena_t;
+
+/*
+ *  Create a new arena.  A BLOCK_SIZE of 0 selects the default.  A
+ *  BLOCK_SIZE smaller than the default is doubled with each new block,
+ *  until it reaches the default.
+ */
+arena_t * new_arena(size_t block_size);
+
+/*
+ *  Allocate SIZE bytes, aligned for any basic type.
+ */
+void * arena_alloc(arena_t * arena, size_t size);
+
+/*
+ *  Copy the LEN bytes at STR into the arena, adding a terminating nul.
+ */
+char * arena_strndup(arena_t * arena, const char * str, size_t len);
+
+char * arena_strdup(arena_t * arena, const char * str);
+
+/*
+ *  Total bytes of block memory held by the arena.
+ */
+size_t arena_size(arena_t * arena);
+
+/*
+ *  Take over the memory of the arena at *SRC_P, which is deleted.
+ *  Everything allocated from it lives on until ARENA is deleted.
+ */
+void arena_absorb(arena_t * arena, arena_t ** src_p);
+
+void arena_delete(arena_t ** arena_p);
+
+#endif /* ARENA_H */
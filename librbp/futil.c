@@ -4,6 +4,10 @@
 #include <errno.h>
 #include "futil.h"
 
+#ifdef FUTIL_MMAP
+#include <sys/mman.h>
+#endif /* FUTIL_MMAP */
+
 int futil_is_writeable_dir(char * path) {
     struct stat st;
     uid_t euid;
@@ -82,4 +86,33 @@ int futil_is_readable_file(char * path) {
     return 1;
 }
 
+#ifdef FUTIL_MMAP
+
+int futil_map_file(FILE * fp, char ** map_p, size_t * map_sz_p,
+  size_t * off_p) {
+    struct stat st;
+    off_t off;
+    char * map;
+
+    if (fstat(fileno(fp), &st) != 0 || !S_ISREG(st.st_mode))
+        return 1;
+    off = ftello(fp);
+    if (off < 0 || off >= st.st_size)
+        return 1;
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
+    if (map == MAP_FAILED)
+        return 1;
+#ifdef MADV_SEQUENTIAL
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+#endif /* MADV_SEQUENTIAL */
+    *map_p = map;
+    *map_sz_p = st.st_size;
+    *off_p = off;
+    return 0;
+}
+
+void futil_unmap_file(char * map, size_t map_sz) {
+    munmap(map, map_sz);
+}
 
+#endif /* FUTIL_MMAP */
@@ -1,8 +1,34 @@
 #ifndef FUTIL_H
 #define FUTIL_H
 
+#include "config.h"
+
+#include <stdio.h>
+#include <stddef.h>
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#define FUTIL_MMAP
+#endif /* HAVE_SYS_MMAN_H && HAVE_MMAP */
+
 int futil_is_writeable_dir(char * path);
 
 int futil_is_readable_file(char * path);
 
+#ifdef FUTIL_MMAP
+
+/*
+ *  Map FP read-only, if it is a regular file with something left to
+ *  read in it.  The whole file is mapped; the unread part starts at
+ *  *OFF_P within the mapping.  FP's position is not changed.
+ *
+ *  Returns 0 if the file was mapped, and 1 if FP could not be mapped
+ *  and must be read as a stream instead.
+ */
+int futil_map_file(FILE * fp, char ** map_p, size_t * map_sz_p,
+  size_t * off_p);
+
+void futil_unmap_file(char * map, size_t map_sz);
+
+#endif /* FUTIL_MMAP */
+
 #endif /* FUTIL_H */
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include "error.h"
+#include "util.h"
 #include "persist.h"
 
 int parse_persist(persist_t * persist, char * spec, char * err_buf,
@@ -38,10 +39,63 @@ int parse_persist(persist_t * persist, char * spec, char * err_buf,
     return 0;
 }
 
+double * parse_persist_sweep(char * spec, unsigned * p_num, char * err_buf,
+  unsigned err_buf_len) {
+    double lo, hi;
+    unsigned long num;
+    char * cp;
+    char * end;
+    double * p;
+    unsigned i;
+
+    lo = strtod(spec, &end);
+    if (end == spec || *end != ':')
+        goto FORMAT_ERROR;
+    cp = end + 1;
+    hi = strtod(cp, &end);
+    if (end == cp || *end != ':')
+        goto FORMAT_ERROR;
+    cp = end + 1;
+    num = strtoul(cp, &end, 10);
+    if (end == cp || *end != '\0')
+        goto FORMAT_ERROR;
+    if (lo < 0.0 || hi > 1.0 || lo > hi) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len,
+              "persistence sweep '%s' must have 0.0 <= <lo> <= <hi> <= 1.0",
+              spec);
+        return NULL;
+    }
+    if (num == 0 || num > PERSIST_SWEEP_MAX_NUM || (num == 1 && lo != hi)) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len,
+              "persistence sweep '%s' must have between 2 and %d values, "
+              "or 1 if <lo> and <hi> are equal", spec,
+              PERSIST_SWEEP_MAX_NUM);
+        return NULL;
+    }
+    p = util_malloc_or_die(sizeof(*p) * num);
+    for (i = 0; i < num; i++) {
+        p[i] = num == 1 ? lo : lo + (hi - lo) * i / (num - 1);
+    }
+    /* make sure rounding leaves the end-points exact */
+    p[num - 1] = hi;
+    *p_num = num;
+    return p;
+
+FORMAT_ERROR:
+    if (err_buf)
+        snprintf(err_buf, err_buf_len,
+          "invalid format for persistence sweep '%s'.  Must be in form "
+          "'<lo>:<hi>:<num>'", spec);
+    return NULL;
+}
+
 #ifdef PERSIST_MAIN
 
 #include <stdio.h>
 #include <assert.h>
+#include <math.h>
 
 int main(void) {
     char * p1 = "0.8";
@@ -54,6 +108,8 @@ int main(void) {
     char * p8 = "";
     char * p9 = ".2,";
     persist_t p;
+    double * sweep;
+    unsigned sweep_num;
 
     error_set_log_stream(NULL);
     assert(parse_persist(&p, p1, NULL, 0) == 0);
@@ -80,6 +136,23 @@ int main(void) {
     assert(p.p_num = 1);
     assert(p.p[0] == 0.2);
 
+    sweep = parse_persist_sweep("0.5:0.99:50", &sweep_num, NULL, 0);
+    assert(sweep != NULL);
+    assert(sweep_num == 50);
+    assert(sweep[0] == 0.5);
+    assert(sweep[49] == 0.99);
+    assert(fabs(sweep[1] - 0.51) < 1e-12);
+    free(sweep);
+    sweep = parse_persist_sweep("0.8:0.8:1", &sweep_num, NULL, 0);
+    assert(sweep != NULL && sweep_num == 1 && sweep[0] == 0.8);
+    free(sweep);
+    assert(parse_persist_sweep("0.5:0.9:1", &sweep_num, NULL, 0) == NULL);
+    assert(parse_persist_sweep("0.9:0.5:10", &sweep_num, NULL, 0) == NULL);
+    assert(parse_persist_sweep("0.5:1.5:10", &sweep_num, NULL, 0) == NULL);
+    assert(parse_persist_sweep("0.5:0.9", &sweep_num, NULL, 0) == NULL);
+    assert(parse_persist_sweep("0.5:0.9:0", &sweep_num, NULL, 0) == NULL);
+    assert(parse_persist_sweep("0.5,0.9,10", &sweep_num, NULL, 0) == NULL);
+
     return 0;
 }
 
@@ -2,6 +2,7 @@
 #define PERSIST_H
 
 #define PERSIST_MAX_NUM 128
+#define PERSIST_SWEEP_MAX_NUM 1000000
 
 /*
  *  Specifications for user persistence ($p$ in the rbp paper).
@@ -19,4 +20,16 @@ typedef struct persist {
 int parse_persist(persist_t * persist, char * spec, char * err_buf,
   unsigned err_buf_len);
 
+/*
+ *  Parse a persistence sweep: NUM persistences evenly spaced from LO
+ *  to HI inclusive, for rbp_sweep_to_depth.  This is not limited to
+ *  PERSIST_MAX_NUM values.
+ *
+ *  The spec has the form '<lo>:<hi>:<num>'.  The persistences are
+ *  returned in a malloc'ed array, and their number in P_NUM; NULL is
+ *  returned on error.
+ */
+double * parse_persist_sweep(char * spec, unsigned * p_num, char * err_buf,
+  unsigned err_buf_len);
+
 #endif /* PERSIST_H */
@@ -13,6 +13,14 @@ struct qdocs {
     unsigned scores_num;
     unsigned scores_size;
     enum qdocs_ord_t ord;
+    int owns_docids;
+    strid_t * docno_dict;
+    /* cached relevances (see qdocs_get_rels), valid while RELS_SERIAL
+     * is that of the qrels they came from, and 0 otherwise. */
+    rel_t * rels;
+    unsigned rels_size;
+    unsigned long rels_serial;
+    enum qdocs_ord_t rels_ord;
 };
 
 static void _qdocs_reorder(qdocs_t * qd, enum qdocs_ord_t ord);
@@ -29,17 +37,26 @@ qdocs_t * new_qdocs(char * qid) {
     qd->scores_num = 0;
     qd->scores_size = 0;
     qd->ord = QDOCS_ORD_OCCUR;
+    qd->owns_docids = 1;
+    qd->docno_dict = NULL;
+    qd->rels = NULL;
+    qd->rels_size = 0;
+    qd->rels_serial = 0;
+    qd->rels_ord = QDOCS_ORD_OCCUR;
     return qd;
 }
 
 void qdocs_delete(qdocs_t ** qd_p) {
     qdocs_t * qd = *qd_p;
     unsigned i;
-    for (i = 0; i < qd->scores_num; i++) {
-        free(qd->scores[i].docid);
+    if (qd->owns_docids) {
+        for (i = 0; i < qd->scores_num; i++) {
+            free(qd->scores[i].docid);
+        }
     }
     free(qd->qid);
     free(qd->scores);
+    free(qd->rels);
     free(qd);
     *qd_p = NULL;
 }
@@ -52,6 +69,7 @@ void qdocs_add_doc_score(qdocs_t * qd, char * docid, unsigned rank,
     util_ensure_array_space((void **) &qd->scores, &qd->scores_size,
       qd->scores_num, sizeof(*qd->scores), SCORES_INIT_SZ,
       SCORES_EXP_FACTOR);
+    assert(qd->owns_docids);
     ds = &qd->scores[qd->scores_num];
     ds->docid = util_strdup_or_die(docid);
     util_downcase_str(ds->docid);
@@ -59,9 +77,65 @@ void qdocs_add_doc_score(qdocs_t * qd, char * docid, unsigned rank,
     ds->rank = rank;
     ds->occur = qd->scores_num;
     ds->flags = 0;
+    ds->docno = QDOCS_NO_DOCNO;
+    qd->docno_dict = NULL;
+    qd->rels_serial = 0;
     qd->scores_num++;
 }
 
+void qdocs_add_doc_score_ref(qdocs_t * qd, char * docid, unsigned rank,
+  double score) {
+    doc_score_t * ds; 
+    assert(qd->owns_docids == 0 || qd->scores_num == 0);
+    qd->owns_docids = 0;
+    util_ensure_array_space((void **) &qd->scores, &qd->scores_size,
+      qd->scores_num, sizeof(*qd->scores), SCORES_INIT_SZ,
+      SCORES_EXP_FACTOR);
+    ds = &qd->scores[qd->scores_num];
+    ds->docid = docid;
+    ds->score = score;
+    ds->rank = rank;
+    ds->occur = qd->scores_num;
+    ds->flags = 0;
+    ds->docno = QDOCS_NO_DOCNO;
+    qd->docno_dict = NULL;
+    qd->rels_serial = 0;
+    qd->scores_num++;
+}
+
+void qdocs_append(qdocs_t * qd, qdocs_t * src) {
+    unsigned i;
+
+    assert(qd->ord == QDOCS_ORD_OCCUR && src->ord == QDOCS_ORD_OCCUR);
+    assert(qd->scores_num == 0 || src->scores_num == 0
+      || qd->owns_docids == src->owns_docids);
+    if (qd->scores_num == 0) {
+        /* just take over SRC's array */
+        doc_score_t * tmp_scores = qd->scores;
+        unsigned tmp_size = qd->scores_size;
+        qd->scores = src->scores;
+        qd->scores_size = src->scores_size;
+        qd->scores_num = src->scores_num;
+        src->scores = tmp_scores;
+        src->scores_size = tmp_size;
+    } else {
+        for (i = 0; i < src->scores_num; i++) {
+            util_ensure_array_space((void **) &qd->scores,
+              &qd->scores_size, qd->scores_num, sizeof(*qd->scores),
+              SCORES_INIT_SZ, SCORES_EXP_FACTOR);
+            qd->scores[qd->scores_num] = src->scores[i];
+            qd->scores[qd->scores_num].occur = qd->scores_num;
+            qd->scores_num++;
+        }
+    }
+    if (src->scores_num > 0) {
+        qd->owns_docids = src->owns_docids;
+        qd->docno_dict = NULL;
+        qd->rels_serial = 0;
+    }
+    src->scores_num = 0;
+}
+
 char * qdocs_qid(qdocs_t * qd) {
     return qd->qid;
 }
@@ -78,6 +152,53 @@ doc_score_t * qdocs_get_scores(qdocs_t * qd, enum qdocs_ord_t ord) {
     return qd->scores;
 }
 
+void qdocs_resolve_docnos(qdocs_t * qd, strid_t * docids) {
+    unsigned i;
+
+    if (qd->docno_dict == docids)
+        return;
+    for (i = 0; i < qd->scores_num; i++)
+        qd->scores[i].docno = strid_lookup_id(docids, qd->scores[i].docid);
+    qd->docno_dict = docids;
+}
+
+strid_t * qdocs_docno_dict(qdocs_t * qd) {
+    return qd->docno_dict;
+}
+
+const rel_t * qdocs_get_rels(qdocs_t * qd, qrels_t * qrels,
+  enum qdocs_ord_t ord) {
+    doc_score_t * scores;
+    qid_qrels_t * qq;
+    int by_docno;
+    unsigned i;
+
+    scores = qdocs_get_scores(qd, ord);
+    if (qd->rels_serial == qrels_get_serial(qrels) && qd->rels_ord == ord)
+        return qd->rels;
+    if (qd->rels_size < qd->scores_num) {
+        free(qd->rels);
+        qd->rels = util_malloc_or_die(sizeof(*qd->rels) * qd->scores_num);
+        qd->rels_size = qd->scores_num;
+    }
+    qq = qrels_get_qid_qrels(qrels, qd->qid);
+    /* by docno if the docnos are resolved against the qrels' docids,
+     * which must then already exist */
+    by_docno = qd->docno_dict != NULL
+        && qd->docno_dict == qrels_get_docids(qrels);
+    for (i = 0; i < qd->scores_num; i++) {
+        if (qq == NULL)
+            qd->rels[i] = REL_UNJUDGED;
+        else if (by_docno)
+            qd->rels[i] = qid_qrels_get_rel_docno(qq, scores[i].docno);
+        else
+            qd->rels[i] = qid_qrels_get_rel(qq, scores[i].docid);
+    }
+    qd->rels_serial = qrels_get_serial(qrels);
+    qd->rels_ord = ord;
+    return qd->rels;
+}
+
 static void _qdocs_reorder(qdocs_t * qd, enum qdocs_ord_t ord) {
     cmp_fn_t cmp_fn = NULL;
     switch (ord) {
@@ -93,6 +214,9 @@ static void _qdocs_reorder(qdocs_t * qd, enum qdocs_ord_t ord) {
     }
     qsort(qd->scores, qd->scores_num, sizeof(*qd->scores), cmp_fn);
     qd->ord = ord;
+    /* documents tied under CMP_FN may not come back in the order the
+     * relevances were cached in */
+    qd->rels_serial = 0;
 }
 
 static int _ds_cmp_occur(const void * va, const void * vb) {
@@ -129,14 +253,75 @@ static int _ds_cmp_score(const void * va, const void * vb) {
 #include <stdio.h>
 #include "run.h"
 
+#define TIED_DOCS 20
+
+/*
+ *  Check that the relevances of QD in order ORD are those of its
+ *  documents in that order.
+ */
+static void _check_rels(qdocs_t * qd, qrels_t * qrels,
+  enum qdocs_ord_t ord) {
+    const rel_t * rels = qdocs_get_rels(qd, qrels, ord);
+    doc_score_t * ds = qdocs_get_scores(qd, ord);
+    unsigned s;
+
+    for (s = 0; s < qdocs_num_scores(qd); s++) {
+        assert(rels[s] == qrels_get_rel(qrels, qdocs_qid(qd),
+              ds[s].docid));
+    }
+}
+
+/*
+ *  Reorder a ranking whose documents all share a rank, and check
+ *  that its cached relevances follow the documents.
+ */
+static void _test_tied_rels(void) {
+    char err_buf[256];
+    char docid[32];
+    FILE * fp;
+    qrels_t * qrels;
+    qdocs_t * qd;
+    unsigned d;
+
+    fp = tmpfile();
+    assert(fp != NULL);
+    for (d = 0; d < TIED_DOCS; d++)
+        fprintf(fp, "1 0 d%u %u\n", d, d % 3);
+    rewind(fp);
+    qrels = load_qrels(fp, err_buf, sizeof(err_buf));
+    assert(qrels != NULL);
+    fclose(fp);
+
+    qd = new_qdocs("1");
+    for (d = 0; d < TIED_DOCS; d++) {
+        sprintf(docid, "d%u", d);
+        /* scores reverse the order of occurrence */
+        qdocs_add_doc_score(qd, docid, 1, (double) d);
+    }
+    _check_rels(qd, qrels, QDOCS_ORD_RANK);
+    /* reordering by score and back by rank, without asking for the
+     * relevances in between, may leave the tied documents in a
+     * different order */
+    qdocs_get_scores(qd, QDOCS_ORD_SCORE);
+    _check_rels(qd, qrels, QDOCS_ORD_RANK);
+    qdocs_get_scores(qd, QDOCS_ORD_OCCUR);
+    _check_rels(qd, qrels, QDOCS_ORD_RANK);
+    _check_rels(qd, qrels, QDOCS_ORD_SCORE);
+    qdocs_delete(&qd);
+    qrels_delete(&qrels);
+}
+
 int main(int argc, char ** argv) {
     char * fname;
     FILE * fp;
     run_t * run;
     unsigned qd_num, i;
 
+    _test_tied_rels();
+    if (argc == 1)
+        return 0;
     if (argc != 2) {
-        fprintf(stderr, "Usage: %s <run-file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [<run-file>]\n", argv[0]);
         return -1;
     }
     fname = argv[1];
@@ -173,7 +358,7 @@ int main(int argc, char ** argv) {
 
         ds = qdocs_get_scores(qd, QDOCS_ORD_SCORE);
         for (s = 1; s < num_scores; s++) {
-            assert(ds[s].score >= ds[s - 1].score);
+            assert(ds[s].score <= ds[s - 1].score);
         }
     }
     run_delete(&run);
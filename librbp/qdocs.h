@@ -1,6 +1,10 @@
 #ifndef QDOCS_H
 #define QDOCS_H
 
+#include <limits.h>
+#include "strid.h"
+#include "qrels.h"
+
 typedef struct qdocs qdocs_t;
 
 typedef struct doc_score {
@@ -9,8 +13,13 @@ typedef struct doc_score {
     unsigned rank;
     double score;
     unsigned flags;
+    unsigned docno;   /* see qdocs_resolve_docnos */
 } doc_score_t;
 
+/* docno of a docid that has not been resolved, or is not in the
+ * dictionary it was resolved against (as with strid_lookup_id). */
+#define QDOCS_NO_DOCNO UINT_MAX
+
 enum qdocs_ord_t {
     QDOCS_ORD_OCCUR,
     QDOCS_ORD_RANK,
@@ -29,10 +38,52 @@ void qdocs_delete(qdocs_t ** qd_p);
 void qdocs_add_doc_score(qdocs_t * qd, char * docid, unsigned rank,
   double score);
 
+/*
+ *  Add a doc score without copying the docid.  DOCID must already be
+ *  downcased, and must outlive QD (typically it lives in an arena
+ *  owned by the run).  A qdocs cannot mix copied and referenced docids.
+ */
+void qdocs_add_doc_score_ref(qdocs_t * qd, char * docid, unsigned rank,
+  double score);
+
+/*
+ *  Move the doc scores of SRC onto the end of QD, renumbering their
+ *  occurrences to follow those already in QD.  SRC is left empty.
+ *  Both must be in QDOCS_ORD_OCCUR order.
+ */
+void qdocs_append(qdocs_t * qd, qdocs_t * src);
+
 unsigned qdocs_num_scores(qdocs_t * qd);
 
 char * qdocs_qid(qdocs_t * qd);
 
 doc_score_t * qdocs_get_scores(qdocs_t * qd, enum qdocs_ord_t ord);
 
+/*
+ *  Set the docno of each doc score to the id of its docid in DOCIDS,
+ *  which is only looked up in, not added to.  Relevance can then be
+ *  found by docno (see qrels_get_docids) rather than by docid string.
+ *  Adding doc scores afterwards undoes the resolution.
+ */
+void qdocs_resolve_docnos(qdocs_t * qd, strid_t * docids);
+
+/*
+ *  Get the dictionary the docnos were last resolved against, or NULL
+ *  if they are not resolved.
+ */
+strid_t * qdocs_docno_dict(qdocs_t * qd);
+
+/*
+ *  Get the relevance, as judged by QRELS, of each document in order
+ *  ORD (that of qdocs_get_scores), with REL_UNJUDGED marking those
+ *  that are not judged; every document is REL_UNJUDGED if QRELS has
+ *  no judgments for the query.  The vector is built on the first call
+ *  for a given qrels, relevance type and ordering, and kept, so that
+ *  several metrics, or several parameter settings, pay for the join
+ *  with the qrels only once.  It is valid until QD is next reordered
+ *  or added to, or another qrels or ordering is asked for.
+ */
+const rel_t * qdocs_get_rels(qdocs_t * qd, qrels_t * qrels,
+  enum qdocs_ord_t ord);
+
 #endif /* QDOCS_H */
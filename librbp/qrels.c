@@ -1,12 +1,18 @@
+#include "config.h"
+#include <stdlib.h>
 #include <errno.h>
 #include <assert.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
 #include "util.h"
 #include "strhash.h"
+#include "array.h"
 #include "qrels.h"
 #include "error.h"
+#include "futil.h"
 
 #define LINE_BUF_SZ 1024
 #define QID_BUF_SZ 256
@@ -17,113 +23,502 @@
 #define QREL_DOCID_COL 2
 #define QREL_REL_COL 3
 
-struct qrel {
-    const char * docid;
+#define IMG_READ_INIT_SZ (64 * 1024)
+
+/*
+ *  Qrels image format.  All integers are in native byte order, which
+ *  the BYTE_ORDER field of the header is there to check.  The image
+ *  consists of:
+ *
+ *    - a header (qrelsimg_hdr_t);
+ *    - a table of NUM_QIDS qid entries (qrelsimg_qid_t), sorted by qid
+ *      string, each giving the extent of the qid's judgments and of
+ *      its hash index;
+ *    - NUM_JUDGMENTS judgments (qrelsimg_judgment_t), grouped by qid,
+ *      and sorted within each qid by docno;
+ *    - NUM_BUCKETS hash buckets (qrelsimg_bucket_t), grouped by qid;
+ *      each qid has a power of two of them, and they index its
+ *      judgments by docid, using linear probing.  The hash function is
+ *      32-bit FNV-1a, and an empty bucket has a POS of QRELSIMG_EMPTY;
+ *    - a table of NUM_DOCIDS docid string offsets; a docid's docno is
+ *      its index in this table.  The order of the table is up to the
+ *      writer;
+ *    - a table of nul-terminated (and downcased) strings, which holds
+ *      the qids and the docids.
+ *
+ *  All strings are referred to by their offset in the string table.
+ *  Relevances are stored raw, as they appeared in the qrels file.
+ */
+#define QRELSIMG_MAGIC "\211RBPQRL\n"
+#define QRELSIMG_MAGIC_LEN 8
+#define QRELSIMG_VERSION 1
+#define QRELSIMG_BYTE_ORDER 0x01020304
+#define QRELSIMG_EMPTY 0xffffffffU
+
+typedef struct qrelsimg_hdr {
+    char magic[QRELSIMG_MAGIC_LEN];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_qids;
+    uint32_t num_docids;
+    uint32_t all_rels_are_integral;
+    uint32_t pad;
+    double max_rel;
+    uint64_t num_judgments;
+    uint64_t num_buckets;
+    uint64_t qids_off;
+    uint64_t judgments_off;
+    uint64_t buckets_off;
+    uint64_t docids_off;
+    uint64_t strtab_off;
+    uint64_t strtab_sz;
+} qrelsimg_hdr_t;
+
+typedef struct qrelsimg_qid {
+    uint64_t first;
+    uint64_t first_bucket;
+    uint32_t qid;
+    uint32_t num_judged;
+    uint32_t num_buckets;
+    uint32_t pad;
+    double raw_num_rel;
+} qrelsimg_qid_t;
+
+typedef struct qrelsimg_judgment {
     double rel;
+    uint32_t docno;
+    uint32_t pad;
+} qrelsimg_judgment_t;
+
+typedef struct qrelsimg_bucket {
+    uint32_t hash;
+    uint32_t pos;
+} qrelsimg_bucket_t;
+
+/* docno hash slot; see qrels_get_docids */
+struct docno_rel {
+    unsigned docno;
+    rel_t rel;
 };
 
+#define DOCNO_EMPTY UINT_MAX
+
+/* the next qrels serial number; 0 is never used */
+static unsigned long next_serial = 1;
+
+/*
+ *  Take the next serial number.  Qrels may be loaded, or their
+ *  relevance types set, on several threads at once, so this must be
+ *  atomic lest two qrels share a serial.
+ */
+static unsigned long _take_serial(void) {
+    return __atomic_fetch_add(&next_serial, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ *  Every qrels is held as a qrels image: either one mapped or read
+ *  from a file, or one built in memory from a text qrels file.  The
+ *  judgments of all qids share one array, so memory use follows the
+ *  number of judgments, however many qids they are spread across.
+ */
 struct qrels {
-    strhash_t * tbl;
+    /* see qrels_get_serial */
+    unsigned long serial;
     int all_rels_are_integral;
     enum reltype_t reltype;
     double reltype_arg;
     rel_t max_rel;
+
+    /* docid dictionary, and the docno hash slots of all qids, built
+     * by qrels_get_docids */
+    strid_t * docids;
+    struct docno_rel * docno_slots;
+
+    char * img;
+    size_t img_sz;
+    int img_mapped;
+    const qrelsimg_hdr_t * img_hdr;
+    const qrelsimg_qid_t * img_qids;
+    const qrelsimg_judgment_t * img_judgments;
+    const uint32_t * img_docids;
+    const qrelsimg_bucket_t * img_buckets;
+    const char * img_strtab;
+    struct qid_qrels * img_qqs;
 };
 
 struct qid_qrels {
-    double raw_num_rel;
-    strhash_t * tbl;
     struct qrels * qrels;
+    const qrelsimg_qid_t * img_qid;
+    size_t docno_first;
+    unsigned docno_mask;
 };
 
 struct qrels_iterator {
-    strhash_iter_t * sh_iter;
     struct qid_qrels * qq;
+    uint64_t img_pos;
 };
 
 struct qrel_line_pos {
     char * qid, * iter, * docid, * rel;
 };
 
-struct count_rel_data {
-    qrels_t * qr;
-    double count;
+/* a judgment read from a text qrels file */
+struct text_judgment {
+    uint32_t qid;
+    uint32_t docno;
+    unsigned line;
+    double rel;
+};
+
+ARRAY_TYPE_DECL(str_array_t, const char *);
+ARRAY_TYPE_DECL(double_array_t, double);
+ARRAY_TYPE_DECL(text_judgment_array_t, struct text_judgment);
+
+/*
+ *  A text qrels file, as read, before it is built into an image.  Qids
+ *  and docids are numbered in order of first appearance.
+ */
+struct qrels_text {
+    strhash_t * qid_ids;
+    strhash_t * docid_ids;
+    str_array_t qids;
+    str_array_t docids;
+    double_array_t raw_num_rels;
+    text_judgment_array_t judgments;
 };
 
 static qrels_t * _new_qrels();
+static qrels_t * _load_qrels_text(FILE * fp, char * err_buf,
+  unsigned err_buf_len);
+static int _build_qrels_img(qrels_t * qr, struct qrels_text * qt,
+  char * err_buf, unsigned err_buf_len);
 static int _parse_qrel_line(char * line, struct qrel_line_pos * pos);
-static struct qid_qrels * _new_qid_qrels(struct qrels * qrels);
-static struct qid_qrels * _get_qid_qrels(qrels_t * qrels, char * qid);
-static void _delete_qid_qrels(void * dat);
-static void _count_rel(const char * docid, strhash_data_t rel, void * userdata);
 static rel_t _adj_rel(qrels_t * qr, rel_t raw_rel);
+static int _load_qrels_img(qrels_t * qr, char * err_buf,
+  unsigned err_buf_len);
+static int _read_qrels_img_stream(qrels_t * qr, FILE * fp, char * err_buf,
+  unsigned err_buf_len);
+static const char * _img_docid(qrels_t * qr, uint32_t docno);
+static uint32_t _img_hash(const char * str);
+static int _str_ptr_cmp(const void * a, const void * b);
+static int _text_judgment_cmp(const void * a, const void * b);
+static unsigned _first_dup(struct text_judgment * judgments, size_t num,
+  struct text_judgment * dup);
+static void _dup_error(char * err_buf, unsigned err_buf_len,
+  const char * qid, const char * docid, unsigned line);
+static unsigned _docno_slots_size(unsigned num_judged);
+static void _add_docno_slot(qid_qrels_t * qq, unsigned docno, rel_t rel);
 
 qrels_t * load_qrels(FILE * fp, char * err_buf, unsigned err_buf_len) {
+    qrels_t * qr;
+    int ret;
+    int c;
+#ifdef FUTIL_MMAP
+    char * map;
+    size_t map_sz;
+    size_t off;
+
+    if (futil_map_file(fp, &map, &map_sz, &off) == 0) {
+        if (off == 0 && map_sz >= QRELSIMG_MAGIC_LEN
+          && memcmp(map, QRELSIMG_MAGIC, QRELSIMG_MAGIC_LEN) == 0) {
+            /* keep the mapping, as the docids point into it */
+            qr = _new_qrels();
+            qr->img = map;
+            qr->img_sz = map_sz;
+            qr->img_mapped = 1;
+            ret = _load_qrels_img(qr, err_buf, err_buf_len);
+            fseeko(fp, 0, SEEK_END);
+            if (ret < 0)
+                qrels_delete(&qr);
+            return qr;
+        }
+        futil_unmap_file(map, map_sz);
+    }
+#endif /* FUTIL_MMAP */
+    /* no qrels line can begin with the first byte of the magic */
+    if ((c = getc(fp)) == (unsigned char) QRELSIMG_MAGIC[0]) {
+        qr = _new_qrels();
+        if (_read_qrels_img_stream(qr, fp, err_buf, err_buf_len) < 0)
+            qrels_delete(&qr);
+        return qr;
+    } else if (c != EOF) {
+        ungetc(c, fp);
+    }
+    return _load_qrels_text(fp, err_buf, err_buf_len);
+}
+
+static qrels_t * _load_qrels_text(FILE * fp, char * err_buf,
+  unsigned err_buf_len) {
     char line_buf[LINE_BUF_SZ];
-    char qid_buf[QID_BUF_SZ];
-    struct qid_qrels * qq = NULL;
+    struct qrels_text qt;
+    const char * qid = NULL;
+    uint32_t qidn = 0;
     unsigned line_num = 0;
     qrels_t * qr;
+    int ret = -1;
 
-    qid_buf[0] = '\0';
     qr = _new_qrels();
+    qt.qid_ids = new_strhash();
+    qt.docid_ids = new_strhash();
+    ARRAY_INIT(qt.qids);
+    ARRAY_INIT(qt.docids);
+    ARRAY_INIT(qt.raw_num_rels);
+    ARRAY_INIT(qt.judgments);
     while (fgets(line_buf, LINE_BUF_SZ, fp) != NULL) {
-        int ret;
         struct qrel_line_pos pos;
-        rel_t rel;
+        struct text_judgment judgment;
         char * relend;
-        strhash_data_t * reldatp;
+        const char * docid;
+        strhash_data_t * datp;
         int found;
 
         line_num++;
-        ret = _parse_qrel_line(line_buf, &pos);
-        if (ret < 0) {
+        if (_parse_qrel_line(line_buf, &pos) < 0) {
             if (err_buf)
                 snprintf(err_buf, err_buf_len, 
                   "wrong number of fields on line %d of qrels file", line_num);
-            qrels_delete(&qr);
-            return NULL;
+            goto BAD_LINE;
         }
-        rel = strtod(pos.rel, &relend);
-        if (rel < 0.0 || *relend != '\0') {
+        judgment.rel = strtod(pos.rel, &relend);
+        if (judgment.rel < 0.0 || *relend != '\0') {
             if (err_buf)
                 snprintf(err_buf, err_buf_len,
                   "rel not a non-negative float on line %d of qrels file",
                   line_num);
-            qrels_delete(&qr);
-            return NULL;
+            goto BAD_LINE;
         }
-        if (rel > qr->max_rel)
-            qr->max_rel = rel;
+        if (judgment.rel > qr->max_rel)
+            qr->max_rel = judgment.rel;
         if (qr->all_rels_are_integral && strchr(pos.rel, '.') != NULL) {
             qr->all_rels_are_integral = 0;
         }
         util_downcase_str(pos.qid);
         util_downcase_str(pos.docid);
-        if (strcmp(pos.qid, qid_buf) != 0) {
-            strncpy(qid_buf, pos.qid, QID_BUF_SZ);
-            qid_buf[QID_BUF_SZ - 1] = '\0';
-            qq = _get_qid_qrels(qr, pos.qid);
+        /* a qid's judgments are usually together */
+        if (qid == NULL || strcmp(pos.qid, qid) != 0) {
+            datp = strhash_update_grab_key(qt.qid_ids, pos.qid, &found, &qid);
+            if (!found) {
+                datp->u = qt.qids.elem_count;
+                ARRAY_ADD(qt.qids, qid);
+                ARRAY_ADD(qt.raw_num_rels, 0.0);
+            }
+            qidn = datp->u;
         }
-        reldatp = strhash_update(qq->tbl, pos.docid, &found);
-        if (found) {
-            if (err_buf)
-                snprintf(err_buf, err_buf_len,
-                  "duplicate relevance for qid '%s' and docid '%s' on line "
-                  "'%d'", pos.qid, pos.docid, line_num);
-            qrels_delete(&qr);
-            return NULL;
+        datp = strhash_update_grab_key(qt.docid_ids, pos.docid, &found,
+          &docid);
+        if (!found) {
+            datp->u = qt.docids.elem_count;
+            ARRAY_ADD(qt.docids, docid);
         }
-        if (rel > 0.0) {
-            qq->raw_num_rel += rel;
+        judgment.qid = qidn;
+        judgment.docno = datp->u;
+        judgment.line = line_num;
+        if (judgment.rel > 0.0) {
+            qt.raw_num_rels.elems[qidn] += judgment.rel;
         }
-        reldatp->lf = rel;
+        ARRAY_ADD(qt.judgments, judgment);
+    }
+    ret = _build_qrels_img(qr, &qt, err_buf, err_buf_len);
+    goto END;
+
+BAD_LINE:
+    /* duplicates are only looked for once all the judgments are read,
+     * but one on an earlier line than this is the first error */
+    {
+        struct text_judgment dup;
+
+        if (_first_dup(qt.judgments.elems, qt.judgments.elem_count, &dup)
+          != 0 && err_buf)
+            _dup_error(err_buf, err_buf_len, qt.qids.elems[dup.qid],
+              qt.docids.elems[dup.docno], dup.line);
     }
+
+END:
+    strhash_delete(&qt.qid_ids, NULL);
+    strhash_delete(&qt.docid_ids, NULL);
+    ARRAY_DELETE(qt.qids);
+    ARRAY_DELETE(qt.docids);
+    ARRAY_DELETE(qt.raw_num_rels);
+    ARRAY_DELETE(qt.judgments);
+    if (ret < 0)
+        qrels_delete(&qr);
     return qr;
 }
 
+/*
+ *  Build QR's image, in memory, from the text qrels QT.  The judgments
+ *  of QT are released as they are taken over.
+ */
+static int _build_qrels_img(qrels_t * qr, struct qrels_text * qt,
+  char * err_buf, unsigned err_buf_len) {
+    uint32_t num_qids = qt->qids.elem_count;
+    uint32_t num_docids = qt->docids.elem_count;
+    size_t num_judgments = qt->judgments.elem_count;
+    uint32_t * qid_rank;
+    size_t * fill;
+    struct text_judgment * judgments;
+    qrelsimg_hdr_t * hdr;
+    qrelsimg_qid_t * img_qids;
+    qrelsimg_judgment_t * img_judgments;
+    qrelsimg_bucket_t * buckets;
+    uint32_t * docid_offs;
+    char * strtab;
+    uint64_t num_buckets = 0;
+    uint64_t strtab_len = 0;
+    unsigned dup_line = 0;
+    struct text_judgment dup;
+    const char * dup_qid = NULL;
+    const char * dup_docid = NULL;
+    size_t j;
+    uint32_t q, d;
+
+    /* qids are put in string order, for searching; docnos stay in
+     * order of first appearance */
+    qsort(qt->qids.elems, num_qids, sizeof(*qt->qids.elems), _str_ptr_cmp);
+    qid_rank = util_malloc_or_die(sizeof(*qid_rank) * (num_qids + 1));
+    img_qids = util_malloc_or_die(sizeof(*img_qids) * (num_qids + 1));
+    memset(img_qids, 0, sizeof(*img_qids) * num_qids);
+    for (q = 0; q < num_qids; q++) {
+        uint32_t id = strhash_get(qt->qid_ids, qt->qids.elems[q], NULL).u;
+
+        qid_rank[id] = q;
+        img_qids[q].raw_num_rel = qt->raw_num_rels.elems[id];
+        strtab_len += strlen(qt->qids.elems[q]) + 1;
+    }
+    for (d = 0; d < num_docids; d++)
+        strtab_len += strlen(qt->docids.elems[d]) + 1;
+    if (strtab_len > UINT32_MAX) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "too many distinct docids "
+              "for qrels image");
+        free(img_qids);
+        free(qid_rank);
+        return -1;
+    }
+    if (strtab_len == 0) {
+        /* an empty qrels still has a (nul) string table */
+        strtab_len = 1;
+    }
+
+    /* bucket the judgments by qid, then sort each qid's by docno */
+    for (j = 0; j < num_judgments; j++)
+        img_qids[qid_rank[qt->judgments.elems[j].qid]].num_judged++;
+    fill = util_malloc_or_die(sizeof(*fill) * (num_qids + 1));
+    for (q = 0, j = 0; q < num_qids; q++) {
+        img_qids[q].first = fill[q] = j;
+        j += img_qids[q].num_judged;
+    }
+    judgments = util_malloc_or_die(sizeof(*judgments) * (num_judgments + 1));
+    for (j = 0; j < num_judgments; j++) {
+        struct text_judgment judgment = qt->judgments.elems[j];
+
+        judgment.qid = qid_rank[judgment.qid];
+        judgments[fill[judgment.qid]++] = judgment;
+    }
+    ARRAY_DELETE(qt->judgments);
+    ARRAY_INIT(qt->judgments);
+    free(fill);
+    for (q = 0; q < num_qids; q++) {
+        struct text_judgment * row = judgments + img_qids[q].first;
+        uint32_t num_judged = img_qids[q].num_judged;
+
+        if (_first_dup(row, num_judged, &dup) != 0
+          && (dup_line == 0 || dup.line < dup_line)) {
+            dup_line = dup.line;
+            dup_qid = qt->qids.elems[q];
+            dup_docid = qt->docids.elems[dup.docno];
+        }
+        img_qids[q].first_bucket = num_buckets;
+        /* keep the hash index at most half full */
+        for (img_qids[q].num_buckets = 1;
+          img_qids[q].num_buckets < num_judged * 2;
+          img_qids[q].num_buckets *= 2)
+            ;
+        num_buckets += img_qids[q].num_buckets;
+    }
+    if (dup_line != 0) {
+        if (err_buf)
+            _dup_error(err_buf, err_buf_len, dup_qid, dup_docid, dup_line);
+        free(judgments);
+        free(img_qids);
+        free(qid_rank);
+        return -1;
+    }
+
+    qr->img_sz = sizeof(*hdr) + sizeof(*img_qids) * num_qids
+        + sizeof(*img_judgments) * num_judgments
+        + sizeof(*buckets) * num_buckets + sizeof(*docid_offs) * num_docids
+        + strtab_len;
+    qr->img = util_malloc_or_die(qr->img_sz);
+    hdr = (qrelsimg_hdr_t *) qr->img;
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, QRELSIMG_MAGIC, QRELSIMG_MAGIC_LEN);
+    hdr->version = QRELSIMG_VERSION;
+    hdr->byte_order = QRELSIMG_BYTE_ORDER;
+    hdr->num_qids = num_qids;
+    hdr->num_docids = num_docids;
+    hdr->all_rels_are_integral = qr->all_rels_are_integral;
+    hdr->max_rel = qr->max_rel;
+    hdr->num_judgments = num_judgments;
+    hdr->num_buckets = num_buckets;
+    hdr->qids_off = sizeof(*hdr);
+    hdr->judgments_off = hdr->qids_off + sizeof(*img_qids) * num_qids;
+    hdr->buckets_off = hdr->judgments_off
+        + sizeof(*img_judgments) * num_judgments;
+    hdr->docids_off = hdr->buckets_off + sizeof(*buckets) * num_buckets;
+    hdr->strtab_off = hdr->docids_off + sizeof(*docid_offs) * num_docids;
+    hdr->strtab_sz = strtab_len;
+    img_judgments = (qrelsimg_judgment_t *) (qr->img + hdr->judgments_off);
+    buckets = (qrelsimg_bucket_t *) (qr->img + hdr->buckets_off);
+    docid_offs = (uint32_t *) (qr->img + hdr->docids_off);
+    strtab = qr->img + hdr->strtab_off;
+
+    /* strings, qids first */
+    strtab_len = 0;
+    strtab[0] = '\0';
+    for (q = 0; q < num_qids; q++) {
+        img_qids[q].qid = strtab_len;
+        strcpy(strtab + strtab_len, qt->qids.elems[q]);
+        strtab_len += strlen(qt->qids.elems[q]) + 1;
+    }
+    for (d = 0; d < num_docids; d++) {
+        docid_offs[d] = strtab_len;
+        strcpy(strtab + strtab_len, qt->docids.elems[d]);
+        strtab_len += strlen(qt->docids.elems[d]) + 1;
+    }
+    memcpy(qr->img + hdr->qids_off, img_qids, sizeof(*img_qids) * num_qids);
+
+    /* judgments, and their hash index */
+    memset(buckets, 0xff, sizeof(*buckets) * num_buckets);
+    for (q = 0; q < num_qids; q++) {
+        qrelsimg_bucket_t * qid_buckets = buckets + img_qids[q].first_bucket;
+        uint32_t mask = img_qids[q].num_buckets - 1;
+        uint32_t r;
+
+        for (r = 0; r < img_qids[q].num_judged; r++) {
+            uint32_t hash;
+            uint32_t b;
+
+            j = img_qids[q].first + r;
+            img_judgments[j].rel = judgments[j].rel;
+            img_judgments[j].docno = judgments[j].docno;
+            img_judgments[j].pad = 0;
+            hash = _img_hash(qt->docids.elems[judgments[j].docno]);
+            for (b = hash & mask; qid_buckets[b].pos != QRELSIMG_EMPTY;
+              b = (b + 1) & mask)
+                ;
+            qid_buckets[b].hash = hash;
+            qid_buckets[b].pos = r;
+        }
+    }
+    free(judgments);
+    free(img_qids);
+    free(qid_rank);
+    return _load_qrels_img(qr, err_buf, err_buf_len);
+}
+
 unsigned qrels_get_num_qids(qrels_t * qrels) {
-    return strhash_num_entries(qrels->tbl);
+    return qrels->img_hdr->num_qids;
 }
 
 static int qid_cmp(const void * a, const void * b) {
@@ -143,13 +538,10 @@ static int qid_cmp(const void * a, const void * b) {
 
 unsigned qrels_get_qids(qrels_t * qrels, const char ** qids_out,
   unsigned qids_out_size) {
-    strhash_iter_t * iter = strhash_get_iter(qrels->tbl);
     unsigned q;
 
-    for (q = 0; q < qids_out_size && 
-      (qids_out[q] = strhash_iter_next(iter, NULL)) != NULL; q++)
-        ;
-    strhash_iter_delete(&iter);
+    for (q = 0; q < qids_out_size && q < qrels->img_hdr->num_qids; q++)
+        qids_out[q] = qrels->img_strtab + qrels->img_qids[q].qid;
     qsort(qids_out, q, sizeof(*qids_out), qid_cmp);
     return q;
 }
@@ -158,11 +550,25 @@ void qrels_set_reltype(qrels_t * qrels, enum reltype_t reltype,
   double reltype_arg) {
     qrels->reltype = reltype;
     qrels->reltype_arg = reltype_arg;
+    qrels->serial = _take_serial();
+}
+
+unsigned long qrels_get_serial(qrels_t * qrels) {
+    return qrels->serial;
 }
 
 void qrels_delete(qrels_t ** qrels_p) {
     qrels_t * qrels = *qrels_p;
-    strhash_delete(&qrels->tbl, _delete_qid_qrels);
+#ifdef FUTIL_MMAP
+    if (qrels->img_mapped)
+        futil_unmap_file(qrels->img, qrels->img_sz);
+    else
+#endif /* FUTIL_MMAP */
+        free(qrels->img);
+    free(qrels->img_qqs);
+    if (qrels->docids != NULL)
+        strid_delete(&qrels->docids);
+    free(qrels->docno_slots);
     free(qrels);
     *qrels_p = NULL;
 }
@@ -190,37 +596,93 @@ double qrels_get_num_rel(qrels_t * qrels, const char * qid) {
 }
 
 qid_qrels_t * qrels_get_qid_qrels(qrels_t * qrels, const char * qid) {
-    return (qid_qrels_t *) strhash_get(qrels->tbl, qid, NULL).v;
+    uint32_t lo, hi;
+
+    /* image qids are in string order */
+    lo = 0;
+    hi = qrels->img_hdr->num_qids;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp(qid, qrels->img_strtab + qrels->img_qids[mid].qid);
+
+        if (cmp == 0)
+            return &qrels->img_qqs[mid];
+        else if (cmp < 0)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return NULL;
 }
 
 rel_t qid_qrels_get_rel(qid_qrels_t * qq, const char * docid) {
-    strhash_data_t rel;
-    int found;
+    qrels_t * qr = qq->qrels;
+    const qrelsimg_qid_t * img_qid = qq->img_qid;
+    const qrelsimg_judgment_t * row = qr->img_judgments + img_qid->first;
+    const qrelsimg_bucket_t * buckets = qr->img_buckets
+        + img_qid->first_bucket;
+    uint32_t mask = img_qid->num_buckets - 1;
+    uint32_t hash = _img_hash(docid);
+    uint32_t b;
+
+    for (b = hash & mask; buckets[b].pos != QRELSIMG_EMPTY;
+      b = (b + 1) & mask) {
+        if (buckets[b].hash == hash && strcmp(docid,
+              _img_docid(qr, row[buckets[b].pos].docno)) == 0)
+            return _adj_rel(qr, row[buckets[b].pos].rel);
+    }
+    return REL_UNJUDGED;
+}
+
+rel_t qid_qrels_get_rel_docno(qid_qrels_t * qq, unsigned docno) {
+    struct docno_rel * slots = qq->qrels->docno_slots + qq->docno_first;
+    unsigned s;
 
-    rel =  strhash_get(qq->tbl, docid, &found);
-    if (!found) {
+    /* most docids of a run are judged for no qid at all */
+    if (docno == DOCNO_EMPTY)
         return REL_UNJUDGED;
-    } else {
-        return _adj_rel(qq->qrels, rel.lf); 
+    for (s = docno & qq->docno_mask; slots[s].docno != DOCNO_EMPTY;
+      s = (s + 1) & qq->docno_mask) {
+        if (slots[s].docno == docno)
+            return _adj_rel(qq->qrels, slots[s].rel);
     }
+    return REL_UNJUDGED;
 }
 
 double qid_qrels_get_num_rel(qid_qrels_t * qq) {
-    struct count_rel_data dat;
-    dat.qr = qq->qrels;
-    dat.count = 0.0;
-    strhash_foreach(qq->tbl, _count_rel, &dat);
-    return dat.count;
+    qrels_t * qr = qq->qrels;
+    const qrelsimg_judgment_t * row = qr->img_judgments + qq->img_qid->first;
+    double count = 0.0;
+    uint32_t j;
+
+    if (qr->reltype == RELTYPE_FRACT
+      || (qr->reltype == RELTYPE_AUTO && !qr->all_rels_are_integral))
+        return qq->img_qid->raw_num_rel * qr->reltype_arg;
+    for (j = 0; j < qq->img_qid->num_judged; j++)
+        count += _adj_rel(qr, row[j].rel);
+    return count;
 }
 
 static qrels_t * _new_qrels() {
     qrels_t * qr;
     qr = util_malloc_or_die(sizeof(*qr));
-    qr->tbl = new_strhash();
+    qr->serial = _take_serial();
     qr->all_rels_are_integral = 1;
     qr->reltype = RELTYPE_AUTO;
     qr->reltype_arg = 1.0;
     qr->max_rel = 0.0;
+    qr->docids = NULL;
+    qr->docno_slots = NULL;
+    qr->img = NULL;
+    qr->img_sz = 0;
+    qr->img_mapped = 0;
+    qr->img_hdr = NULL;
+    qr->img_qids = NULL;
+    qr->img_judgments = NULL;
+    qr->img_docids = NULL;
+    qr->img_buckets = NULL;
+    qr->img_strtab = NULL;
+    qr->img_qqs = NULL;
     return qr;
 }
 
@@ -239,36 +701,6 @@ static int _parse_qrel_line(char * line, struct qrel_line_pos * pos) {
     return 0;
 }
 
-static struct qid_qrels * _new_qid_qrels(struct qrels * qrels) {
-    struct qid_qrels * qq;
-    qq = util_malloc_or_die(sizeof(*qq));
-    qq->tbl = new_strhash();
-    qq->raw_num_rel = 0;
-    qq->qrels = qrels;
-    return qq;
-}
-
-static struct qid_qrels * _get_qid_qrels(qrels_t * qrels, char * qid) {
-    struct qid_qrels ** qqp;
-    qqp = (struct qid_qrels **) strhash_update(qrels->tbl, qid, NULL);
-    if (*qqp == NULL) {
-        *qqp = _new_qid_qrels(qrels);
-    }
-    return *qqp;
-}
-
-static void _delete_qid_qrels(void * dat) {
-    struct qid_qrels * qq = dat;
-    strhash_delete(&qq->tbl, NULL);
-    free(qq);
-}
-
-static void _count_rel(const char * docid, strhash_data_t rel,
-  void * userdata) {
-    struct count_rel_data * rel_data = userdata;
-    rel_data->count += _adj_rel(rel_data->qr, rel.lf);
-}
-
 static rel_t _adj_rel(qrels_t * qr, rel_t raw_rel) {
     switch (qr->reltype) {
     case RELTYPE_AUTO:
@@ -295,41 +727,503 @@ RELTYPE_FRACT:
 
 qrels_iterator_t * qid_qrels_get_iterator(qid_qrels_t * qq) {
     qrels_iterator_t * qit = util_malloc_or_die(sizeof(*qit));
-    qit->sh_iter = strhash_get_iter(qq->tbl);
+    qit->img_pos = qq->img_qid->first;
     qit->qq = qq;
     return qit;
 }
 
 const char * qrel_iter_next(qrels_iterator_t * iter, rel_t * rel) {
-    strhash_data_t dat;
-    const char * docid = NULL;
+    qrels_t * qr = iter->qq->qrels;
+    const qrelsimg_qid_t * img_qid = iter->qq->img_qid;
 
-    docid =  strhash_iter_next(iter->sh_iter, &dat);
-    if (docid == NULL)
+    if (iter->img_pos >= img_qid->first + img_qid->num_judged)
         return NULL;
-    *rel = _adj_rel(iter->qq->qrels, dat.lf);
-    return docid;
+    *rel = _adj_rel(qr, qr->img_judgments[iter->img_pos].rel);
+    return _img_docid(qr, qr->img_judgments[iter->img_pos++].docno);
 }
 
 void qrel_iter_delete(qrels_iterator_t ** iter_p) {
-    strhash_iter_delete(&(*iter_p)->sh_iter);
     free(*iter_p);
     *iter_p = NULL;
 }
 
+strid_t * qrels_get_docids(qrels_t * qrels) {
+    const qrelsimg_hdr_t * hdr = qrels->img_hdr;
+    size_t num_slots = 0;
+    unsigned q, d;
+
+    if (qrels->docids != NULL)
+        return qrels->docids;
+    qrels->docids = new_strid();
+    /* image docnos are already dense, so become the ids as they are */
+    for (d = 0; d < hdr->num_docids; d++)
+        strid_get_id(qrels->docids, (char *) _img_docid(qrels, d));
+    for (q = 0; q < hdr->num_qids; q++) {
+        qrels->img_qqs[q].docno_first = num_slots;
+        num_slots += _docno_slots_size(qrels->img_qids[q].num_judged);
+    }
+    qrels->docno_slots = util_malloc_or_die(sizeof(struct docno_rel)
+      * (num_slots + 1));
+    memset(qrels->docno_slots, 0xff, sizeof(struct docno_rel) * num_slots);
+    for (q = 0; q < hdr->num_qids; q++) {
+        qid_qrels_t * qq = &qrels->img_qqs[q];
+        const qrelsimg_judgment_t * row = qrels->img_judgments
+            + qq->img_qid->first;
+        unsigned j;
+
+        qq->docno_mask = _docno_slots_size(qq->img_qid->num_judged) - 1;
+        for (j = 0; j < qq->img_qid->num_judged; j++)
+            _add_docno_slot(qq, row[j].docno, row[j].rel);
+    }
+    return qrels->docids;
+}
+
+int qrels_write_image(qrels_t * qrels, FILE * fp, char * err_buf,
+  unsigned err_buf_len) {
+    if (fwrite(qrels->img, 1, qrels->img_sz, fp) != qrels->img_sz
+      || fflush(fp) != 0) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "error writing qrels image: %s",
+              strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static int _load_qrels_img(qrels_t * qr, char * err_buf,
+  unsigned err_buf_len) {
+    const qrelsimg_hdr_t * hdr = (const qrelsimg_hdr_t *) qr->img;
+    const char * img = qr->img;
+    size_t img_sz = qr->img_sz;
+    uint64_t i;
+
+    if (img_sz < sizeof(*hdr)) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "qrels image truncated");
+        return -1;
+    }
+    if (hdr->byte_order != QRELSIMG_BYTE_ORDER) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len,
+              "qrels image has wrong byte order for this machine");
+        return -1;
+    }
+    if (hdr->version != QRELSIMG_VERSION) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len,
+              "qrels image has unsupported version %u",
+              (unsigned) hdr->version);
+        return -1;
+    }
+    if (hdr->qids_off > img_sz || (img_sz - hdr->qids_off)
+          / sizeof(qrelsimg_qid_t) < hdr->num_qids
+      || hdr->qids_off % sizeof(double) != 0
+      || hdr->judgments_off > img_sz || (img_sz - hdr->judgments_off)
+          / sizeof(qrelsimg_judgment_t) < hdr->num_judgments
+      || hdr->judgments_off % sizeof(double) != 0
+      || hdr->docids_off > img_sz || (img_sz - hdr->docids_off)
+          / sizeof(uint32_t) < hdr->num_docids
+      || hdr->docids_off % sizeof(uint32_t) != 0
+      || hdr->buckets_off > img_sz || (img_sz - hdr->buckets_off)
+          / sizeof(qrelsimg_bucket_t) < hdr->num_buckets
+      || hdr->buckets_off % sizeof(uint32_t) != 0
+      || hdr->strtab_off > img_sz || hdr->strtab_sz > img_sz - hdr->strtab_off
+      || hdr->strtab_sz == 0
+      || img[hdr->strtab_off + hdr->strtab_sz - 1] != '\0')
+        goto CORRUPT;
+    qr->img_hdr = hdr;
+    qr->img_qids = (const qrelsimg_qid_t *) (img + hdr->qids_off);
+    qr->img_judgments = (const qrelsimg_judgment_t *)
+        (img + hdr->judgments_off);
+    qr->img_docids = (const uint32_t *) (img + hdr->docids_off);
+    qr->img_buckets = (const qrelsimg_bucket_t *) (img + hdr->buckets_off);
+    qr->img_strtab = img + hdr->strtab_off;
+    for (i = 0; i < hdr->num_qids; i++) {
+        const qrelsimg_qid_t * img_qid = &qr->img_qids[i];
+        const qrelsimg_bucket_t * buckets;
+        uint32_t b;
+        uint32_t num_empty = 0;
+
+        if (img_qid->qid >= hdr->strtab_sz
+          || img_qid->first > hdr->num_judgments
+          || img_qid->num_judged > hdr->num_judgments - img_qid->first
+          || img_qid->first_bucket > hdr->num_buckets
+          || img_qid->num_buckets > hdr->num_buckets - img_qid->first_bucket
+          || img_qid->num_buckets <= img_qid->num_judged
+          || (img_qid->num_buckets & (img_qid->num_buckets - 1)) != 0)
+            goto CORRUPT;
+        buckets = (const qrelsimg_bucket_t *) (img + hdr->buckets_off)
+            + img_qid->first_bucket;
+        for (b = 0; b < img_qid->num_buckets; b++) {
+            if (buckets[b].pos == QRELSIMG_EMPTY)
+                num_empty++;
+            else if (buckets[b].pos >= img_qid->num_judged)
+                goto CORRUPT;
+        }
+        /* a lookup that misses probes until it finds an empty bucket */
+        if (num_empty == 0)
+            goto CORRUPT;
+    }
+    for (i = 0; i < hdr->num_docids; i++) {
+        if (qr->img_docids[i] >= hdr->strtab_sz)
+            goto CORRUPT;
+    }
+    for (i = 0; i < hdr->num_judgments; i++) {
+        if (qr->img_judgments[i].docno >= hdr->num_docids)
+            goto CORRUPT;
+    }
+    qr->all_rels_are_integral = hdr->all_rels_are_integral;
+    qr->max_rel = hdr->max_rel;
+    qr->img_qqs = util_malloc_or_die(sizeof(*qr->img_qqs)
+      * (hdr->num_qids + 1));
+    for (i = 0; i < hdr->num_qids; i++) {
+        struct qid_qrels * qq = &qr->img_qqs[i];
+
+        qq->qrels = qr;
+        qq->img_qid = &qr->img_qids[i];
+        qq->docno_first = 0;
+        qq->docno_mask = 0;
+    }
+    return 0;
+
+CORRUPT:
+    if (err_buf)
+        snprintf(err_buf, err_buf_len, "qrels image truncated or corrupt");
+    return -1;
+}
+
+/*
+ *  Read a qrels image from FP, whose first byte has already been read.
+ */
+static int _read_qrels_img_stream(qrels_t * qr, FILE * fp, char * err_buf,
+  unsigned err_buf_len) {
+    size_t size = IMG_READ_INIT_SZ;
+    size_t len = 1;
+    size_t nread;
+
+    qr->img = util_malloc_or_die(size);
+    qr->img[0] = QRELSIMG_MAGIC[0];
+    while ((nread = fread(qr->img + len, 1, size - len, fp)) > 0) {
+        len += nread;
+        if (len == size) {
+            size *= 2;
+            qr->img = util_realloc_or_die(qr->img, size);
+        }
+    }
+    qr->img_sz = len;
+    if (ferror(fp)) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "error reading qrels image: %s",
+              strerror(errno));
+        return -1;
+    }
+    if (len < QRELSIMG_MAGIC_LEN
+      || memcmp(qr->img, QRELSIMG_MAGIC, QRELSIMG_MAGIC_LEN) != 0) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "bad magic number in qrels image");
+        return -1;
+    }
+    return _load_qrels_img(qr, err_buf, err_buf_len);
+}
+
+static const char * _img_docid(qrels_t * qr, uint32_t docno) {
+    return qr->img_strtab + qr->img_docids[docno];
+}
+
+static uint32_t _img_hash(const char * str) {
+    uint32_t hash = 2166136261U;
+
+    for (; *str != '\0'; str++) {
+        hash ^= (unsigned char) *str;
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/*
+ *  Number of docno slots for a qid with NUM_JUDGED judgments: a power
+ *  of two, kept at most half full.
+ */
+static unsigned _docno_slots_size(unsigned num_judged) {
+    unsigned size;
+
+    for (size = 1; size < num_judged * 2; size *= 2)
+        ;
+    return size;
+}
+
+static void _add_docno_slot(qid_qrels_t * qq, unsigned docno, rel_t rel) {
+    struct docno_rel * slots = qq->qrels->docno_slots + qq->docno_first;
+    unsigned s;
+
+    for (s = docno & qq->docno_mask; slots[s].docno != DOCNO_EMPTY;
+      s = (s + 1) & qq->docno_mask)
+        ;
+    slots[s].docno = docno;
+    slots[s].rel = rel;
+}
+
+static int _str_ptr_cmp(const void * a, const void * b) {
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+static int _text_judgment_cmp(const void * a, const void * b) {
+    const struct text_judgment * ja = a;
+    const struct text_judgment * jb = b;
+
+    if (ja->qid != jb->qid)
+        return ja->qid < jb->qid ? -1 : 1;
+    else if (ja->docno != jb->docno)
+        return ja->docno < jb->docno ? -1 : 1;
+    else if (ja->line != jb->line)
+        return ja->line < jb->line ? -1 : 1;
+    return 0;
+}
+
+/*
+ *  Sort the NUM JUDGMENTS by qid, docno and line, and find the one on
+ *  the earliest line that repeats the qid and docno of another, into
+ *  DUP.  Returns its line, or 0 if there are no duplicates.
+ */
+static unsigned _first_dup(struct text_judgment * judgments, size_t num,
+  struct text_judgment * dup) {
+    unsigned dup_line = 0;
+    size_t j;
+
+    qsort(judgments, num, sizeof(*judgments), _text_judgment_cmp);
+    for (j = 1; j < num; j++) {
+        if (judgments[j].qid == judgments[j - 1].qid
+          && judgments[j].docno == judgments[j - 1].docno
+          && (dup_line == 0 || judgments[j].line < dup_line)) {
+            dup_line = judgments[j].line;
+            *dup = judgments[j];
+        }
+    }
+    return dup_line;
+}
+
+static void _dup_error(char * err_buf, unsigned err_buf_len,
+  const char * qid, const char * docid, unsigned line) {
+    snprintf(err_buf, err_buf_len,
+      "duplicate relevance for qid '%s' and docid '%s' on line '%d'",
+      qid, docid, line);
+}
+
 #ifdef QRELS_MAIN
 
+#include <math.h>
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define QRELS_TEST_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+#define SERIAL_NUM_THREADS 4
+#define SERIAL_NUM_SETS 10000
+
+static qrels_t * _load_qrels_str(const char * text, char * err_buf,
+  unsigned err_buf_len) {
+    FILE * fp = tmpfile();
+    qrels_t * qrels;
+
+    assert(fp != NULL);
+    fputs(text, fp);
+    rewind(fp);
+    qrels = load_qrels(fp, err_buf, err_buf_len);
+    fclose(fp);
+    return qrels;
+}
+
+static void _text_tests(void) {
+    char err_buf[LINE_BUF_SZ];
+    qrels_t * qrels;
+    const char * qids[4];
+
+    /* a qid's judgments need not be together */
+    qrels = _load_qrels_str("2 0 b 1\n10 0 a 0\n2 0 a 2\n10 0 c 1\n"
+      "2 0 c 0.5\n", NULL, 0);
+    assert(qrels != NULL);
+    assert(qrels_get_num_qids(qrels) == 2);
+    assert(qrels_get_qids(qrels, qids, 4) == 2);
+    assert(strcmp(qids[0], "2") == 0 && strcmp(qids[1], "10") == 0);
+    assert(qrels_get_rel(qrels, "2", "a") == 2.0);
+    assert(qrels_get_rel(qrels, "10", "a") == 0.0);
+    assert(qrels_get_rel(qrels, "10", "b") == REL_UNJUDGED);
+    assert(qrels_get_num_rel(qrels, "2") == 3.5);
+    assert(qrels_get_qid_qrels(qrels, "2")->img_qid->num_judged == 3);
+    qrels_delete(&qrels);
+
+    qrels = _load_qrels_str("", NULL, 0);
+    assert(qrels != NULL);
+    assert(qrels_get_num_qids(qrels) == 0);
+    assert(qrels_get_rel(qrels, "1", "a") == REL_INVALID_QID);
+    qrels_delete(&qrels);
+
+    /* the first duplicate, by line, is reported */
+    qrels = _load_qrels_str("1 0 a 1\n2 0 b 1\n2 0 a 1\n2 0 b 0\n"
+      "1 0 a 0\n", err_buf, LINE_BUF_SZ);
+    assert(qrels == NULL);
+    assert(strstr(err_buf, "'b'") != NULL);
+    assert(strstr(err_buf, "'4'") != NULL);
+    qrels = _load_qrels_str("1 0 a 1\n1 0 b\n", err_buf, LINE_BUF_SZ);
+    assert(qrels == NULL);
+    assert(strstr(err_buf, "line 2") != NULL);
+    /* as is a duplicate before a malformed line, but not after it */
+    qrels = _load_qrels_str("1 0 a 1\n1 0 a 0\n1 0 b\n", err_buf,
+      LINE_BUF_SZ);
+    assert(qrels == NULL);
+    assert(strstr(err_buf, "duplicate") != NULL);
+    assert(strstr(err_buf, "'2'") != NULL);
+    qrels = _load_qrels_str("1 0 a 1\n1 0 b -1\n1 0 a 0\n", err_buf,
+      LINE_BUF_SZ);
+    assert(qrels == NULL);
+    assert(strstr(err_buf, "rel not") != NULL);
+}
+
+/*
+ *  Load the image IMG of IMG_SZ bytes, through a file.
+ */
+static qrels_t * _load_qrels_img_buf(const char * img, size_t img_sz,
+  char * err_buf, unsigned err_buf_len) {
+    FILE * fp = tmpfile();
+    qrels_t * qrels;
+
+    assert(fp != NULL);
+    assert(fwrite(img, 1, img_sz, fp) == img_sz);
+    rewind(fp);
+    qrels = load_qrels(fp, err_buf, err_buf_len);
+    fclose(fp);
+    return qrels;
+}
+
+/*
+ *  Check that images whose hash buckets would send a lookup astray
+ *  are rejected as corrupt.
+ */
+static void _corrupt_img_tests(void) {
+    char err_buf[LINE_BUF_SZ];
+    qrels_t * qrels;
+    FILE * fp;
+    char * img;
+    size_t img_sz;
+    qrelsimg_hdr_t * hdr;
+    qrelsimg_qid_t * img_qid;
+    qrelsimg_bucket_t * buckets;
+    uint32_t b;
+
+    qrels = _load_qrels_str("1 0 a 1\n1 0 b 0\n2 0 c 1\n", NULL, 0);
+    assert(qrels != NULL);
+    fp = tmpfile();
+    assert(fp != NULL);
+    assert(qrels_write_image(qrels, fp, NULL, 0) == 0);
+    qrels_delete(&qrels);
+    img_sz = ftell(fp);
+    img = util_malloc_or_die(img_sz);
+    rewind(fp);
+    assert(fread(img, 1, img_sz, fp) == img_sz);
+    fclose(fp);
+    hdr = (qrelsimg_hdr_t *) img;
+    img_qid = (qrelsimg_qid_t *) (img + hdr->qids_off);
+    buckets = (qrelsimg_bucket_t *) (img + hdr->buckets_off)
+        + img_qid->first_bucket;
+
+    qrels = _load_qrels_img_buf(img, img_sz, NULL, 0);
+    assert(qrels != NULL);
+    assert(qrels_get_rel(qrels, "1", "z") == REL_UNJUDGED);
+    qrels_delete(&qrels);
+
+    /* no empty bucket, so that a miss would never end */
+    for (b = 0; b < img_qid->num_buckets; b++) {
+        if (buckets[b].pos == QRELSIMG_EMPTY)
+            buckets[b].pos = 0;
+    }
+    qrels = _load_qrels_img_buf(img, img_sz, err_buf, LINE_BUF_SZ);
+    assert(qrels == NULL);
+    assert(strstr(err_buf, "corrupt") != NULL);
+
+    /* a bucket pointing past the qid's judgments */
+    buckets[0].pos = img_qid->num_judged;
+    qrels = _load_qrels_img_buf(img, img_sz, err_buf, LINE_BUF_SZ);
+    assert(qrels == NULL);
+    free(img);
+}
+
+static void * _take_serials(void * arg) {
+    unsigned long * serials = arg;
+    qrels_t * qrels = _load_qrels_str("1 0 a 1\n", NULL, 0);
+    unsigned s;
+
+    assert(qrels != NULL);
+    for (s = 0; s < SERIAL_NUM_SETS; s++) {
+        qrels_set_reltype(qrels, RELTYPE_FRACT, 1.0);
+        serials[s] = qrels_get_serial(qrels);
+    }
+    qrels_delete(&qrels);
+    return NULL;
+}
+
+static int _ulong_cmp(const void * a, const void * b) {
+    unsigned long ua = *(const unsigned long *) a;
+    unsigned long ub = *(const unsigned long *) b;
+
+    return ua < ub ? -1 : ua > ub;
+}
+
+/*
+ *  Check that qrels given serials on several threads at once never
+ *  share one.
+ */
+static void _serial_tests(void) {
+    unsigned long * serials = util_malloc_or_die(sizeof(*serials)
+      * SERIAL_NUM_THREADS * SERIAL_NUM_SETS);
+    unsigned t, s;
+#ifdef QRELS_TEST_THREADS
+    pthread_t threads[SERIAL_NUM_THREADS];
+    int started[SERIAL_NUM_THREADS];
+
+    for (t = 0; t < SERIAL_NUM_THREADS; t++) {
+        started[t] = pthread_create(&threads[t], NULL, _take_serials,
+          serials + t * SERIAL_NUM_SETS) == 0;
+    }
+    for (t = 0; t < SERIAL_NUM_THREADS; t++) {
+        if (started[t])
+            pthread_join(threads[t], NULL);
+        else
+            _take_serials(serials + t * SERIAL_NUM_SETS);
+    }
+#else
+    for (t = 0; t < SERIAL_NUM_THREADS; t++)
+        _take_serials(serials + t * SERIAL_NUM_SETS);
+#endif /* QRELS_TEST_THREADS */
+    qsort(serials, SERIAL_NUM_THREADS * SERIAL_NUM_SETS, sizeof(*serials),
+      _ulong_cmp);
+    for (s = 0; s < SERIAL_NUM_THREADS * SERIAL_NUM_SETS; s++) {
+        assert(serials[s] != 0);
+        assert(s == 0 || serials[s] != serials[s - 1]);
+    }
+    free(serials);
+}
+
 int main(int argc, char ** argv) {
     char * fname;
     FILE * fp;
+    FILE * img_fp;
     qrels_t * qrels;
+    qrels_t * img_qrels;
     struct qrel_line_pos pos;
     char line_buf[LINE_BUF_SZ];
+    const char ** qids;
+    const char ** img_qids;
+    unsigned num_qids;
+    unsigned q;
 
     if (argc != 2) {
         fprintf(stderr, "Usage: %s <qrels-file>\n", argv[0]);
         return -1;
     }
+    _text_tests();
+    _corrupt_img_tests();
+    _serial_tests();
     fname = argv[1];
     fp = fopen(fname, "r");
     if (fp == NULL) {
@@ -342,25 +1236,101 @@ int main(int argc, char ** argv) {
         fclose(fp);
         return -1;
     }
+
+    /* round trip through an image, read both as a stream and mapped */
+    img_fp = tmpfile();
+    assert(img_fp != NULL);
+    assert(qrels_write_image(qrels, img_fp, NULL, 0) == 0);
+    rewind(img_fp);
+    img_qrels = load_qrels(img_fp, NULL, 0);
+    assert(img_qrels != NULL);
+    rewind(img_fp);
+    assert(getc(img_fp) == (unsigned char) QRELSIMG_MAGIC[0]);
+    qrels_delete(&img_qrels);
+    img_qrels = _new_qrels();
+    assert(_read_qrels_img_stream(img_qrels, img_fp, NULL, 0) == 0);
+    qrels_delete(&img_qrels);
+    rewind(img_fp);
+    img_qrels = load_qrels(img_fp, NULL, 0);
+    assert(img_qrels != NULL);
+    fclose(img_fp);
+
+    num_qids = qrels_get_num_qids(qrels);
+    assert(qrels_get_num_qids(img_qrels) == num_qids);
+    assert(qrels_get_max_rel(img_qrels) == qrels_get_max_rel(qrels));
+    qids = util_malloc_or_die(sizeof(*qids) * (num_qids + 1));
+    img_qids = util_malloc_or_die(sizeof(*img_qids) * (num_qids + 1));
+    assert(qrels_get_qids(qrels, qids, num_qids) == num_qids);
+    assert(qrels_get_qids(img_qrels, img_qids, num_qids) == num_qids);
+    for (q = 0; q < num_qids; q++) {
+        qid_qrels_t * qq;
+        qrels_iterator_t * qit;
+        const char * docid;
+        rel_t rel;
+        unsigned n = 0;
+
+        assert(strcmp(qids[q], img_qids[q]) == 0);
+        assert(fabs(qrels_get_num_rel(img_qrels, qids[q])
+              - qrels_get_num_rel(qrels, qids[q])) < 1e-9);
+        qq = qrels_get_qid_qrels(img_qrels, qids[q]);
+        qit = qid_qrels_get_iterator(qq);
+        while ((docid = qrel_iter_next(qit, &rel)) != NULL) {
+            assert(rel == qrels_get_rel(qrels, qids[q], docid));
+            n++;
+        }
+        qrel_iter_delete(&qit);
+        assert(n == qrels_get_qid_qrels(qrels, qids[q])->img_qid->num_judged);
+    }
+    free(img_qids);
+    free(qids);
+
+    /* compare raw relevances against the file */
+    qrels_set_reltype(qrels, RELTYPE_FRACT, 1.0);
+    qrels_set_reltype(img_qrels, RELTYPE_FRACT, 1.0);
     rewind(fp);
     while (fgets(line_buf, LINE_BUF_SZ, fp) != NULL) {
         qid_qrels_t * qq;
         qrels_iterator_t * qit;
         rel_t rel;
+        unsigned docno;
 
         _parse_qrel_line(line_buf, &pos);
+        util_downcase_str(pos.qid);
+        util_downcase_str(pos.docid);
         rel = qrels_get_rel(qrels, pos.qid, pos.docid);
         assert(rel == strtod(pos.rel, NULL));
+        assert(qrels_get_rel(img_qrels, pos.qid, pos.docid) == rel);
+        assert(qrels_get_rel(img_qrels, pos.qid, "no-docid-like-this-i-hope")
+          == REL_UNJUDGED);
+        assert(qrels_get_rel(img_qrels, "no-qid-like-this-i-hope", pos.docid)
+          == REL_INVALID_QID);
         assert(qrels_get_rel(qrels, pos.qid, "no-docid-like-this-i-hope")
           == REL_UNJUDGED);
         assert(qrels_get_rel(qrels, "no-qid-like-this-i-hope", pos.docid)
           == REL_INVALID_QID);
+
+        /* by docno */
+        qq = qrels_get_qid_qrels(img_qrels, pos.qid);
+        docno = strid_lookup_id(qrels_get_docids(img_qrels), pos.docid);
+        assert(docno != UINT_MAX);
+        assert(strcmp(strid_get_str(qrels_get_docids(img_qrels), docno),
+              pos.docid) == 0);
+        assert(qid_qrels_get_rel_docno(qq, docno) == rel);
+        assert(qid_qrels_get_rel_docno(qq, UINT_MAX) == REL_UNJUDGED);
         qq = qrels_get_qid_qrels(qrels, pos.qid);
+        docno = strid_lookup_id(qrels_get_docids(qrels), pos.docid);
+        assert(docno != UINT_MAX);
+        assert(qid_qrels_get_rel_docno(qq, docno) == rel);
+        assert(qid_qrels_get_rel_docno(qq, UINT_MAX) == REL_UNJUDGED);
+        assert(strid_lookup_id(qrels_get_docids(qrels),
+              "no-docid-like-this-i-hope") == UINT_MAX);
+
         qit = qid_qrels_get_iterator(qq);
         while ( (qrel_iter_next(qit, &rel)) != NULL) {
         }
         qrel_iter_delete(&qit);
     }
+    qrels_delete(&img_qrels);
     qrels_delete(&qrels);
     fclose(fp);
     return 0;
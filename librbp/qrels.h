@@ -2,6 +2,7 @@
 #define QREL_H
 
 #include <stdio.h>
+#include "strid.h"
 
 #define REL_UNJUDGED    (-1.0)
 #define REL_INVALID_QID (-2.0)
@@ -37,9 +38,26 @@ typedef struct qid_qrels qid_qrels_t;
 
 /**
  *  Load qrels from an input stream.
+ *
+ *  FP may also hold a qrels image, as written by qrels_write_image.
+ *  An image in a regular file is memory-mapped and used in place, so
+ *  loading it costs next to nothing, however large the qrels.  A text
+ *  qrels file is built into an image in memory, so either way memory
+ *  use is proportional to the number of judgments, not of topics.
  */
 qrels_t * load_qrels(FILE * fp, char * err_buf, unsigned err_buf_len);
 
+/**
+ *  Write QRELS to FP as a qrels image.  The image holds the judgments
+ *  of all topics in a single table, with a hash index for each topic,
+ *  along with the precomputed relevance statistics, and is specific to
+ *  the byte order of the machine it was written on.
+ *
+ *  Returns 0 on success, -1 on error.
+ */
+int qrels_write_image(qrels_t * qrels, FILE * fp, char * err_buf,
+  unsigned err_buf_len);
+
 /**
  *  Get the number of qids in the qrels.
  */
@@ -57,6 +75,16 @@ unsigned qrels_get_qids(qrels_t * qrels, const char ** qids_out,
 void qrels_set_reltype(qrels_t * qrels, enum reltype_t reltype, 
   double reltype_arg);
 
+/**
+ *  Get a number that identifies QRELS, with its relevance type, among
+ *  all the qrels of the process.  It changes whenever the relevance
+ *  type is set, so a cache of relevances taken from QRELS can tell
+ *  whether it is still valid (see qdocs_get_rels).  Serials are taken
+ *  atomically, so that qrels may be loaded, and their relevance types
+ *  set, on several threads at once.
+ */
+unsigned long qrels_get_serial(qrels_t * qrels);
+
 /**
  *  Get the maximum (raw) relevance score.
  */
@@ -88,6 +116,19 @@ double qrels_get_num_rel(qrels_t * qrels, const char * qid);
  */
 qid_qrels_t * qrels_get_qid_qrels(qrels_t * qrels, const char * qid);
 
+/**
+ *  Get a dictionary holding every docid judged in the qrels.  A run
+ *  resolved against it (run_resolve_docnos) can have the relevance of
+ *  its documents found by docno (qid_qrels_get_rel_docno), without
+ *  hashing the docid strings.
+ *
+ *  The dictionary is built on the first call, and belongs to QRELS.
+ *  Building it visits every judgment of every qid, so it pays only
+ *  when the same runs are evaluated many times over; evaluate_res
+ *  does not use it, and looks up each qid's judgments directly.
+ */
+strid_t * qrels_get_docids(qrels_t * qrels);
+
 /** 
  *  Delete a qrels structure.
  */
@@ -98,6 +139,13 @@ void qrels_delete(qrels_t ** qrels_p);
  */
 rel_t qid_qrels_get_rel(qid_qrels_t * qq, const char * docid);
 
+/**
+ *  Get relevance of a document for a qid, given the id of its docid in
+ *  the qrels_get_docids dictionary, which must already have been
+ *  built.  An unknown docno (UINT_MAX) is unjudged.
+ */
+rel_t qid_qrels_get_rel_docno(qid_qrels_t * qq, unsigned docno);
+
 /**
  *  Get the number of relevant documents for a qid.
  *
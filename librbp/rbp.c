@@ -1,8 +1,20 @@
 #include <math.h>
 #include <assert.h>
 #include <limits.h>
+#include <float.h>
+#include <string.h>
 #include "rbp.h"
 #include "util.h"
+#include "array.h"
+
+/* The AVX2 kernels are built with a per-function target attribute,
+ * so they need no special compiler flags, and are only used if the
+ * processor running us has AVX2. */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RBP_AVX2
+#include <immintrin.h>
+#define RBP_AVX2_TARGET __attribute__((target("avx2")))
+#endif
 
 #ifndef MAX
 #define MAX(a,b)((a) > (b) ? (a) : (b))
@@ -12,6 +24,27 @@
 #define MIN(a,b)((a) > (b) ? (b) : (a))
 #endif
 
+/* The per-persistence state is kept as one array per field, each
+ * padded to a whole number of vectors, so that the kernels below
+ * work on RBP_VEC_WIDTH persistences at a time with no remainder. */
+#define RBP_VEC_WIDTH 4
+#define RBP_NUM_FIELDS 8
+
+/* rbp_sweep_to_depth works through the persistences in blocks of
+ * this many, so that a block's state stays in cache. */
+#define RBP_SWEEP_BLOCK 64
+
+/* A tie in the ranking, as gathered by rbp_sweep_to_depth. */
+struct rbp_tie {
+    unsigned start;
+    unsigned len;
+    /* total relevance of the judged documents */
+    double rel;
+    unsigned num_unjudged;
+};
+
+ARRAY_TYPE_DECL(rbp_tie_arr_t, struct rbp_tie);
+
 struct rbp {
     qdocs_t * qdocs;
     enum qdocs_ord_t ord;
@@ -20,6 +53,34 @@ struct rbp {
     unsigned depth;
     double num_rel_ret;
     rbp_val_t * vals;
+    /* the relevance of each document of QDOCS, in order ORD */
+    const rel_t * rels;
+
+    /* Per-persistence state, P_PAD long, for the P_NUM persistences
+     * of PERSIST (none if PERSIST is NULL).  The padding has a
+     * persistence, and so a weight, of 0. */
+    unsigned p_num;
+    unsigned p_pad;
+    double * p;
+    double * wgt;
+    double * tie_wgt;
+    double * sum;
+    double * cumerr;
+    /* for rbp_calc_all_depths: p^d, and the values at depth d */
+    double * resid;
+    double * row_sum;
+    double * row_err;
+    /* Set once every weight has underflowed to zero; from then on,
+     * documents contribute nothing, and the kernels are skipped. */
+    int wgt_zero;
+    int tie_wgt_zero;
+
+    /* The ranking's ties, gathered on the first sweep since rbp_init,
+     * and the sweep's results. */
+    int ties_valid;
+    rbp_tie_arr_t ties;
+    rbp_val_t * sweep_vals;
+    unsigned sweep_vals_space;
 
     /* Handle ties */
     unsigned tie_len;
@@ -31,15 +92,249 @@ struct rbp {
     double tie_accum_score;
 };
 
+/*
+ *  Kernels over the per-persistence arrays.  Each is written so that
+ *  every persistence sees exactly the floating-point operations, in
+ *  the same order, whichever version is run.
+ */
+
+#ifdef RBP_AVX2
+
+/*
+ *  Add the current weights into the tie weights, and step the
+ *  weights down a rank.  Weights that underflow below DBL_MIN are
+ *  flushed to zero, as subnormal arithmetic is very slow, and such
+ *  weights cannot affect any reported value.  Returns non-zero if
+ *  any weight is still non-zero.
+ */
+RBP_AVX2_TARGET
+static int _kern_step_avx2(double * tie_wgt, double * wgt, const double * p,
+  unsigned n) {
+    const __m256d min = _mm256_set1_pd(DBL_MIN);
+    const __m256d zero = _mm256_setzero_pd();
+    int live = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i += RBP_VEC_WIDTH) {
+        __m256d w = _mm256_loadu_pd(wgt + i);
+
+        _mm256_storeu_pd(tie_wgt + i,
+          _mm256_add_pd(_mm256_loadu_pd(tie_wgt + i), w));
+        w = _mm256_mul_pd(w, _mm256_loadu_pd(p + i));
+        w = _mm256_and_pd(w, _mm256_cmp_pd(w, min, _CMP_GE_OQ));
+        live |= _mm256_movemask_pd(_mm256_cmp_pd(w, zero, _CMP_NEQ_OQ));
+        _mm256_storeu_pd(wgt + i, w);
+    }
+    return live;
+}
+
+RBP_AVX2_TARGET
+static void _kern_div_avx2(double * tie_wgt, double len, unsigned n) {
+    const __m256d l = _mm256_set1_pd(len);
+    unsigned i;
+
+    for (i = 0; i < n; i += RBP_VEC_WIDTH) {
+        _mm256_storeu_pd(tie_wgt + i,
+          _mm256_div_pd(_mm256_loadu_pd(tie_wgt + i), l));
+    }
+}
+
+/*
+ *  ACC += TIE_WGT * REL * FRAC, multiplying left to right.
+ */
+RBP_AVX2_TARGET
+static void _kern_accum_avx2(double * acc, const double * tie_wgt,
+  double rel, double frac, unsigned n) {
+    const __m256d r = _mm256_set1_pd(rel);
+    const __m256d f = _mm256_set1_pd(frac);
+    unsigned i;
+
+    for (i = 0; i < n; i += RBP_VEC_WIDTH) {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(tie_wgt + i), r);
+
+        v = _mm256_mul_pd(v, f);
+        _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i), v));
+    }
+}
+
+/*
+ *  ACC += TIE_WGT * FRAC.
+ */
+RBP_AVX2_TARGET
+static void _kern_accum_frac_avx2(double * acc, const double * tie_wgt,
+  double frac, unsigned n) {
+    const __m256d f = _mm256_set1_pd(frac);
+    unsigned i;
+
+    for (i = 0; i < n; i += RBP_VEC_WIDTH) {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(tie_wgt + i), f);
+
+        _mm256_storeu_pd(acc + i, _mm256_add_pd(_mm256_loadu_pd(acc + i), v));
+    }
+}
+
+/*
+ *  OUT = ACC + TIE_WGT * REL * FRAC (+ RESID, if not NULL).
+ */
+RBP_AVX2_TARGET
+static void _kern_accum_to_avx2(double * out, const double * acc,
+  const double * tie_wgt, double rel, double frac, const double * resid,
+  unsigned n) {
+    const __m256d r = _mm256_set1_pd(rel);
+    const __m256d f = _mm256_set1_pd(frac);
+    unsigned i;
+
+    for (i = 0; i < n; i += RBP_VEC_WIDTH) {
+        __m256d v = _mm256_mul_pd(_mm256_loadu_pd(tie_wgt + i), r);
+
+        v = _mm256_add_pd(_mm256_loadu_pd(acc + i), _mm256_mul_pd(v, f));
+        if (resid != NULL)
+            v = _mm256_add_pd(v, _mm256_loadu_pd(resid + i));
+        _mm256_storeu_pd(out + i, v);
+    }
+}
+
+#endif /* RBP_AVX2 */
+
+static int _kern_step_scalar(double * tie_wgt, double * wgt, const double * p,
+  unsigned n) {
+    int live = 0;
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        double w = wgt[i];
+
+        tie_wgt[i] += w;
+        w *= p[i];
+        if (w < DBL_MIN)
+            w = 0.0;
+        live |= w != 0.0;
+        wgt[i] = w;
+    }
+    return live;
+}
+
+static void _kern_div_scalar(double * tie_wgt, double len, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        tie_wgt[i] /= len;
+}
+
+static void _kern_accum_scalar(double * acc, const double * tie_wgt,
+  double rel, double frac, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        acc[i] += tie_wgt[i] * rel * frac;
+}
+
+static void _kern_accum_frac_scalar(double * acc, const double * tie_wgt,
+  double frac, unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++)
+        acc[i] += tie_wgt[i] * frac;
+}
+
+static void _kern_accum_to_scalar(double * out, const double * acc,
+  const double * tie_wgt, double rel, double frac, const double * resid,
+  unsigned n) {
+    unsigned i;
+
+    for (i = 0; i < n; i++) {
+        out[i] = acc[i] + tie_wgt[i] * rel * frac;
+        if (resid != NULL)
+            out[i] += resid[i];
+    }
+}
+
+
+#ifdef RBP_AVX2
+#ifdef __AVX2__
+#define RBP_HAVE_AVX2() 1
+#else
+#define RBP_HAVE_AVX2() __builtin_cpu_supports("avx2")
+#endif
+#define RBP_DISPATCH(kern, args) \
+    (RBP_HAVE_AVX2() ? kern##_avx2 args : kern##_scalar args)
+#else
+#define RBP_DISPATCH(kern, args) (kern##_scalar args)
+#endif /* RBP_AVX2 */
+
+static int _kern_step(double * tie_wgt, double * wgt, const double * p,
+  unsigned n) {
+    return RBP_DISPATCH(_kern_step, (tie_wgt, wgt, p, n));
+}
+
+static void _kern_div(double * tie_wgt, double len, unsigned n) {
+    RBP_DISPATCH(_kern_div, (tie_wgt, len, n));
+}
+
+static void _kern_accum(double * acc, const double * tie_wgt, double rel,
+  double frac, unsigned n) {
+    RBP_DISPATCH(_kern_accum, (acc, tie_wgt, rel, frac, n));
+}
+
+static void _kern_accum_frac(double * acc, const double * tie_wgt,
+  double frac, unsigned n) {
+    RBP_DISPATCH(_kern_accum_frac, (acc, tie_wgt, frac, n));
+}
+
+static void _kern_accum_to(double * out, const double * acc,
+  const double * tie_wgt, double rel, double frac, const double * resid,
+  unsigned n) {
+    RBP_DISPATCH(_kern_accum_to, (out, acc, tie_wgt, rel, frac, resid, n));
+}
+
+/*
+ *  Whether documents A and B of a ranking are tied.
+ */
+static int _tied(enum qdocs_ord_t ord, doc_score_t * a, doc_score_t * b) {
+    switch (ord) {
+    case QDOCS_ORD_RANK:
+        return a->rank == b->rank;
+    case QDOCS_ORD_SCORE:
+        return a->score == b->score;
+    case QDOCS_ORD_OCCUR:
+        return a->occur == b->occur;
+    }
+    return 0;
+}
+
 rbp_t * new_rbp(qrels_t * qrels, enum qdocs_ord_t ord, persist_t * persist) {
     rbp_t * rbp = util_malloc_or_die(sizeof(*rbp));
+    unsigned p;
+
     rbp->qdocs = NULL;
+    rbp->rels = NULL;
     rbp->qrels = qrels;
     rbp->ord = ord;
     rbp->persist = persist;
     rbp->depth = 0;
     rbp->num_rel_ret = 0.0;
-    rbp->vals = util_malloc_or_die(sizeof(*rbp->vals) * persist->p_num);
+    rbp->p_num = persist != NULL ? persist->p_num : 0;
+    rbp->vals = util_malloc_or_die(sizeof(*rbp->vals) * rbp->p_num);
+    rbp->p_pad = (rbp->p_num + RBP_VEC_WIDTH - 1) & ~(RBP_VEC_WIDTH - 1);
+    rbp->p = util_malloc_or_die(sizeof(*rbp->p) * rbp->p_pad
+      * RBP_NUM_FIELDS);
+    rbp->wgt = rbp->p + rbp->p_pad;
+    rbp->tie_wgt = rbp->wgt + rbp->p_pad;
+    rbp->sum = rbp->tie_wgt + rbp->p_pad;
+    rbp->cumerr = rbp->sum + rbp->p_pad;
+    rbp->resid = rbp->cumerr + rbp->p_pad;
+    rbp->row_sum = rbp->resid + rbp->p_pad;
+    rbp->row_err = rbp->row_sum + rbp->p_pad;
+    for (p = 0; p < rbp->p_pad; p++) {
+        rbp->p[p] = p < rbp->p_num ? persist->p[p] : 0.0;
+        rbp->tie_wgt[p] = 0.0;
+    }
+    rbp->wgt_zero = 0;
+    rbp->tie_wgt_zero = 0;
+    rbp->ties_valid = 0;
+    ARRAY_INIT(rbp->ties);
+    rbp->sweep_vals = NULL;
+    rbp->sweep_vals_space = 0;
     rbp->tie_len = 0;
     rbp->tie_pos = 0;
     switch (ord) {
@@ -56,15 +351,24 @@ rbp_t * new_rbp(qrels_t * qrels, enum qdocs_ord_t ord, persist_t * persist) {
 }
 
 int rbp_init(rbp_t * rbp, qdocs_t * qdocs) {
-    int i;
+    unsigned p;
+
     if (qrels_get_qid_qrels(rbp->qrels, qdocs_qid(qdocs)) == NULL) {
         return -1;
     }
     rbp->qdocs = qdocs;
-    for (i = 0; i < rbp->persist->p_num; i++) {
-        rbp->vals[i].sum = rbp->vals[i].err = rbp->vals[i].cumerr = 0.0;
-        rbp->vals[i].wgt = 1 - rbp->persist->p[i];
+    rbp->rels = qdocs_get_rels(qdocs, rbp->qrels, rbp->ord);
+    for (p = 0; p < rbp->p_pad; p++) {
+        rbp->sum[p] = rbp->cumerr[p] = 0.0;
+        rbp->wgt[p] = p < rbp->p_num ? 1 - rbp->p[p] : 0.0;
     }
+    for (p = 0; p < rbp->p_num; p++) {
+        rbp->vals[p].sum = rbp->vals[p].err = rbp->vals[p].cumerr = 0.0;
+        rbp->vals[p].wgt = 1 - rbp->p[p];
+    }
+    rbp->wgt_zero = 0;
+    rbp->tie_wgt_zero = 0;
+    rbp->ties_valid = 0;
     rbp->depth = 0;
     rbp->num_rel_ret = 0.0;
     rbp->tie_len = 0;
@@ -128,72 +432,71 @@ int rbp_init(rbp_t * rbp, qdocs_t * qdocs) {
 rbp_val_t * rbp_calc_to_depth(rbp_t * rbp, unsigned depth,
   double * num_rel_ret) {
     unsigned d, p, num_scores;
-    char * qid;
     doc_score_t * doc_scores;
-    qid_qrels_t * qq;
     unsigned actual_depth;
 
     assert(depth > rbp->depth);
     assert(rbp->qdocs != NULL);
     num_scores = qdocs_num_scores(rbp->qdocs);
     doc_scores = qdocs_get_scores(rbp->qdocs, rbp->ord);
-    qid = qdocs_qid(rbp->qdocs);
-    qq = qrels_get_qid_qrels(rbp->qrels, qid);
-    assert(qq != NULL);
     d = rbp->tie_pos;
     actual_depth = MIN(num_scores, depth);
-    if (actual_depth == rbp->depth) {
+    /* an earlier depth may already have reached the end of the
+     * ranking */
+    if (actual_depth == MIN(num_scores, rbp->depth)) {
         goto END;
     }
 
     do {
-        unsigned p;
         rel_t rel;
         double tie_frac;
 
         if (rbp->tie_len == 0) {
             unsigned t;
+            int live = 0;
 
-            rbp->tie_len = 0;
-            for (p = 0; p < rbp->persist->p_num; p++) {
-                rbp->vals[p].tie_wgt = 0.0;
+            /* once all the weights are zero, so are all the tie
+             * weights, and the tie need only be measured. */
+            rbp->tie_wgt_zero = rbp->wgt_zero;
+            if (!rbp->tie_wgt_zero) {
+                for (p = 0; p < rbp->p_pad; p++) {
+                    rbp->tie_wgt[p] = 0.0;
+                }
             }
             /* search forward to see how many documents have this
              * same rank or score.  Note that by starting t at d,
              * we ensure a tie length of always at least 1. */
             for (t = d; t < num_scores; t++) {
-                if ( (rbp->ord == QDOCS_ORD_RANK && doc_scores[d].rank
-                      != doc_scores[t].rank) || 
-                  (rbp->ord == QDOCS_ORD_SCORE && doc_scores[d].score !=
-                   doc_scores[t].score) ||
-                  (rbp->ord == QDOCS_ORD_OCCUR && doc_scores[d].occur
-                   != doc_scores[t].occur)) {
+                if (!_tied(rbp->ord, &doc_scores[d], &doc_scores[t])) {
                     break;
                 }
-                for (p = 0; p < rbp->persist->p_num; p++) {
-                    rbp->vals[p].tie_wgt += rbp->vals[p].wgt;
-                    rbp->vals[p].wgt *= rbp->persist->p[p];
+                if (!rbp->tie_wgt_zero) {
+                    live = _kern_step(rbp->tie_wgt, rbp->wgt, rbp->p,
+                      rbp->p_pad);
                 }
             }
             assert(t > d);
             rbp->tie_len = t - d;
-            for (p = 0; p < rbp->persist->p_num; p++) {
-                rbp->vals[p].tie_wgt /= rbp->tie_len;
+            if (!rbp->tie_wgt_zero) {
+                _kern_div(rbp->tie_wgt, rbp->tie_len, rbp->p_pad);
+                rbp->wgt_zero = !live;
             }
         }
         assert(rbp->tie_len > 0);
         tie_frac = (double) (MIN(rbp->tie_pos + rbp->tie_len, depth) -
           MAX(rbp->tie_pos, rbp->depth)) / rbp->tie_len;
         for (d = rbp->tie_pos; d < rbp->tie_pos + rbp->tie_len; d++) {
-            rel = qid_qrels_get_rel(qq, doc_scores[d].docid);
+            rel = rbp->rels[d];
             if (rel != REL_UNJUDGED)
                 rbp->num_rel_ret += (rel * tie_frac);
-            for (p = 0; p < rbp->persist->p_num; p++) {
-                if (rel == REL_UNJUDGED) {
-                    rbp->vals[p].cumerr += rbp->vals[p].tie_wgt * tie_frac;
-                } else {
-                    rbp->vals[p].sum += rbp->vals[p].tie_wgt * rel * tie_frac;
-                }
+            if (rbp->tie_wgt_zero)
+                continue;
+            if (rel == REL_UNJUDGED) {
+                _kern_accum_frac(rbp->cumerr, rbp->tie_wgt, tie_frac,
+                  rbp->p_pad);
+            } else {
+                _kern_accum(rbp->sum, rbp->tie_wgt, rel, tie_frac,
+                  rbp->p_pad);
             }
         }
         /* Does the tie end at or before the depth we're calculating to? */
@@ -202,9 +505,14 @@ rbp_val_t * rbp_calc_to_depth(rbp_t * rbp, unsigned depth,
             rbp->tie_len = 0;
         }
     } while (d < actual_depth);
-    for (p = 0; p < rbp->persist->p_num; p++) {
-        rbp->vals[p].err = rbp->vals[p].cumerr
-            + pow(rbp->persist->p[p], actual_depth);
+    for (p = 0; p < rbp->p_num; p++) {
+        rbp_val_t * val = &rbp->vals[p];
+
+        val->sum = rbp->sum[p];
+        val->cumerr = rbp->cumerr[p];
+        val->wgt = rbp->wgt[p];
+        val->tie_wgt = rbp->tie_wgt[p];
+        val->err = rbp->cumerr[p] + pow(rbp->p[p], actual_depth);
     }
     rbp->depth = depth;
 END:
@@ -213,6 +521,191 @@ END:
     return rbp->vals;
 }
 
+/*
+ *  Gather the ties of the ranking being evaluated, with the total
+ *  relevance and number of unjudged documents in each.
+ */
+static void _gather_ties(rbp_t * rbp) {
+    doc_score_t * doc_scores;
+    unsigned d, t, num_scores;
+
+    num_scores = qdocs_num_scores(rbp->qdocs);
+    doc_scores = qdocs_get_scores(rbp->qdocs, rbp->ord);
+    rbp->ties.elem_count = 0;
+    for (d = 0; d < num_scores; d = t) {
+        struct rbp_tie tie;
+
+        tie.start = d;
+        tie.rel = 0.0;
+        tie.num_unjudged = 0;
+        for (t = d; t < num_scores
+              && _tied(rbp->ord, &doc_scores[d], &doc_scores[t]); t++) {
+            rel_t rel = rbp->rels[t];
+
+            if (rel == REL_UNJUDGED)
+                tie.num_unjudged++;
+            else
+                tie.rel += rel;
+        }
+        tie.len = t - d;
+        ARRAY_ADD(rbp->ties, tie);
+    }
+    rbp->ties_valid = 1;
+}
+
+/*
+ *  The rbp of a ranking at a fixed depth is a polynomial in p, whose
+ *  coefficients are fixed by the ranking's ties and their relevance.
+ *  Those are gathered once, and the polynomial is then evaluated for
+ *  each persistence by stepping the weights down the ranks, as
+ *  rbp_calc_to_depth does, but with no further relevance lookups.
+ *  Ties are weighted just as rbp_calc_to_depth weights them in a
+ *  fresh evaluation to DEPTH.
+ */
+rbp_val_t * rbp_sweep_to_depth(rbp_t * rbp, unsigned depth,
+  const double * persist, unsigned p_num, double * num_rel_ret) {
+    double p[RBP_SWEEP_BLOCK];
+    double wgt[RBP_SWEEP_BLOCK];
+    double tie_wgt[RBP_SWEEP_BLOCK];
+    double sum[RBP_SWEEP_BLOCK];
+    double cumerr[RBP_SWEEP_BLOCK];
+    unsigned actual_depth, num_ties, b, t, i;
+    double rel_ret = 0.0;
+
+    assert(depth > 0);
+    assert(rbp->qdocs != NULL);
+    if (!rbp->ties_valid)
+        _gather_ties(rbp);
+    if (p_num > rbp->sweep_vals_space) {
+        rbp->sweep_vals = util_realloc_or_die(rbp->sweep_vals,
+          sizeof(*rbp->sweep_vals) * p_num);
+        rbp->sweep_vals_space = p_num;
+    }
+    actual_depth = MIN(qdocs_num_scores(rbp->qdocs), depth);
+    /* the ties that start within the depth; the last may run past it */
+    for (num_ties = 0; num_ties < rbp->ties.elem_count
+          && rbp->ties.elems[num_ties].start < actual_depth; num_ties++) {
+        struct rbp_tie * tie = &rbp->ties.elems[num_ties];
+
+        rel_ret += tie->rel * ((double) (MIN(tie->start + tie->len, depth)
+              - tie->start) / tie->len);
+    }
+
+    for (b = 0; b < p_num; b += RBP_SWEEP_BLOCK) {
+        unsigned n = MIN(p_num - b, RBP_SWEEP_BLOCK);
+        unsigned n_pad = (n + RBP_VEC_WIDTH - 1) & ~(RBP_VEC_WIDTH - 1);
+        int live = 1;
+
+        for (i = 0; i < n_pad; i++) {
+            p[i] = i < n ? persist[b + i] : 0.0;
+            wgt[i] = i < n ? 1 - p[i] : 0.0;
+            sum[i] = cumerr[i] = 0.0;
+        }
+        /* once every weight in the block is zero, the remaining ties
+         * contribute nothing to it. */
+        for (t = 0; t < num_ties && live; t++) {
+            struct rbp_tie * tie = &rbp->ties.elems[t];
+            double tie_frac;
+            unsigned d;
+
+            tie_frac = (double) (MIN(tie->start + tie->len, depth)
+              - tie->start) / tie->len;
+            for (i = 0; i < n_pad; i++)
+                tie_wgt[i] = 0.0;
+            for (d = 0; d < tie->len; d++)
+                live = _kern_step(tie_wgt, wgt, p, n_pad);
+            if (tie->len > 1)
+                _kern_div(tie_wgt, tie->len, n_pad);
+            if (tie->rel != 0.0)
+                _kern_accum(sum, tie_wgt, tie->rel, tie_frac, n_pad);
+            if (tie->num_unjudged > 0)
+                _kern_accum(cumerr, tie_wgt, tie->num_unjudged, tie_frac,
+                  n_pad);
+        }
+        for (i = 0; i < n; i++) {
+            rbp_val_t * val = &rbp->sweep_vals[b + i];
+
+            val->sum = sum[i];
+            val->cumerr = cumerr[i];
+            val->err = cumerr[i] + pow(p[i], actual_depth);
+            val->wgt = val->tie_wgt = 0.0;
+        }
+    }
+    if (num_rel_ret != NULL)
+        *num_rel_ret = rel_ret;
+    return rbp->sweep_vals;
+}
+
+/*
+ *  A tie at [s, s + l) contributes to depth s + k (0 < k <= l) the
+ *  fraction k / l of what it contributes to the depths beyond it, as
+ *  rbp_calc_to_depth has it; so each depth's values are those of the
+ *  ties before it, plus a fraction of the tie it falls in.
+ */
+void rbp_calc_all_depths(rbp_t * rbp, double * sums, double * errs,
+  double * num_rel_ret) {
+    doc_score_t * doc_scores;
+    unsigned num_scores, s, t, k, p;
+    double rel_ret = 0.0;
+
+    assert(rbp->qdocs != NULL);
+    assert(rbp->depth == 0);
+    num_scores = qdocs_num_scores(rbp->qdocs);
+    doc_scores = qdocs_get_scores(rbp->qdocs, rbp->ord);
+    for (p = 0; p < rbp->p_pad; p++) {
+        rbp->resid[p] = 0.0;
+    }
+    for (s = 0; s < num_scores; s = t) {
+        double tie_rel = 0.0;
+        unsigned num_unjudged = 0;
+        unsigned tie_len;
+
+        for (p = 0; p < rbp->p_pad; p++) {
+            rbp->tie_wgt[p] = 0.0;
+        }
+        for (t = s; t < num_scores
+              && _tied(rbp->ord, &doc_scores[s], &doc_scores[t]); t++) {
+            rel_t rel = rbp->rels[t];
+
+            if (rel == REL_UNJUDGED)
+                num_unjudged++;
+            else
+                tie_rel += rel;
+            _kern_step(rbp->tie_wgt, rbp->wgt, rbp->p, rbp->p_pad);
+        }
+        tie_len = t - s;
+        if (tie_len > 1)
+            _kern_div(rbp->tie_wgt, tie_len, rbp->p_pad);
+        for (k = 1; k <= tie_len; k++) {
+            double tie_frac = (double) k / tie_len;
+            unsigned d = s + k - 1;
+
+            /* by pow(), as rbp_calc_to_depth has it, so that the
+             * residuals at each depth are the same as there */
+            for (p = 0; p < rbp->p_num; p++) {
+                rbp->resid[p] = pow(rbp->p[p], d + 1);
+            }
+            _kern_accum_to(rbp->row_sum, rbp->sum, rbp->tie_wgt, tie_rel,
+              tie_frac, NULL, rbp->p_pad);
+            _kern_accum_to(rbp->row_err, rbp->cumerr, rbp->tie_wgt,
+              num_unjudged, tie_frac, rbp->resid, rbp->p_pad);
+            memcpy(sums + d * rbp->p_num, rbp->row_sum,
+              sizeof(*sums) * rbp->p_num);
+            memcpy(errs + d * rbp->p_num, rbp->row_err,
+              sizeof(*errs) * rbp->p_num);
+            if (num_rel_ret != NULL)
+                num_rel_ret[d] = rel_ret + tie_rel * tie_frac;
+        }
+        if (tie_rel != 0.0)
+            _kern_accum(rbp->sum, rbp->tie_wgt, tie_rel, 1.0, rbp->p_pad);
+        if (num_unjudged > 0)
+            _kern_accum(rbp->cumerr, rbp->tie_wgt, num_unjudged, 1.0,
+              rbp->p_pad);
+        rel_ret += tie_rel;
+    }
+    rbp->depth = DEPTH_FULL;
+}
+
 void rbp_weights(double * wgts, double persist, unsigned depth) {
     unsigned d;
     double wgt = 1 - persist;
@@ -231,14 +724,231 @@ void rbp_delete(rbp_t ** rbp_p) {
 
     rbp = *rbp_p;
     free(rbp->vals);
+    free(rbp->p);
+    ARRAY_DELETE(rbp->ties);
+    free(rbp->sweep_vals);
     free(rbp);
 }
 
 #ifdef RBP_MAIN
 
+#include <stdio.h>
+#include "run.h"
+
 #define TEST_DEPTH 10000
 #define TEST_PERSIST 0.7
 #define RESIDUE_MARGIN 0.0001
+#define SWEEP_MARGIN 1e-12
+#define SWEEP_NUM_DOCS 40
+#define TEXT_BUF_SZ 4096
+
+static FILE * _str_file(const char * text) {
+    FILE * fp = tmpfile();
+
+    assert(fp != NULL);
+    fputs(text, fp);
+    rewind(fp);
+    return fp;
+}
+
+/*
+ *  Check rbp_sweep_to_depth and rbp_calc_all_depths against
+ *  rbp_calc_to_depth, both fresh and continued across cutoffs, on a
+ *  ranking with ties (some across the cutoffs) and judged, unjudged
+ *  and fractionally relevant documents.
+ */
+static void _ranking_tests(void) {
+    static double sweep_p[] = { 0.0, 0.3, 0.5, 0.8, 0.95, 0.999, 1.0 };
+    static unsigned depths[] = { 1, 4, 5, 12, 21, 35, DEPTH_FULL };
+    unsigned num_p = sizeof(sweep_p) / sizeof(sweep_p[0]);
+    unsigned num_depths = sizeof(depths) / sizeof(depths[0]);
+    char text[TEXT_BUF_SZ];
+    char * cp;
+    FILE * fp;
+    qrels_t * qrels;
+    run_t * run;
+    persist_t persist;
+    rbp_t * rbp;
+    rbp_t * cont;
+    double all_sums[SWEEP_NUM_DOCS * PERSIST_MAX_NUM];
+    double all_errs[SWEEP_NUM_DOCS * PERSIST_MAX_NUM];
+    double all_rel_ret[SWEEP_NUM_DOCS];
+    unsigned i, d, p;
+
+    for (cp = text, i = 0; i < 30; i++) {
+        if (i != 7 && i != 12)
+            cp += sprintf(cp, "1 0 d%u %s\n", i,
+              i % 3 == 0 ? "1" : i % 3 == 1 ? "0" : "0.5");
+    }
+    fp = _str_file(text);
+    qrels = load_qrels(fp, NULL, 0);
+    fclose(fp);
+    assert(qrels != NULL);
+    qrels_set_reltype(qrels, RELTYPE_FRACT, 1.0);
+    for (cp = text, i = 0; i < SWEEP_NUM_DOCS; i++) {
+        unsigned score = SWEEP_NUM_DOCS - i;
+
+        /* ties at 3-5, 10-15 and 20-21 */
+        if (i >= 3 && i <= 5)
+            score = SWEEP_NUM_DOCS - 3;
+        else if (i >= 10 && i <= 15)
+            score = SWEEP_NUM_DOCS - 10;
+        else if (i == 21)
+            score = SWEEP_NUM_DOCS - 20;
+        cp += sprintf(cp, "1 Q0 d%u %u %u test\n", i, i + 1, score);
+    }
+    fp = _str_file(text);
+    run = load_run(fp, NULL, 0);
+    fclose(fp);
+    assert(run != NULL);
+
+    persist.p_num = num_p;
+    memcpy(persist.p, sweep_p, sizeof(sweep_p));
+    rbp = new_rbp(qrels, QDOCS_ORD_SCORE, &persist);
+    cont = new_rbp(qrels, QDOCS_ORD_SCORE, &persist);
+    assert(rbp_init(cont, run_get_qdocs_by_index(run, 0)) == 0);
+    for (d = 0; d < num_depths; d++) {
+        rbp_val_t * calc;
+        rbp_val_t * sweep;
+        double calc_rel_ret, sweep_rel_ret;
+
+        assert(rbp_init(rbp, run_get_qdocs_by_index(run, 0)) == 0);
+        calc = rbp_calc_to_depth(rbp, depths[d], &calc_rel_ret);
+        sweep = rbp_sweep_to_depth(cont, depths[d], sweep_p, num_p,
+          &sweep_rel_ret);
+        assert(fabs(calc_rel_ret - sweep_rel_ret) < SWEEP_MARGIN);
+        for (p = 0; p < num_p; p++) {
+            assert(fabs(calc[p].sum - sweep[p].sum) < SWEEP_MARGIN);
+            assert(fabs(calc[p].err - sweep[p].err) < SWEEP_MARGIN);
+        }
+        /* continuing an evaluation gives the same as a fresh one */
+        calc = rbp_calc_to_depth(cont, depths[d], &calc_rel_ret);
+        assert(fabs(calc_rel_ret - sweep_rel_ret) < SWEEP_MARGIN);
+        for (p = 0; p < num_p; p++) {
+            assert(fabs(calc[p].sum - sweep[p].sum) < SWEEP_MARGIN);
+            assert(fabs(calc[p].err - sweep[p].err) < SWEEP_MARGIN);
+        }
+    }
+
+    assert(rbp_init(cont, run_get_qdocs_by_index(run, 0)) == 0);
+    rbp_calc_all_depths(cont, all_sums, all_errs, all_rel_ret);
+    for (d = 1; d <= SWEEP_NUM_DOCS; d++) {
+        rbp_val_t * calc;
+        double calc_rel_ret;
+
+        assert(rbp_init(rbp, run_get_qdocs_by_index(run, 0)) == 0);
+        calc = rbp_calc_to_depth(rbp, d, &calc_rel_ret);
+        assert(fabs(calc_rel_ret - all_rel_ret[d - 1]) < SWEEP_MARGIN);
+        for (p = 0; p < num_p; p++) {
+            assert(fabs(calc[p].sum - all_sums[(d - 1) * num_p + p])
+              < SWEEP_MARGIN);
+            assert(fabs(calc[p].err - all_errs[(d - 1) * num_p + p])
+              < SWEEP_MARGIN);
+        }
+    }
+
+    rbp_delete(&rbp);
+    rbp_delete(&cont);
+    run_delete(&run);
+    qrels_delete(&qrels);
+}
+
+/*
+ *  Check the relevance vectors that rbp reads, as cached on the qdocs.
+ */
+static void _rels_tests(void) {
+    FILE * fp;
+    qrels_t * qrels;
+    run_t * run;
+    qdocs_t * qd;
+    const rel_t * rels;
+    const rel_t * again;
+
+    fp = _str_file("1 0 a 1\n1 0 b 0\n1 0 c 2\n");
+    qrels = load_qrels(fp, NULL, 0);
+    fclose(fp);
+    assert(qrels != NULL);
+    fp = _str_file("1 Q0 x 1 4 t\n1 Q0 b 2 1 t\n1 Q0 c 3 3 t\n"
+      "1 Q0 a 4 2 t\n2 Q0 a 1 1 t\n");
+    run = load_run(fp, NULL, 0);
+    fclose(fp);
+    assert(run != NULL);
+
+    qrels_set_reltype(qrels, RELTYPE_FRACT, 1.0);
+    qd = run_get_qdocs_by_qid(run, "1");
+    rels = qdocs_get_rels(qd, qrels, QDOCS_ORD_SCORE);
+    assert(rels[0] == REL_UNJUDGED && rels[1] == 2.0 && rels[2] == 1.0
+      && rels[3] == 0.0);
+    /* kept, and rebuilt for another ordering */
+    assert(qdocs_get_rels(qd, qrels, QDOCS_ORD_SCORE) == rels);
+    again = qdocs_get_rels(qd, qrels, QDOCS_ORD_OCCUR);
+    assert(again[0] == REL_UNJUDGED && again[1] == 0.0 && again[2] == 2.0
+      && again[3] == 1.0);
+    /* and for a new relevance type */
+    qrels_set_reltype(qrels, RELTYPE_BINARY, 2.0);
+    again = qdocs_get_rels(qd, qrels, QDOCS_ORD_OCCUR);
+    assert(again[0] == REL_UNJUDGED && again[1] == 0.0 && again[2] == 1.0
+      && again[3] == 0.0);
+    /* by docno, to the same effect */
+    run_resolve_docnos(run, qrels_get_docids(qrels));
+    qrels_set_reltype(qrels, RELTYPE_FRACT, 1.0);
+    rels = qdocs_get_rels(qd, qrels, QDOCS_ORD_SCORE);
+    assert(rels[0] == REL_UNJUDGED && rels[1] == 2.0 && rels[2] == 1.0
+      && rels[3] == 0.0);
+    /* an unjudged query */
+    rels = qdocs_get_rels(run_get_qdocs_by_qid(run, "2"), qrels,
+      QDOCS_ORD_SCORE);
+    assert(rels[0] == REL_UNJUDGED);
+    run_delete(&run);
+    qrels_delete(&qrels);
+}
+
+#define KERN_N 16
+
+/*
+ *  Check that the AVX2 kernels give exactly the scalar kernels'
+ *  results, including the flushing of underflowing weights, where
+ *  this processor can run them.
+ */
+static void _kern_tests(void) {
+#ifdef RBP_AVX2
+    double p[KERN_N], wgt[2][KERN_N], tie_wgt[2][KERN_N];
+    double acc[2][KERN_N], out[2][KERN_N];
+    int live[2];
+    unsigned i, step;
+
+    if (!__builtin_cpu_supports("avx2"))
+        return;
+    for (i = 0; i < KERN_N; i++) {
+        p[i] = i == 0 ? 0.0 : i == KERN_N - 1 ? 1.0 : i / (double) KERN_N;
+        wgt[0][i] = wgt[1][i] = 1.0 - p[i];
+        tie_wgt[0][i] = tie_wgt[1][i] = 0.0;
+        acc[0][i] = acc[1][i] = 0.0;
+    }
+    /* enough steps for all but p = 1 to underflow */
+    for (step = 0; step < 12000; step++) {
+        live[0] = _kern_step_scalar(tie_wgt[0], wgt[0], p, KERN_N);
+        live[1] = _kern_step_avx2(tie_wgt[1], wgt[1], p, KERN_N);
+        assert(!live[0] == !live[1]);
+        _kern_div_scalar(tie_wgt[0], 3.0, KERN_N);
+        _kern_div_avx2(tie_wgt[1], 3.0, KERN_N);
+        _kern_accum_scalar(acc[0], tie_wgt[0], 0.7, 0.3, KERN_N);
+        _kern_accum_avx2(acc[1], tie_wgt[1], 0.7, 0.3, KERN_N);
+        _kern_accum_frac_scalar(acc[0], tie_wgt[0], 0.9, KERN_N);
+        _kern_accum_frac_avx2(acc[1], tie_wgt[1], 0.9, KERN_N);
+        _kern_accum_to_scalar(out[0], acc[0], tie_wgt[0], 0.1, 0.7, wgt[0],
+          KERN_N);
+        _kern_accum_to_avx2(out[1], acc[1], tie_wgt[1], 0.1, 0.7, wgt[1],
+          KERN_N);
+        assert(memcmp(wgt[0], wgt[1], sizeof(wgt[0])) == 0);
+        assert(memcmp(tie_wgt[0], tie_wgt[1], sizeof(tie_wgt[0])) == 0);
+        assert(memcmp(acc[0], acc[1], sizeof(acc[0])) == 0);
+        assert(memcmp(out[0], out[1], sizeof(out[0])) == 0);
+    }
+    for (i = 1; i < KERN_N - 1; i++)
+        assert(wgt[0][i] == 0.0);
+#endif /* RBP_AVX2 */
+}
 
 int main(void) {
     double wgts[TEST_DEPTH];
@@ -255,6 +965,9 @@ int main(void) {
     }
     assert(sum <= 1.0);
     assert(1.0 - sum < RESIDUE_MARGIN);
+    _kern_tests();
+    _ranking_tests();
+    _rels_tests();
     return 0;
 }
 
@@ -16,6 +16,10 @@ typedef struct {
     double err;
 } rbp_val_t;
 
+/*
+ *  PERSIST gives the persistences for rbp_calc_to_depth.  It may be
+ *  NULL if only rbp_sweep_to_depth is to be used.
+ */
 rbp_t * new_rbp(qrels_t * qrels, enum qdocs_ord_t ord,
   persist_t * persist);
 
@@ -30,6 +34,32 @@ int rbp_init(rbp_t * rbp, qdocs_t * qdocs);
 rbp_val_t * rbp_calc_to_depth(rbp_t * rbp, unsigned depth, 
   double * num_rel_ret);
 
+/*
+ *  Calculate rbp to DEPTH for each of the P_NUM persistences in
+ *  PERSIST, which need not be sorted, and are not limited in number.
+ *  Unlike rbp_calc_to_depth, each call is a fresh evaluation from the
+ *  top of the ranking.  The relevance of the ranking is looked up on
+ *  the first call after rbp_init, so repeated sweeps of a ranking are
+ *  cheap.  Only the sum, cumerr and err of the returned values are
+ *  set; they agree with rbp_calc_to_depth to within rounding error.
+ */
+rbp_val_t * rbp_sweep_to_depth(rbp_t * rbp, unsigned depth,
+  const double * persist, unsigned p_num, double * num_rel_ret);
+
+/*
+ *  Calculate rbp at every depth from 1 to the length of the ranking,
+ *  for each persistence, in a single pass.  SUMS and ERRS must each
+ *  have room for qdocs_num_scores() * persist->p_num values; those for
+ *  depth D (counting from 1) are at [(D - 1) * p_num].  NUM_REL_RET,
+ *  if not NULL, must have room for qdocs_num_scores() values, and gets
+ *  the (fractional) number of relevant documents to each depth.  Ties
+ *  that span a depth are weighted just as by rbp_calc_to_depth, and
+ *  the results agree with it to within rounding error.  Must be called
+ *  straight after rbp_init.
+ */
+void rbp_calc_all_depths(rbp_t * rbp, double * sums, double * errs,
+  double * num_rel_ret);
+
 /*
  *  Calculate rbp weights at each depth for a given persistence.
  *
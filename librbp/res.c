@@ -1,68 +1,365 @@
+#include "config.h"
 #include "res.h"
 #include "rbp.h"
 #include "util.h"
+#include <stdlib.h>
 #include <assert.h>
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define RES_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+/* evaluates the Qth qid of RUN into RES, a res_t or curve_res_t */
+typedef void (*qid_eval_fn_t)(void * res, unsigned q, qrels_t * qrels,
+  run_t * run, rbp_t * rbp);
+
 static void _init_qid_res(qid_res_t * qres, unsigned d_num, unsigned p_num);
 static void _cleanup_qid_res(qid_res_t * qres, unsigned d_num);
-static res_t * _new_res(unsigned num_qid, depth_t * depth, persist_t * persist);
+static res_t * _new_res(unsigned num_qid, depth_t * depth, persist_t * persist,
+  const double * p, unsigned p_num);
+static res_t * _evaluate(qrels_t * qrels, run_t * run, enum qdocs_ord_t ord,
+  persist_t * persist, const double * p, unsigned p_num, depth_t * depth,
+  unsigned num_threads);
+static void _for_each_qid(void * res, unsigned num_qid,
+  qid_eval_fn_t eval_qid, qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, unsigned num_threads);
+static void _evaluate_qid(void * res, unsigned q, qrels_t * qrels,
+  run_t * run, rbp_t * rbp);
+static void _average_res(res_t * res);
+static void _curve_qid(void * res, unsigned q, qrels_t * qrels,
+  run_t * run, rbp_t * rbp);
+static void _average_curve(curve_res_t * res);
 
 res_t * evaluate_res(qrels_t * qrels, run_t * run, enum qdocs_ord_t ord,
   persist_t * persist, depth_t * depth) {
+    return _evaluate(qrels, run, ord, persist, persist->p, persist->p_num,
+      depth, 1);
+}
+
+res_t * evaluate_res_parallel(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, depth_t * depth,
+  unsigned num_threads) {
+    return _evaluate(qrels, run, ord, persist, persist->p, persist->p_num,
+      depth, num_threads);
+}
+
+res_t * evaluate_res_sweep(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, const double * p, unsigned p_num, depth_t * depth,
+  unsigned num_threads) {
+    return _evaluate(qrels, run, ord, NULL, p, p_num, depth, num_threads);
+}
+
+static res_t * _evaluate(qrels_t * qrels, run_t * run, enum qdocs_ord_t ord,
+  persist_t * persist, const double * p, unsigned p_num, depth_t * depth,
+  unsigned num_threads) {
     res_t * res;
+
+    res = _new_res(run_num_qdocs(run), depth, persist, p, p_num);
+    _for_each_qid(res, res->num_qid, _evaluate_qid, qrels, run, ord,
+      persist, num_threads);
+    _average_res(res);
+    return res;
+}
+
+curve_res_t * evaluate_curve(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, unsigned num_threads) {
+    curve_res_t * res;
+    unsigned q;
+
+    res = util_malloc_or_die(sizeof(*res));
+    res->num_qid = run_num_qdocs(run);
+    res->persist = persist;
+    res->qid_res = util_malloc_or_die(sizeof(*res->qid_res) * res->num_qid);
+    for (q = 0; q < res->num_qid; q++) {
+        qid_curve_t * qc = &res->qid_res[q];
+
+        qc->num_depths = 0;
+        qc->num_rel_ret = qc->sums = qc->errs = NULL;
+    }
+    _for_each_qid(res, res->num_qid, _curve_qid, qrels, run, ord, persist,
+      num_threads);
+    _average_curve(res);
+    return res;
+}
+
+typedef struct {
+    void * res;
+    unsigned num_qid;
+    qid_eval_fn_t eval_qid;
+    qrels_t * qrels;
+    run_t * run;
+    enum qdocs_ord_t ord;
+    persist_t * persist;
+#ifdef RES_THREADS
+    pthread_mutex_t lock;
+#endif /* RES_THREADS */
+    unsigned next_q;
+} res_work_t;
+
+/*
+ *  Worker: evaluate qids, taken in turn from the shared counter, with
+ *  an rbp_t of its own.
+ */
+static void * _evaluate_worker(void * arg) {
+    res_work_t * work = arg;
     rbp_t * rbp;
+    unsigned q;
+
+    rbp = new_rbp(work->qrels, work->ord, work->persist);
+    for (;;) {
+#ifdef RES_THREADS
+        pthread_mutex_lock(&work->lock);
+        q = work->next_q++;
+        pthread_mutex_unlock(&work->lock);
+#else
+        q = work->next_q++;
+#endif /* RES_THREADS */
+        if (q >= work->num_qid)
+            break;
+        work->eval_qid(work->res, q, work->qrels, work->run, rbp);
+    }
+    rbp_delete(&rbp);
+    return NULL;
+}
+
+/*
+ *  Evaluate each of the NUM_QID qids of RUN into RES with EVAL_QID,
+ *  sharing them out among up to NUM_THREADS threads.
+ */
+static void _for_each_qid(void * res, unsigned num_qid,
+  qid_eval_fn_t eval_qid, qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, unsigned num_threads) {
+    res_work_t work;
+
+    work.res = res;
+    work.num_qid = num_qid;
+    work.eval_qid = eval_qid;
+    work.qrels = qrels;
+    work.run = run;
+    work.ord = ord;
+    work.persist = persist;
+    work.next_q = 0;
+    /* relevances are looked up by docid in the hash of each qid's
+     * judgments, rather than by resolving the run's docnos against
+     * qrels_get_docids: that means building a dictionary of every
+     * docid in the qrels, which a single evaluation never repays */
+#ifdef RES_THREADS
+    pthread_mutex_init(&work.lock, NULL);
+    if (num_threads > num_qid)
+        num_threads = num_qid;
+    if (num_threads > 1) {
+        pthread_t * threads;
+        unsigned num_started;
+        unsigned t;
+
+        threads = util_malloc_or_die(sizeof(*threads) * num_threads);
+        for (num_started = 0; num_started < num_threads; num_started++) {
+            if (pthread_create(&threads[num_started], NULL,
+                  _evaluate_worker, &work) != 0)
+                break;
+        }
+        /* if no thread could be created, do the work here */
+        if (num_started == 0)
+            _evaluate_worker(&work);
+        for (t = 0; t < num_started; t++) {
+            pthread_join(threads[t], NULL);
+        }
+        free(threads);
+    } else {
+        _evaluate_worker(&work);
+    }
+    pthread_mutex_destroy(&work.lock);
+#else
+    _evaluate_worker(&work);
+#endif /* RES_THREADS */
+}
+
+/*
+ *  Evaluate the Qth qid of RUN into its slot in RES.
+ */
+static void _evaluate_qid(void * arg, unsigned q, qrels_t * qrels,
+  run_t * run, rbp_t * rbp) {
+    res_t * res = arg;
+    qdocs_t * qd;
+    char * qid;
+    qid_res_t * qres;
+    unsigned d, p;
+    int ret;
+
+    qd = run_get_qdocs_by_index(run, q);
+    qid = qdocs_qid(qd);
+    qres = &res->qid_res[q];
+    qres->qid = qid;
+    qres->num_ret = qdocs_num_scores(qd);
+    qres->num_rel = qrels_get_num_rel(qrels, qid);
+    if (qres->num_rel == -1) {
+        return;
+    }
+    ret = rbp_init(rbp, qd);
+    assert(ret == 0);
+    for (d = 0; d < res->depth->d_num; d++) {
+        rbp_val_t * rbpvals;
+        depth_res_t * dres;
+
+        dres = &qres->depth_res[d];
+        if (res->persist != NULL) {
+            rbpvals = rbp_calc_to_depth(rbp, res->depth->d[d],
+              &dres->num_rel_ret);
+        } else {
+            rbpvals = rbp_sweep_to_depth(rbp, res->depth->d[d], res->p,
+              res->p_num, &dres->num_rel_ret);
+        }
+        for (p = 0; p < res->p_num; p++) {
+            dres->persist_res[p].sum = rbpvals[p].sum;
+            dres->persist_res[p].err = rbpvals[p].err;
+        }
+    }
+}
+
+/*
+ *  Total and average the results of the judged qids.  The qids are
+ *  taken in run order, however they were evaluated, so that the
+ *  averages do not depend on the number of threads.
+ */
+static void _average_res(res_t * res) {
+    qid_res_t * ave = &res->ave_res;
+    unsigned num_judged_queries = 0;
     unsigned q, d, p;
-    unsigned num_judged_queries;
-    qid_res_t * ave;
 
-    res = _new_res(run_num_qdocs(run), depth, persist);
-    ave = &res->ave_res;
-    rbp = new_rbp(qrels, ord, persist);
-    num_judged_queries = 0;
     for (q = 0; q < res->num_qid; q++) {
-        qdocs_t * qd;
-        char * qid;
-        qid_res_t * qres;
-        int ret;
-        
-        qd = run_get_qdocs_by_index(run, q);
-        qid = qdocs_qid(qd);
-        qres = &res->qid_res[q];
-        qres->qid = qid;
-        qres->num_ret = qdocs_num_scores(qd);
-        qres->num_rel = qrels_get_num_rel(qrels, qid);
+        qid_res_t * qres = &res->qid_res[q];
+
         if (qres->num_rel == -1) {
             continue;
         }
         num_judged_queries++;
         ave->num_rel += qres->num_rel;
         ave->num_ret += qres->num_ret;
-        ret = rbp_init(rbp, qd);
-        assert(ret == 0);
-        for (d = 0; d < depth->d_num; d++) {
-            rbp_val_t * rbpvals;
-            depth_res_t * dres;
-
-            dres = &qres->depth_res[d];
-            rbpvals = rbp_calc_to_depth(rbp, depth->d[d], &dres->num_rel_ret);
+        for (d = 0; d < res->depth->d_num; d++) {
+            depth_res_t * dres = &qres->depth_res[d];
+
             ave->depth_res[d].num_rel_ret += dres->num_rel_ret;
-            for (p = 0; p < persist->p_num; p++) {
-                dres->persist_res[p].sum = rbpvals[p].sum;
-                dres->persist_res[p].err = rbpvals[p].err;
-                ave->depth_res[d].persist_res[p].sum += rbpvals[p].sum;
-                ave->depth_res[d].persist_res[p].err += rbpvals[p].err;
+            for (p = 0; p < res->p_num; p++) {
+                ave->depth_res[d].persist_res[p].sum
+                    += dres->persist_res[p].sum;
+                ave->depth_res[d].persist_res[p].err
+                    += dres->persist_res[p].err;
             }
         }
     }
-    /* calculate averages */
-    for (d = 0; d < depth->d_num; d++) {
-        for (p = 0; p < persist->p_num; p++) {
+    for (d = 0; d < res->depth->d_num; d++) {
+        for (p = 0; p < res->p_num; p++) {
             ave->depth_res[d].persist_res[p].sum /= num_judged_queries;
             ave->depth_res[d].persist_res[p].err /= num_judged_queries;
         }
     }
-    rbp_delete(&rbp);
-    return res;
+}
+
+/*
+ *  Evaluate the Qth qid of RUN at every depth into its slot in RES.
+ */
+static void _curve_qid(void * arg, unsigned q, qrels_t * qrels,
+  run_t * run, rbp_t * rbp) {
+    curve_res_t * res = arg;
+    unsigned p_num = res->persist->p_num;
+    qdocs_t * qd;
+    qid_curve_t * qc;
+    int ret;
+
+    qd = run_get_qdocs_by_index(run, q);
+    qc = &res->qid_res[q];
+    qc->qid = qdocs_qid(qd);
+    qc->num_ret = qdocs_num_scores(qd);
+    qc->num_rel = qrels_get_num_rel(qrels, qc->qid);
+    if (qc->num_rel == -1) {
+        return;
+    }
+    qc->num_depths = qc->num_ret;
+    qc->num_rel_ret = util_malloc_or_die(sizeof(*qc->num_rel_ret)
+      * qc->num_depths);
+    qc->sums = util_malloc_or_die(sizeof(*qc->sums) * qc->num_depths * p_num);
+    qc->errs = util_malloc_or_die(sizeof(*qc->errs) * qc->num_depths * p_num);
+    ret = rbp_init(rbp, qd);
+    assert(ret == 0);
+    rbp_calc_all_depths(rbp, qc->sums, qc->errs, qc->num_rel_ret);
+}
+
+/*
+ *  Average the curves of the judged qids, in run order, out to the
+ *  longest of them.  A ranking shorter than that keeps the values of
+ *  its last depth, as rbp_calc_to_depth does for depths beyond it.
+ */
+static void _average_curve(curve_res_t * res) {
+    qid_curve_t * ave = &res->ave_res;
+    unsigned p_num = res->persist->p_num;
+    unsigned num_judged_queries = 0;
+    unsigned q, d, p;
+
+    ave->qid = "all";
+    ave->num_ret = 0;
+    ave->num_rel = 0.0;
+    ave->num_depths = 0;
+    for (q = 0; q < res->num_qid; q++) {
+        qid_curve_t * qc = &res->qid_res[q];
+
+        if (qc->num_rel != -1 && qc->num_depths > ave->num_depths)
+            ave->num_depths = qc->num_depths;
+    }
+    ave->num_rel_ret = util_malloc_or_die(sizeof(*ave->num_rel_ret)
+      * ave->num_depths);
+    ave->sums = util_malloc_or_die(sizeof(*ave->sums) * ave->num_depths
+      * p_num);
+    ave->errs = util_malloc_or_die(sizeof(*ave->errs) * ave->num_depths
+      * p_num);
+    for (d = 0; d < ave->num_depths; d++) {
+        ave->num_rel_ret[d] = 0.0;
+        for (p = 0; p < p_num; p++) {
+            ave->sums[d * p_num + p] = ave->errs[d * p_num + p] = 0.0;
+        }
+    }
+    for (q = 0; q < res->num_qid; q++) {
+        qid_curve_t * qc = &res->qid_res[q];
+
+        if (qc->num_rel == -1 || qc->num_depths == 0) {
+            continue;
+        }
+        num_judged_queries++;
+        ave->num_rel += qc->num_rel;
+        ave->num_ret += qc->num_ret;
+        for (d = 0; d < ave->num_depths; d++) {
+            unsigned qd = d < qc->num_depths ? d : qc->num_depths - 1;
+
+            ave->num_rel_ret[d] += qc->num_rel_ret[qd];
+            for (p = 0; p < p_num; p++) {
+                ave->sums[d * p_num + p] += qc->sums[qd * p_num + p];
+                ave->errs[d * p_num + p] += qc->errs[qd * p_num + p];
+            }
+        }
+    }
+    for (d = 0; d < ave->num_depths; d++) {
+        for (p = 0; p < p_num; p++) {
+            ave->sums[d * p_num + p] /= num_judged_queries;
+            ave->errs[d * p_num + p] /= num_judged_queries;
+        }
+    }
+}
+
+void curve_res_delete(curve_res_t ** res_p) {
+    curve_res_t * res = *res_p;
+    unsigned q;
+
+    for (q = 0; q < res->num_qid; q++) {
+        free(res->qid_res[q].num_rel_ret);
+        free(res->qid_res[q].sums);
+        free(res->qid_res[q].errs);
+    }
+    free(res->ave_res.num_rel_ret);
+    free(res->ave_res.sums);
+    free(res->ave_res.errs);
+    free(res->qid_res);
+    free(res);
+    *res_p = NULL;
 }
 
 void res_delete(res_t ** res_p) {
@@ -79,20 +376,22 @@ void res_delete(res_t ** res_p) {
 }
 
 static res_t * _new_res(unsigned num_qid, depth_t * depth, 
-  persist_t * persist) {
+  persist_t * persist, const double * p, unsigned p_num) {
     res_t * res;
     unsigned q;
 
     res = util_malloc_or_die(sizeof(*res));
-    _init_qid_res(&res->ave_res, depth->d_num, persist->p_num);
+    _init_qid_res(&res->ave_res, depth->d_num, p_num);
     res->ave_res.qid = "all";
     res->qid_res = util_malloc_or_die(sizeof(*res->qid_res) * num_qid);
     for (q = 0; q < num_qid; q++) {
-        _init_qid_res(&res->qid_res[q], depth->d_num, persist->p_num);
+        _init_qid_res(&res->qid_res[q], depth->d_num, p_num);
     }
     res->num_qid = num_qid;
     res->depth = depth;
     res->persist = persist;
+    res->p = p;
+    res->p_num = p_num;
     return res;
 }
 
@@ -122,3 +421,184 @@ static void _cleanup_qid_res(qid_res_t * qres, unsigned d_num) {
     }
     free(qres->depth_res);
 }
+
+#ifdef RES_MAIN
+
+#include <stdio.h>
+#include <string.h>
+
+#define ERR_BUF_SIZE 1024
+#define TEST_QIDS 37
+#define TEST_MAX_DOCS 300
+
+static unsigned test_threads[] = { 2, 3, 5, 8, 64 };
+
+/*
+ *  Check that results A and B hold exactly the same values.
+ */
+static void _check_same_qid_res(res_t * res, qid_res_t * a, qid_res_t * b) {
+    unsigned d, p;
+
+    assert((a->qid == NULL) == (b->qid == NULL));
+    assert(a->qid == NULL || strcmp(a->qid, b->qid) == 0);
+    assert(a->num_ret == b->num_ret);
+    assert(a->num_rel == b->num_rel);
+    for (d = 0; d < res->depth->d_num; d++) {
+        depth_res_t * da = &a->depth_res[d];
+        depth_res_t * db = &b->depth_res[d];
+
+        assert(da->num_rel_ret == db->num_rel_ret);
+        for (p = 0; p < res->p_num; p++) {
+            assert(da->persist_res[p].sum == db->persist_res[p].sum);
+            assert(da->persist_res[p].err == db->persist_res[p].err);
+        }
+    }
+}
+
+static void _check_same_res(res_t * a, res_t * b) {
+    unsigned q;
+
+    assert(a->num_qid == b->num_qid);
+    assert(a->p_num == b->p_num);
+    for (q = 0; q < a->num_qid; q++)
+        _check_same_qid_res(a, &a->qid_res[q], &b->qid_res[q]);
+    _check_same_qid_res(a, &a->ave_res, &b->ave_res);
+}
+
+/*
+ *  Check that evaluating RUN against QRELS in parallel, by fixed
+ *  persistences and by a sweep, gives the results of a serial
+ *  evaluation.
+ */
+static void _check_parallel(qrels_t * qrels, run_t * run) {
+    char err_buf[ERR_BUF_SIZE];
+    char persist_spec[] = "0.5,0.8,0.95";
+    char sweep_spec[] = "0.1:0.99:12";
+    char depth_spec[] = "1,10,100,1000";
+    persist_t persist;
+    depth_t depth;
+    double * sweep;
+    unsigned sweep_num;
+    res_t * serial;
+    res_t * serial_sweep;
+    unsigned t;
+
+    assert(parse_persist(&persist, persist_spec, err_buf,
+          ERR_BUF_SIZE) == 0);
+    assert(parse_depth(&depth, depth_spec, err_buf, ERR_BUF_SIZE) == 0);
+    sweep = parse_persist_sweep(sweep_spec, &sweep_num, err_buf,
+      ERR_BUF_SIZE);
+    assert(sweep != NULL);
+
+    serial = evaluate_res(qrels, run, QDOCS_ORD_RANK, &persist, &depth);
+    serial_sweep = evaluate_res_sweep(qrels, run, QDOCS_ORD_RANK, sweep,
+      sweep_num, &depth, 1);
+    for (t = 0; t < sizeof(test_threads) / sizeof(test_threads[0]); t++) {
+        res_t * res;
+
+        res = evaluate_res_parallel(qrels, run, QDOCS_ORD_RANK, &persist,
+          &depth, test_threads[t]);
+        _check_same_res(serial, res);
+        res_delete(&res);
+        res = evaluate_res_sweep(qrels, run, QDOCS_ORD_RANK, sweep,
+          sweep_num, &depth, test_threads[t]);
+        _check_same_res(serial_sweep, res);
+        res_delete(&res);
+    }
+    res_delete(&serial);
+    res_delete(&serial_sweep);
+    free(sweep);
+}
+
+/*
+ *  Generate a run of more queries than threads, with rankings of very
+ *  different lengths so that the threads take uneven shares, one
+ *  query without judgments, and judged queries absent from the run.
+ */
+static void _test_generated_res(void) {
+    char err_buf[ERR_BUF_SIZE];
+    FILE * fp;
+    qrels_t * qrels;
+    run_t * run;
+    unsigned q, d;
+
+    fp = tmpfile();
+    assert(fp != NULL);
+    for (q = 0; q < TEST_QIDS + 3; q++) {
+        if (q == 5)
+            continue;
+        for (d = 0; d < TEST_MAX_DOCS; d += 1 + q % 4)
+            fprintf(fp, "%u 0 d%u %u\n", q, d, (d + q) % 3);
+    }
+    rewind(fp);
+    qrels = load_qrels(fp, err_buf, ERR_BUF_SIZE);
+    assert(qrels != NULL);
+    fclose(fp);
+
+    fp = tmpfile();
+    assert(fp != NULL);
+    for (q = 0; q < TEST_QIDS; q++) {
+        unsigned num_docs = (q % 7 == 0) ? TEST_MAX_DOCS * 4
+            : 1 + (q * 53) % TEST_MAX_DOCS;
+
+        for (d = 0; d < num_docs; d++) {
+            fprintf(fp, "%u Q0 d%u %u %u test\n", q, (d * 7 + q) %
+              (TEST_MAX_DOCS * 2), d + 1, num_docs - d);
+        }
+    }
+    rewind(fp);
+    run = load_run(fp, err_buf, ERR_BUF_SIZE);
+    assert(run != NULL);
+    fclose(fp);
+
+    _check_parallel(qrels, run);
+    run_delete(&run);
+    qrels_delete(&qrels);
+}
+
+int main(int argc, char ** argv) {
+    char err_buf[ERR_BUF_SIZE];
+    FILE * fp;
+    qrels_t * qrels;
+    run_t * run;
+
+    _test_generated_res();
+    if (argc == 1)
+        return 0;
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s [<qrels-file> <run-file>]\n", argv[0]);
+        return -1;
+    }
+    fp = fopen(argv[1], "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open file %s for reading\n", argv[1]);
+        return -1;
+    }
+    qrels = load_qrels(fp, err_buf, ERR_BUF_SIZE);
+    fclose(fp);
+    if (qrels == NULL) {
+        fprintf(stderr, "Error loading qrels file '%s': %s\n", argv[1],
+          err_buf);
+        return -1;
+    }
+    fp = fopen(argv[2], "r");
+    if (fp == NULL) {
+        fprintf(stderr, "Unable to open file %s for reading\n", argv[2]);
+        qrels_delete(&qrels);
+        return -1;
+    }
+    run = load_run(fp, err_buf, ERR_BUF_SIZE);
+    fclose(fp);
+    if (run == NULL) {
+        fprintf(stderr, "Error loading run file '%s': %s\n", argv[2],
+          err_buf);
+        qrels_delete(&qrels);
+        return -1;
+    }
+    _check_parallel(qrels, run);
+    run_delete(&run);
+    qrels_delete(&qrels);
+    return 0;
+}
+
+#endif /* RES_MAIN */
@@ -29,11 +29,37 @@ typedef struct {
 typedef struct {
     unsigned num_qid;
     depth_t * depth;
+    /* NULL for a sweep (see evaluate_res_sweep) */
     persist_t * persist;
+    /* the P_NUM persistences evaluated; for other than a sweep, these
+     * are those of PERSIST. */
+    const double * p;
+    unsigned p_num;
     qid_res_t * qid_res;
     qid_res_t ave_res;
 } res_t;
 
+/* rbp at every depth of a ranking, as curves against depth.  The
+ * values at depth D (counting from 1) for the Pth persistence are at
+ * [(D - 1) * p_num + P] of SUMS and ERRS. */
+typedef struct {
+    const char * qid;
+    unsigned num_ret;
+    double num_rel; /* < 0.0 means "no judgments" */
+    unsigned num_depths;
+    double * num_rel_ret;
+    double * sums;
+    double * errs;
+} qid_curve_t;
+
+typedef struct {
+    unsigned num_qid;
+    persist_t * persist;
+    qid_curve_t * qid_res;
+    /* out to the longest ranking */
+    qid_curve_t ave_res;
+} curve_res_t;
+
 /* Perform a full evaluation and retrieve the results.  These results
  * must be free'd using res_delete, and you must delete the results
  * before deleting or otherwise modifying the passed-in qrels, run,
@@ -41,6 +67,33 @@ typedef struct {
 res_t * evaluate_res(qrels_t * qrels, run_t * run, enum qdocs_ord_t ord,
   persist_t * persist, depth_t * depth);
 
+/* As evaluate_res, but with the qids shared out among up to
+ * NUM_THREADS threads, each with an rbp_t of its own.  The averages
+ * are taken in the same order as by evaluate_res, so the results are
+ * identical to it.  Falls back to evaluate_res if threads are not
+ * supported. */
+res_t * evaluate_res_parallel(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, depth_t * depth,
+  unsigned num_threads);
+
+/* As evaluate_res_parallel, but for each of the P_NUM persistences in
+ * P, which may be many more than a persist_t holds, using
+ * rbp_sweep_to_depth.  P must not be modified or freed before the
+ * results are deleted. */
+res_t * evaluate_res_sweep(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, const double * p, unsigned p_num, depth_t * depth,
+  unsigned num_threads);
+
 void res_delete(res_t ** res_p);
 
+/* Evaluate each qid at every depth from 1 to the length of its
+ * ranking, with rbp_calc_all_depths, and average the curves.  There
+ * is no per-depth overhead, so this is much cheaper than asking
+ * evaluate_res for every depth.  The results must be free'd using
+ * curve_res_delete, as for evaluate_res_parallel. */
+curve_res_t * evaluate_curve(qrels_t * qrels, run_t * run,
+  enum qdocs_ord_t ord, persist_t * persist, unsigned num_threads);
+
+void curve_res_delete(curve_res_t ** res_p);
+
 #endif /* RES_H */
@@ -5,11 +5,14 @@
 #include <assert.h>
 #include <math.h>
 #include <ctype.h>
+#include <stdint.h>
 
 #include "error.h"
 #include "util.h"
 #include "run.h"
 #include "strhash.h"
+#include "arena.h"
+#include "futil.h"
 
 /* causes too many compatibility problems... */
 #undef RUN_MD5SUM
@@ -18,7 +21,22 @@
 #include <openssl/md5.h>
 #endif /* RUN_MD5SUM */
 
-#define LINE_BUF_SZ 1024
+#ifdef FUTIL_MMAP
+#include <sys/mman.h>
+#include <unistd.h>
+#endif /* FUTIL_MMAP */
+
+#if defined(FUTIL_MMAP) && defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define RUN_THREADS
+#include <pthread.h>
+#endif /* FUTIL_MMAP && HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+#define LINE_BUF_INIT_SZ 1024
+/* parsed pages of a mapped run file are dropped in chunks of this size */
+#define MMAP_RELEASE_SZ (16 * 1024 * 1024)
+/* don't bother parsing less than this much of a run file in a thread */
+#define CHUNK_MIN_SZ (1024 * 1024)
+#define CHUNK_ERR_BUF_SZ 1024
 #define QID_BUF_SZ 256
 #define RUNID_BUF_SZ 256
 
@@ -33,6 +51,48 @@
 #define RUN_SCORE_COL 4
 #define RUN_RUNID_COL 5
 
+/*
+ *  Binary run file format.  All integers are in native byte order,
+ *  which the BYTE_ORDER field of the header is there to check.  The
+ *  file consists of:
+ *
+ *    - a header (runbin_hdr_t);
+ *    - a table of NUM_QIDS qid entries (runbin_qid_t), in run order;
+ *    - for each qid, its NUM_DOCS doc entries (runbin_doc_t), in order
+ *      of occurrence in the original run;
+ *    - a table of nul-terminated (and downcased) strings, which holds
+ *      the qids, the docids (each distinct docid once), and the runid.
+ *
+ *  All strings are referred to by their offset in the string table.
+ */
+#define RUNBIN_MAGIC "\211RBPRUN\n"
+#define RUNBIN_MAGIC_LEN 8
+#define RUNBIN_VERSION 1
+#define RUNBIN_BYTE_ORDER 0x01020304
+
+typedef struct runbin_hdr {
+    char magic[RUNBIN_MAGIC_LEN];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t num_qids;
+    uint32_t runid;
+    uint64_t qids_off;
+    uint64_t strtab_off;
+    uint64_t strtab_sz;
+} runbin_hdr_t;
+
+typedef struct runbin_qid {
+    uint64_t docs_off;
+    uint32_t qid;
+    uint32_t num_docs;
+} runbin_qid_t;
+
+typedef struct runbin_doc {
+    double score;
+    uint32_t docid;
+    uint32_t rank;
+} runbin_doc_t;
+
 struct run {
     qdocs_t ** qdocs;
     unsigned qdocs_num;
@@ -40,14 +100,63 @@ struct run {
     strhash_t * qdocs_hash;
     unsigned max_depth;
     char * runid;
+    /* docids of all qdocs, which reference rather than own them */
+    arena_t * docids;
+    /* binary run file the docids point into, if any */
+    char * bin;
+    size_t bin_sz;
+    int bin_mapped;
 #ifdef RUN_MD5SUM
 #define MD5_HEX_LENGTH 32
     char md5sum[MD5_HEX_LENGTH + 1];
 #endif /* RUN_MD5SUM */
 };
 
+/*
+ *  State of a run file parse, carried from line to line.
+ *
+ *  When parsing one chunk of a file among several, the runid and
+ *  comma warnings can only be issued once all the chunks are parsed,
+ *  so DEFER_WARNINGS is set and the lines they occur on are recorded
+ *  instead.
+ */
+typedef struct run_parse {
+    run_t * run;
+    char * qid;
+    char qid_buf[QID_BUF_SZ];
+    char runid_buf[RUNID_BUF_SZ];
+    unsigned runid_line;
+    char runid_change_buf[RUNID_BUF_SZ];
+    unsigned runid_change_line;
+    unsigned comma_line;
+    int defer_warnings;
+    unsigned line_num;
+    qdocs_t * qd;
+    char * line_buf;
+    size_t line_buf_sz;
+    char * err_buf;
+    unsigned err_buf_len;
+#ifdef RUN_MD5SUM
+    MD5_CTX md5_ctx;
+#endif /* RUN_MD5SUM */
+} run_parse_t;
+
+/* some runs format ranks with commas; we only warn about this once */
+static int warned_about_commas = 0;
+
 static run_t * _new_run();
 static qdocs_t * _get_create_qdocs(run_t * run, char * qid, int create);
+static void _init_parse(run_parse_t * rp, run_t * run, char * qid,
+  unsigned line_base, char * err_buf, unsigned err_buf_len);
+static void _finish_run(run_t * run, const char * runid);
+static int _parse_line(run_parse_t * rp, char * line, size_t len);
+static int _parse_stream(run_parse_t * rp, FILE * fp);
+static int _load_runbin(run_parse_t * rp, const char * bin, size_t bin_sz);
+static int _read_runbin_stream(run_parse_t * rp, FILE * fp);
+#ifdef FUTIL_MMAP
+static int _parse_buf(run_parse_t * rp, const char * start,
+  const char * end);
+#endif /* FUTIL_MMAP */
 
 run_t * load_run(FILE * fp, char * err_buf, unsigned err_buf_len) {
     return load_run_single_query(fp, NULL, err_buf, err_buf_len);
@@ -55,128 +164,708 @@ run_t * load_run(FILE * fp, char * err_buf, unsigned err_buf_len) {
 
 run_t * load_run_single_query(FILE * fp, char * qid, char * err_buf, 
   unsigned err_buf_len) {
-
-    char line_buf[LINE_BUF_SZ];
-    char qid_buf[QID_BUF_SZ];
-    char runid_buf[RUNID_BUF_SZ];
-    int warned_about_runid = 0;
-    unsigned line_num = 0;
-    qdocs_t * qd = NULL;
+    run_parse_t rp;
     run_t * run;
-    unsigned q;
+    int ret;
+#ifdef FUTIL_MMAP
+    char * map;
+    size_t map_sz;
+    size_t off;
+#endif /* FUTIL_MMAP */
 #ifdef RUN_MD5SUM
-    MD5_CTX md5_ctx;
     unsigned char md5_digest[MD5_DIGEST_LENGTH];
     int c;
 #endif /* RUN_MD5SUM */
 
-    qid_buf[0] = '\0';
-    runid_buf[0] = '\0';
     run = _new_run();
+    _init_parse(&rp, run, qid, 0, err_buf, err_buf_len);
+#ifdef FUTIL_MMAP
+    if (futil_map_file(fp, &map, &map_sz, &off) == 0) {
+        if (map_sz - off >= RUNBIN_MAGIC_LEN
+          && memcmp(map + off, RUNBIN_MAGIC, RUNBIN_MAGIC_LEN) == 0) {
+            /* keep the mapping, as the docids point into it */
+            run->bin = map;
+            run->bin_sz = map_sz;
+            run->bin_mapped = 1;
+            ret = _load_runbin(&rp, map + off, map_sz - off);
+            fseeko(fp, 0, SEEK_END);
+        } else {
+            ret = _parse_buf(&rp, map + off, map + map_sz);
+            futil_unmap_file(map, map_sz);
+            fseeko(fp, 0, SEEK_END);
+        }
+    } else {
+        ret = _parse_stream(&rp, fp);
+    }
+#else
+    ret = _parse_stream(&rp, fp);
+#endif /* FUTIL_MMAP */
+    free(rp.line_buf);
+    if (ret < 0) {
+        run_delete(&run);
+        return NULL;
+    }
 #ifdef RUN_MD5SUM
-    MD5_Init(&md5_ctx);
+    MD5_Final(md5_digest, &rp.md5_ctx);
+    for (c = 0; c < MD5_DIGEST_LENGTH; c++) {
+        sprintf(run->md5sum + c * 2, "%02x", md5_digest[c]);
+    }
 #endif /* RUN_MD5SUM */
-    while (fgets(line_buf, LINE_BUF_SZ, fp) != NULL) {
-        char * cols[RUN_NUM_COLS];
-        int ret;
-        double score;
-        long rank;
-        char * score_end;
-        char * rank_end;
+    _finish_run(run, rp.runid_buf);
+    return run;
+}
 
-#ifdef RUN_MD5SUM
-        MD5_Update(&md5_ctx, line_buf, strlen(line_buf));
-#endif /* RUN_MD5SUM */
-        line_num++;
-        ret = util_parse_cols(line_buf, cols, RUN_NUM_COLS);
-        if (ret < 0) {
-            if (err_buf)
-                snprintf(err_buf, err_buf_len,
-                  "wrong number of fields on line %d of run file", line_num);
-            run_delete(&run);
-            return NULL;
+#if defined(RUN_THREADS) && !defined(RUN_MD5SUM)
+
+/*
+ *  A byte range of a mapped run file, parsed by a thread of its own.
+ */
+typedef struct run_chunk {
+    const char * start;
+    const char * end;
+    unsigned num_lines;
+    run_parse_t rp;
+    int ret;
+    char err_buf[CHUNK_ERR_BUF_SZ];
+} run_chunk_t;
+
+static void * _count_chunk_lines(void * arg);
+static void * _parse_chunk(void * arg);
+static void _run_chunk_threads(run_chunk_t * chunks, unsigned num_chunks,
+  void * (*fn)(void *));
+static void _merge_run_chunk(run_t * run, run_chunk_t * chunk);
+
+run_t * load_run_parallel(FILE * fp, unsigned num_threads, char * err_buf,
+  unsigned err_buf_len) {
+    char * map;
+    size_t map_sz;
+    size_t off;
+    size_t chunk_sz;
+    run_chunk_t * chunks;
+    unsigned num_chunks;
+    unsigned c;
+    unsigned line_base;
+    run_t * run = NULL;
+    char runid_buf[RUNID_BUF_SZ];
+    int warned_about_runid = 0;
+
+    if (num_threads <= 1)
+        return load_run(fp, err_buf, err_buf_len);
+    if (futil_map_file(fp, &map, &map_sz, &off) != 0)
+        return load_run(fp, err_buf, err_buf_len);
+    if (map_sz - off >= RUNBIN_MAGIC_LEN
+      && memcmp(map + off, RUNBIN_MAGIC, RUNBIN_MAGIC_LEN) == 0) {
+        /* binary runs need no parsing */
+        futil_unmap_file(map, map_sz);
+        return load_run(fp, err_buf, err_buf_len);
+    }
+    if ((map_sz - off) / num_threads < CHUNK_MIN_SZ)
+        num_threads = (map_sz - off) / CHUNK_MIN_SZ;
+    if (num_threads <= 1) {
+        futil_unmap_file(map, map_sz);
+        return load_run(fp, err_buf, err_buf_len);
+    }
+
+    /* split the file into equal ranges, then move each split point to
+     * the start of the following line */
+    chunks = util_malloc_or_die(sizeof(*chunks) * num_threads);
+    chunk_sz = (map_sz - off) / num_threads;
+    num_chunks = 0;
+    for (c = 0; c < num_threads; c++) {
+        const char * start = (c == 0) ? map + off
+            : chunks[num_chunks - 1].end;
+        const char * end;
+
+        if (c == num_threads - 1) {
+            end = map + map_sz;
+        } else {
+            end = map + off + (c + 1) * chunk_sz;
+            if (end < start)
+                end = start;
+            end = memchr(end, '\n', map + map_sz - end);
+            end = (end == NULL) ? map + map_sz : end + 1;
         }
-        util_downcase_str(cols[RUN_QID_COL]);
-        if (qid != NULL && strcmp(qid, cols[RUN_QID_COL]) != 0) {
+        if (end == start)
             continue;
+        chunks[num_chunks].start = start;
+        chunks[num_chunks].end = end;
+        num_chunks++;
+        if (end == map + map_sz)
+            break;
+    }
+
+    /* line numbers must be known up front for error messages */
+    _run_chunk_threads(chunks, num_chunks, _count_chunk_lines);
+    line_base = 0;
+    for (c = 0; c < num_chunks; c++) {
+        _init_parse(&chunks[c].rp, _new_run(), NULL, line_base,
+          chunks[c].err_buf, CHUNK_ERR_BUF_SZ);
+        chunks[c].rp.defer_warnings = 1;
+        line_base += chunks[c].num_lines;
+    }
+    _run_chunk_threads(chunks, num_chunks, _parse_chunk);
+    futil_unmap_file(map, map_sz);
+    fseeko(fp, 0, SEEK_END);
+
+    /* merge chunks in file order, issuing the warnings (and the
+     * error) that a serial parse would have, in the same order */
+    run = _new_run();
+    runid_buf[0] = '\0';
+    for (c = 0; c < num_chunks; c++) {
+        run_parse_t * rp = &chunks[c].rp;
+        unsigned runid_line = 0;
+        const char * runid_now = NULL;
+
+        if (rp->runid_buf[0] == '\0' || warned_about_runid) {
+            /* nothing to check */
+        } else if (runid_buf[0] == '\0') {
+            strcpy(runid_buf, rp->runid_buf);
+        } else if (strcmp(runid_buf, rp->runid_buf) != 0) {
+            runid_line = rp->runid_line;
+            runid_now = rp->runid_buf;
         }
-        if (strcmp(cols[RUN_QID_COL], qid_buf) != 0) {
-            strncpy(qid_buf, cols[RUN_QID_COL], QID_BUF_SZ);
-            qid_buf[QID_BUF_SZ - 1] = '\0';
-            qd = _get_create_qdocs(run, cols[RUN_QID_COL], 1);
+        if (runid_line == 0 && rp->runid_change_line != 0
+          && !warned_about_runid) {
+            runid_line = rp->runid_change_line;
+            runid_now = rp->runid_change_buf;
         }
-        score = strtod(cols[RUN_SCORE_COL], &score_end);
-        if (*score_end != '\0') {
-            if (err_buf)
-                snprintf(err_buf, err_buf_len,
-                  "score '%s' not a floating point number on line "
-                  "%d of run file", cols[RUN_SCORE_COL], line_num);
-            run_delete(&run);
-            return NULL;
-        } else if (isnan(score)) {
-            /* The odd run puts in a single document with a score
-             * of NaN as a placeholder for a query that it otherwise
-             * would not have any results for. */
-            warning("score for qid %s, docid %s, on line "
-              "%d of run file is NaN, converting to 0.0\n",  cols[RUN_QID_COL],
-              cols[RUN_DOCID_COL], line_num);
-            score = 0.0;
+        if (rp->comma_line != 0 && !warned_about_commas
+          && (runid_line == 0 || rp->comma_line < runid_line)) {
+            warning("comma(s) in rank on line %d of run "
+              "file, stripping", rp->comma_line);
+            warned_about_commas = 1;
         }
-        errno = 0;
-        /* strtoul does automatic negative-to-positive conversion, which
-         * is not what we want... */
-        rank = strtol(cols[RUN_RANK_COL], &rank_end, 10);
-        if (*rank_end == ',') {
-            /* incredibly, some runs format ranks with commas */
-            static int warned_about_commas = 0;
-            char * f, * t;
-
-            if (!warned_about_commas) {
-                warning("comma(s) in rank on line %d of run "
-                  "file, stripping", line_num);
-                warned_about_commas = 1;
-            }
-            for (f = t = rank_end; ; f++, t++) {
-                while (*f == ',')
-                    f++;
-                *t = *f;
-                if (*f == '\0')
-                    break;
-            }
-            rank = strtol(cols[RUN_RANK_COL], &rank_end, 10);
+        if (runid_line != 0) {
+            warning("runid changes on line %d of run file: "
+              "was '%s', is now '%s'", runid_line, runid_buf, runid_now);
+            warned_about_runid = 1;
         }
-        if (errno == ERANGE || rank < 0 || *rank_end != '\0') {
+        if (rp->comma_line != 0 && !warned_about_commas) {
+            warning("comma(s) in rank on line %d of run "
+              "file, stripping", rp->comma_line);
+            warned_about_commas = 1;
+        }
+        if (chunks[c].ret < 0) {
             if (err_buf)
-                snprintf(err_buf, err_buf_len,
-                  "rank not a non-negative integer on line %d of run file",
-                  line_num);
+                snprintf(err_buf, err_buf_len, "%s", chunks[c].err_buf);
             run_delete(&run);
-            return NULL;
-        }
-        if (runid_buf[0] != '\0' && strcmp(cols[RUN_RUNID_COL], runid_buf)
-          != 0 && !warned_about_runid) {
-            warning("runid changes on line %d of run file: "
-              "was '%s', is now '%s'", line_num, runid_buf, 
-              cols[RUN_RUNID_COL]);
-            warned_about_runid = 1;
-        } else if (runid_buf[0] == '\0') {
-            strncpy(runid_buf, cols[RUN_RUNID_COL], RUNID_BUF_SZ);
+            goto END;
         }
-        qdocs_add_doc_score(qd, cols[RUN_DOCID_COL], (unsigned) rank, score);
+        _merge_run_chunk(run, &chunks[c]);
     }
-#ifdef RUN_MD5SUM
-    MD5_Final(md5_digest, &md5_ctx);
-    for (c = 0; c < MD5_DIGEST_LENGTH; c++) {
-        sprintf(run->md5sum + c * 2, "%02x", md5_digest[c]);
+    _finish_run(run, runid_buf);
+
+END:
+    for (c = 0; c < num_chunks; c++) {
+        free(chunks[c].rp.line_buf);
+        if (chunks[c].rp.run != NULL)
+            run_delete(&chunks[c].rp.run);
     }
+    free(chunks);
+    return run;
+}
+
+static void * _count_chunk_lines(void * arg) {
+    run_chunk_t * chunk = arg;
+    const char * pos = chunk->start;
+
+    chunk->num_lines = 0;
+    while (pos < chunk->end
+      && (pos = memchr(pos, '\n', chunk->end - pos)) != NULL) {
+        chunk->num_lines++;
+        pos++;
+    }
+    return NULL;
+}
+
+static void * _parse_chunk(void * arg) {
+    run_chunk_t * chunk = arg;
+
+    chunk->ret = _parse_buf(&chunk->rp, chunk->start, chunk->end);
+    return NULL;
+}
+
+/*
+ *  Apply FN to each chunk, each in a thread of its own.  Should a
+ *  thread not be able to be created, the chunk is processed here
+ *  instead.
+ */
+static void _run_chunk_threads(run_chunk_t * chunks, unsigned num_chunks,
+  void * (*fn)(void *)) {
+    pthread_t * threads;
+    int * started;
+    unsigned c;
+
+    threads = util_malloc_or_die(sizeof(*threads) * num_chunks);
+    started = util_malloc_or_die(sizeof(*started) * num_chunks);
+    for (c = 0; c < num_chunks; c++) {
+        started[c] = (pthread_create(&threads[c], NULL, fn, &chunks[c])
+          == 0);
+        if (!started[c])
+            fn(&chunks[c]);
+    }
+    for (c = 0; c < num_chunks; c++) {
+        if (started[c])
+            pthread_join(threads[c], NULL);
+    }
+    free(started);
+    free(threads);
+}
+
+/*
+ *  Move the qdocs of CHUNK onto the end of those of RUN.  Because
+ *  chunks are merged in file order, occurrence order is preserved.
+ */
+static void _merge_run_chunk(run_t * run, run_chunk_t * chunk) {
+    run_t * frag = chunk->rp.run;
+    unsigned q;
+
+    for (q = 0; q < frag->qdocs_num; q++) {
+        qdocs_t * qd = _get_create_qdocs(run, qdocs_qid(frag->qdocs[q]), 1);
+        qdocs_append(qd, frag->qdocs[q]);
+    }
+    arena_absorb(run->docids, &frag->docids);
+}
+
+#else
+
+run_t * load_run_parallel(FILE * fp, unsigned num_threads, char * err_buf,
+  unsigned err_buf_len) {
+    return load_run(fp, err_buf, err_buf_len);
+}
+
+#endif /* RUN_THREADS && !RUN_MD5SUM */
+
+static void _init_parse(run_parse_t * rp, run_t * run, char * qid,
+  unsigned line_base, char * err_buf, unsigned err_buf_len) {
+    rp->run = run;
+    rp->qid = qid;
+    rp->qid_buf[0] = '\0';
+    rp->runid_buf[0] = '\0';
+    rp->runid_line = 0;
+    rp->runid_change_buf[0] = '\0';
+    rp->runid_change_line = 0;
+    rp->comma_line = 0;
+    rp->defer_warnings = 0;
+    rp->line_num = line_base;
+    rp->qd = NULL;
+    rp->line_buf_sz = LINE_BUF_INIT_SZ;
+    rp->line_buf = util_malloc_or_die(rp->line_buf_sz);
+    rp->err_buf = err_buf;
+    rp->err_buf_len = err_buf_len;
+#ifdef RUN_MD5SUM
+    MD5_Init(&rp->md5_ctx);
 #endif /* RUN_MD5SUM */
+}
+
+static void _finish_run(run_t * run, const char * runid) {
+    unsigned q;
+
     for (q = 0; q < run->qdocs_num; q++) {
         unsigned depth = qdocs_num_scores(run->qdocs[q]);
         if (depth > run->max_depth)
             run->max_depth = depth;
     }
-    run->runid = util_strdup_or_die(runid_buf);
-    return run;
+    run->runid = util_strdup_or_die(runid);
+}
+
+/*
+ *  Read FP line by line.  Lines of any length are accepted; the line
+ *  buffer grows as needed.
+ */
+static int _parse_stream(run_parse_t * rp, FILE * fp) {
+    size_t len = 0;
+    int c;
+
+    /* no text run line can begin with the first byte of the magic */
+    if ((c = getc(fp)) == (unsigned char) RUNBIN_MAGIC[0])
+        return _read_runbin_stream(rp, fp);
+    else if (c != EOF)
+        ungetc(c, fp);
+
+    while (fgets(rp->line_buf + len, rp->line_buf_sz - len, fp) != NULL) {
+        len += strlen(rp->line_buf + len);
+        if (len > 0 && rp->line_buf[len - 1] != '\n' && !feof(fp)) {
+            /* line didn't fit: grow buffer and read the rest of it */
+            rp->line_buf_sz *= 2;
+            rp->line_buf = util_realloc_or_die(rp->line_buf,
+              rp->line_buf_sz);
+            continue;
+        }
+        if (_parse_line(rp, rp->line_buf, len) < 0)
+            return -1;
+        len = 0;
+    }
+    return 0;
+}
+
+#ifdef FUTIL_MMAP
+/*
+ *  Parse the lines of a mapped run file between START and END, which
+ *  must fall on line boundaries.  Each line is copied into the line
+ *  buffer before it is tokenised, since the mapping is read-only; but
+ *  there is no stdio overhead, and no per-line read calls.
+ */
+static int _parse_buf(run_parse_t * rp, const char * start,
+  const char * end) {
+    const char * pos = start;
+    const char * released;
+    size_t page_sz = sysconf(_SC_PAGESIZE);
+
+    /* only whole pages of our own range may be released */
+    released = (const char *) (((size_t) start + page_sz - 1)
+      & ~(page_sz - 1));
+    while (pos < end) {
+        const char * nl = memchr(pos, '\n', end - pos);
+        size_t len = (nl == NULL ? end : nl + 1) - pos;
+
+        if (len + 1 > rp->line_buf_sz) {
+            while (len + 1 > rp->line_buf_sz)
+                rp->line_buf_sz *= 2;
+            rp->line_buf = util_realloc_or_die(rp->line_buf,
+              rp->line_buf_sz);
+        }
+        memcpy(rp->line_buf, pos, len);
+        rp->line_buf[len] = '\0';
+        if (_parse_line(rp, rp->line_buf, len) < 0)
+            return -1;
+        pos += len;
+#ifdef MADV_DONTNEED
+        if (pos - released >= MMAP_RELEASE_SZ) {
+            /* docids have been copied out, so the pages behind us are
+             * no longer needed; don't let them count against us. */
+            madvise((void *) released, MMAP_RELEASE_SZ, MADV_DONTNEED);
+            released += MMAP_RELEASE_SZ;
+        }
+#endif /* MADV_DONTNEED */
+    }
+    return 0;
+}
+#endif /* FUTIL_MMAP */
+
+/*
+ *  Parse a single nul-terminated line of LEN bytes (including any
+ *  trailing newline).  The line is modified in place.
+ */
+static int _parse_line(run_parse_t * rp, char * line, size_t len) {
+    char * cols[RUN_NUM_COLS];
+    int ret;
+    double score;
+    long rank;
+    char * score_end;
+    char * rank_end;
+    char * docid;
+
+#ifdef RUN_MD5SUM
+    MD5_Update(&rp->md5_ctx, line, len);
+#endif /* RUN_MD5SUM */
+    rp->line_num++;
+    ret = util_parse_cols(line, cols, RUN_NUM_COLS);
+    if (ret < 0) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "wrong number of fields on line %d of run file", rp->line_num);
+        return -1;
+    }
+    util_downcase_str(cols[RUN_QID_COL]);
+    if (rp->qid != NULL && strcmp(rp->qid, cols[RUN_QID_COL]) != 0) {
+        return 0;
+    }
+    if (strcmp(cols[RUN_QID_COL], rp->qid_buf) != 0) {
+        strncpy(rp->qid_buf, cols[RUN_QID_COL], QID_BUF_SZ);
+        rp->qid_buf[QID_BUF_SZ - 1] = '\0';
+        rp->qd = _get_create_qdocs(rp->run, cols[RUN_QID_COL], 1);
+    }
+    score = strtod(cols[RUN_SCORE_COL], &score_end);
+    if (*score_end != '\0') {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "score '%s' not a floating point number on line "
+              "%d of run file", cols[RUN_SCORE_COL], rp->line_num);
+        return -1;
+    } else if (isnan(score)) {
+        /* The odd run puts in a single document with a score
+         * of NaN as a placeholder for a query that it otherwise
+         * would not have any results for. */
+        warning("score for qid %s, docid %s, on line "
+          "%d of run file is NaN, converting to 0.0\n",  cols[RUN_QID_COL],
+          cols[RUN_DOCID_COL], rp->line_num);
+        score = 0.0;
+    }
+    errno = 0;
+    /* strtoul does automatic negative-to-positive conversion, which
+     * is not what we want... */
+    rank = strtol(cols[RUN_RANK_COL], &rank_end, 10);
+    if (*rank_end == ',') {
+        /* incredibly, some runs format ranks with commas */
+        char * f, * t;
+
+        if (rp->defer_warnings) {
+            if (rp->comma_line == 0)
+                rp->comma_line = rp->line_num;
+        } else if (!warned_about_commas) {
+            warning("comma(s) in rank on line %d of run "
+              "file, stripping", rp->line_num);
+            warned_about_commas = 1;
+        }
+        for (f = t = rank_end; ; f++, t++) {
+            while (*f == ',')
+                f++;
+            *t = *f;
+            if (*f == '\0')
+                break;
+        }
+        rank = strtol(cols[RUN_RANK_COL], &rank_end, 10);
+    }
+    if (errno == ERANGE || rank < 0 || *rank_end != '\0') {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "rank not a non-negative integer on line %d of run file",
+              rp->line_num);
+        return -1;
+    }
+    if (rp->runid_buf[0] != '\0' && strcmp(cols[RUN_RUNID_COL],
+          rp->runid_buf) != 0 && rp->runid_change_line == 0) {
+        if (!rp->defer_warnings)
+            warning("runid changes on line %d of run file: "
+              "was '%s', is now '%s'", rp->line_num, rp->runid_buf, 
+              cols[RUN_RUNID_COL]);
+        strncpy(rp->runid_change_buf, cols[RUN_RUNID_COL], RUNID_BUF_SZ);
+        rp->runid_change_buf[RUNID_BUF_SZ - 1] = '\0';
+        rp->runid_change_line = rp->line_num;
+    } else if (rp->runid_buf[0] == '\0') {
+        strncpy(rp->runid_buf, cols[RUN_RUNID_COL], RUNID_BUF_SZ);
+        rp->runid_buf[RUNID_BUF_SZ - 1] = '\0';
+        rp->runid_line = rp->line_num;
+    }
+    util_downcase_str(cols[RUN_DOCID_COL]);
+    docid = arena_strdup(rp->run->docids, cols[RUN_DOCID_COL]);
+    qdocs_add_doc_score_ref(rp->qd, docid, (unsigned) rank, score);
+    return 0;
+}
+
+/*
+ *  FP is positioned just after the first byte of a binary run.  Read
+ *  it all into memory and load it.
+ */
+static int _read_runbin_stream(run_parse_t * rp, FILE * fp) {
+    run_t * run = rp->run;
+    size_t size = LINE_BUF_INIT_SZ;
+    size_t len = 1;
+    size_t nread;
+
+    run->bin = util_malloc_or_die(size);
+    run->bin[0] = RUNBIN_MAGIC[0];
+    while ((nread = fread(run->bin + len, 1, size - len, fp)) > 0) {
+        len += nread;
+        if (len == size) {
+            size *= 2;
+            run->bin = util_realloc_or_die(run->bin, size);
+        }
+    }
+    run->bin_sz = len;
+    if (ferror(fp)) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "error reading binary run file: %s", strerror(errno));
+        return -1;
+    }
+    if (len < RUNBIN_MAGIC_LEN
+      || memcmp(run->bin, RUNBIN_MAGIC, RUNBIN_MAGIC_LEN) != 0) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "bad magic number in binary run file");
+        return -1;
+    }
+    return _load_runbin(rp, run->bin, len);
+}
+
+/*
+ *  Load the binary run of BIN_SZ bytes at BIN, which must remain valid
+ *  for the lifetime of the run, as the docids point into it.  Only the
+ *  qid of RP is loaded, if one is given.
+ */
+static int _load_runbin(run_parse_t * rp, const char * bin, size_t bin_sz) {
+    const runbin_hdr_t * hdr = (const runbin_hdr_t *) bin;
+    const runbin_qid_t * qids;
+    const char * strtab;
+    unsigned q;
+
+    if (bin_sz < sizeof(*hdr)) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "binary run file truncated");
+        return -1;
+    }
+    if (hdr->byte_order != RUNBIN_BYTE_ORDER) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "binary run file has wrong byte order for this machine");
+        return -1;
+    }
+    if (hdr->version != RUNBIN_VERSION) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "binary run file has unsupported version %u",
+              (unsigned) hdr->version);
+        return -1;
+    }
+    if (hdr->qids_off > bin_sz || (bin_sz - hdr->qids_off)
+          / sizeof(*qids) < hdr->num_qids
+      || hdr->strtab_off > bin_sz || hdr->strtab_sz > bin_sz - hdr->strtab_off
+      || hdr->strtab_sz == 0 || bin[hdr->strtab_off + hdr->strtab_sz - 1]
+          != '\0'
+      || hdr->runid >= hdr->strtab_sz) {
+        if (rp->err_buf)
+            snprintf(rp->err_buf, rp->err_buf_len,
+              "binary run file truncated or corrupt");
+        return -1;
+    }
+    qids = (const runbin_qid_t *) (bin + hdr->qids_off);
+    strtab = bin + hdr->strtab_off;
+    for (q = 0; q < hdr->num_qids; q++) {
+        const runbin_doc_t * docs;
+        qdocs_t * qd;
+        unsigned d;
+
+        if (qids[q].qid >= hdr->strtab_sz || qids[q].docs_off > bin_sz
+          || (bin_sz - qids[q].docs_off) / sizeof(*docs)
+              < qids[q].num_docs) {
+            if (rp->err_buf)
+                snprintf(rp->err_buf, rp->err_buf_len,
+                  "binary run file truncated or corrupt");
+            return -1;
+        }
+        if (rp->qid != NULL && strcmp(rp->qid, strtab + qids[q].qid) != 0)
+            continue;
+        docs = (const runbin_doc_t *) (bin + qids[q].docs_off);
+        qd = _get_create_qdocs(rp->run, (char *) strtab + qids[q].qid, 1);
+        for (d = 0; d < qids[q].num_docs; d++) {
+            if (docs[d].docid >= hdr->strtab_sz) {
+                if (rp->err_buf)
+                    snprintf(rp->err_buf, rp->err_buf_len,
+                      "binary run file truncated or corrupt");
+                return -1;
+            }
+            qdocs_add_doc_score_ref(qd, (char *) strtab + docs[d].docid,
+              docs[d].rank, docs[d].score);
+        }
+    }
+    strncpy(rp->runid_buf, strtab + hdr->runid, RUNID_BUF_SZ);
+    rp->runid_buf[RUNID_BUF_SZ - 1] = '\0';
+    return 0;
+}
+
+/*
+ *  Add STR to the string table being built for a binary run, unless it
+ *  is already there, and return its offset.
+ */
+static uint32_t _runbin_str(strhash_t * offs, char ** strtab,
+  size_t * strtab_sz, size_t * strtab_len, const char * str) {
+    strhash_data_t * off;
+    int found;
+    size_t len = strlen(str) + 1;
+
+    off = strhash_update(offs, str, &found);
+    if (!found) {
+        while (*strtab_len + len > *strtab_sz) {
+            *strtab_sz = (*strtab_sz == 0) ? LINE_BUF_INIT_SZ
+                : *strtab_sz * 2;
+            *strtab = util_realloc_or_die(*strtab, *strtab_sz);
+        }
+        memcpy(*strtab + *strtab_len, str, len);
+        off->u = *strtab_len;
+        *strtab_len += len;
+    }
+    return off->u;
+}
+
+int run_write_binary(run_t * run, FILE * fp, char * err_buf,
+  unsigned err_buf_len) {
+    runbin_hdr_t hdr;
+    runbin_qid_t * qids = NULL;
+    uint32_t * docids = NULL;
+    unsigned num_docs = 0;
+    strhash_t * offs;
+    char * strtab = NULL;
+    size_t strtab_sz = 0;
+    size_t strtab_len = 0;
+    uint64_t off;
+    unsigned q, d, i;
+    int ret = -1;
+
+    /* first pass: lay out the qid table and the string table */
+    offs = new_strhash();
+    qids = util_malloc_or_die(sizeof(*qids) * (run->qdocs_num + 1));
+    for (q = 0; q < run->qdocs_num; q++)
+        num_docs += qdocs_num_scores(run->qdocs[q]);
+    docids = util_malloc_or_die(sizeof(*docids) * (num_docs + 1));
+    off = sizeof(hdr) + sizeof(*qids) * run->qdocs_num;
+    for (q = 0, i = 0; q < run->qdocs_num; q++) {
+        qdocs_t * qd = run->qdocs[q];
+        doc_score_t * ds = qdocs_get_scores(qd, QDOCS_ORD_OCCUR);
+
+        qids[q].qid = _runbin_str(offs, &strtab, &strtab_sz, &strtab_len,
+          qdocs_qid(qd));
+        qids[q].num_docs = qdocs_num_scores(qd);
+        qids[q].docs_off = off;
+        off += sizeof(runbin_doc_t) * qids[q].num_docs;
+        for (d = 0; d < qids[q].num_docs; d++, i++) {
+            docids[i] = _runbin_str(offs, &strtab, &strtab_sz, &strtab_len,
+              ds[d].docid);
+        }
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, RUNBIN_MAGIC, RUNBIN_MAGIC_LEN);
+    hdr.version = RUNBIN_VERSION;
+    hdr.byte_order = RUNBIN_BYTE_ORDER;
+    hdr.num_qids = run->qdocs_num;
+    hdr.runid = _runbin_str(offs, &strtab, &strtab_sz, &strtab_len,
+      run->runid);
+    hdr.qids_off = sizeof(hdr);
+    hdr.strtab_off = off;
+    hdr.strtab_sz = strtab_len;
+    if (strtab_len > UINT32_MAX) {
+        if (err_buf)
+            snprintf(err_buf, err_buf_len, "too many distinct docids "
+              "for binary run file");
+        goto END;
+    }
+
+    /* second pass: write it out */
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1
+      || fwrite(qids, sizeof(*qids), run->qdocs_num, fp) != run->qdocs_num)
+        goto WRITE_ERROR;
+    for (q = 0, i = 0; q < run->qdocs_num; q++) {
+        doc_score_t * ds = qdocs_get_scores(run->qdocs[q], QDOCS_ORD_OCCUR);
+
+        for (d = 0; d < qids[q].num_docs; d++, i++) {
+            runbin_doc_t doc;
+
+            memset(&doc, 0, sizeof(doc));
+            doc.score = ds[d].score;
+            doc.docid = docids[i];
+            doc.rank = ds[d].rank;
+            if (fwrite(&doc, sizeof(doc), 1, fp) != 1)
+                goto WRITE_ERROR;
+        }
+    }
+    if (fwrite(strtab, 1, strtab_len, fp) != strtab_len || fflush(fp) != 0)
+        goto WRITE_ERROR;
+    ret = 0;
+    goto END;
+
+WRITE_ERROR:
+    if (err_buf)
+        snprintf(err_buf, err_buf_len, "error writing binary run file: %s",
+          strerror(errno));
+
+END:
+    strhash_delete(&offs, NULL);
+    free(strtab);
+    free(docids);
+    free(qids);
+    return ret;
 }
 
 #ifdef RUN_MD5SUM
@@ -203,6 +892,14 @@ void run_delete(run_t ** run_p) {
     }
     free(run->qdocs);
     free(run->runid);
+    if (run->docids != NULL)
+        arena_delete(&run->docids);
+#ifdef FUTIL_MMAP
+    if (run->bin_mapped)
+        futil_unmap_file(run->bin, run->bin_sz);
+    else
+#endif /* FUTIL_MMAP */
+        free(run->bin);
     free(run);
     *run_p = NULL;
 }
@@ -220,6 +917,13 @@ qdocs_t * run_get_qdocs_by_qid(run_t * run, char * qid) {
     return _get_create_qdocs(run, qid, 0);
 }
 
+void run_resolve_docnos(run_t * run, strid_t * docids) {
+    unsigned q;
+
+    for (q = 0; q < run->qdocs_num; q++)
+        qdocs_resolve_docnos(run->qdocs[q], docids);
+}
+
 static run_t * _new_run() {
     run_t * run;
     run = util_malloc_or_die(sizeof(*run));
@@ -228,6 +932,10 @@ static run_t * _new_run() {
     run->qdocs_size = 0;
     run->qdocs_hash = new_strhash();
     run->max_depth = 0;
+    run->docids = new_arena(0);
+    run->bin = NULL;
+    run->bin_sz = 0;
+    run->bin_mapped = 0;
 #ifdef RUN_MD5SUM
     run->md5sum[0] = '\0';
 #endif /* RUN_MD5SUM */
@@ -251,7 +959,147 @@ static qdocs_t * _get_create_qdocs(run_t * run, char * qid, int create) {
 
 #ifdef RUN_MAIN
 
+#include <stdio.h>
+
 #define ERR_BUF_SIZE 1024
+#define TEST_QIDS 250
+#define TEST_MAX_DOCS 2000
+
+static unsigned test_threads[] = { 2, 3, 4, 7 };
+
+/*
+ *  Check that runs A and B have the same runid and queries, and the
+ *  same documents, ranks and scores in the same order of occurrence.
+ */
+static void _check_same_run(run_t * a, run_t * b) {
+    unsigned q;
+
+    assert(strcmp(run_get_runid(a), run_get_runid(b)) == 0);
+    assert(run_num_qdocs(a) == run_num_qdocs(b));
+    for (q = 0; q < run_num_qdocs(a); q++) {
+        qdocs_t * qa = run_get_qdocs_by_index(a, q);
+        qdocs_t * qb = run_get_qdocs_by_index(b, q);
+        doc_score_t * da;
+        doc_score_t * db;
+        unsigned s;
+
+        assert(strcmp(qdocs_qid(qa), qdocs_qid(qb)) == 0);
+        assert(run_get_qdocs_by_qid(b, qdocs_qid(qa)) == qb);
+        assert(qdocs_num_scores(qa) == qdocs_num_scores(qb));
+        da = qdocs_get_scores(qa, QDOCS_ORD_OCCUR);
+        db = qdocs_get_scores(qb, QDOCS_ORD_OCCUR);
+        for (s = 0; s < qdocs_num_scores(qa); s++) {
+            assert(strcmp(da[s].docid, db[s].docid) == 0);
+            assert(da[s].rank == db[s].rank);
+            assert(da[s].score == db[s].score);
+        }
+    }
+}
+
+/*
+ *  Check that loading FP (from its start) in parallel, and writing
+ *  RUN in binary form and reading it back, both give RUN.
+ */
+static void _check_loads(run_t * run, FILE * fp) {
+    char err_buf[ERR_BUF_SIZE];
+    run_t * other;
+    FILE * bin_fp;
+    unsigned t;
+
+    for (t = 0; t < sizeof(test_threads) / sizeof(test_threads[0]); t++) {
+        rewind(fp);
+        other = load_run_parallel(fp, test_threads[t], err_buf,
+          ERR_BUF_SIZE);
+        assert(other != NULL);
+        _check_same_run(run, other);
+        run_delete(&other);
+    }
+
+    bin_fp = tmpfile();
+    assert(bin_fp != NULL);
+    assert(run_write_binary(run, bin_fp, err_buf, ERR_BUF_SIZE) == 0);
+    rewind(bin_fp);
+    other = load_run(bin_fp, err_buf, ERR_BUF_SIZE);
+    assert(other != NULL);
+    _check_same_run(run, other);
+    run_delete(&other);
+    /* a binary run given to the parallel loader is read as is */
+    rewind(bin_fp);
+    other = load_run_parallel(bin_fp, 4, err_buf, ERR_BUF_SIZE);
+    assert(other != NULL);
+    _check_same_run(run, other);
+    run_delete(&other);
+    fclose(bin_fp);
+}
+
+/*
+ *  The qid of the line of BUF that holds POS.
+ */
+static unsigned _qid_at(const char * buf, size_t pos) {
+    while (pos > 0 && buf[pos - 1] != '\n')
+        pos--;
+    return (unsigned) strtoul(buf + pos, NULL, 10);
+}
+
+/*
+ *  Generate a run of several megabytes, with queries and lines of
+ *  differing lengths, and check that it loads the same serially, in
+ *  parallel, and from binary form.  The points at which the parallel
+ *  loader first splits the file must fall within lines, and within
+ *  the documents of a query, for the test to be worth anything.
+ */
+static void _test_generated_run(void) {
+    char err_buf[ERR_BUF_SIZE];
+    FILE * fp;
+    run_t * run;
+    char * buf;
+    size_t size;
+    unsigned q, d, t, c;
+    unsigned mid_line = 0;
+    unsigned mid_qid = 0;
+
+    fp = tmpfile();
+    assert(fp != NULL);
+    for (q = 0; q < TEST_QIDS; q++) {
+        unsigned num_docs = 1 + (q * 7919) % TEST_MAX_DOCS;
+
+        for (d = 0; d < num_docs; d++) {
+            fprintf(fp, "%u Q0 doc-%u-%u %u %.4f test\n", 400 + q,
+              (q * 31 + d * 17) % 1000, d, d + 1,
+              (double) (num_docs - d) / 7);
+        }
+    }
+    size = ftell(fp);
+    buf = util_malloc_or_die(size);
+    rewind(fp);
+    assert(fread(buf, 1, size, fp) == size);
+
+    for (t = 0; t < sizeof(test_threads) / sizeof(test_threads[0]); t++) {
+        size_t chunk_sz = size / test_threads[t];
+
+        assert(chunk_sz >= CHUNK_MIN_SZ);
+        for (c = 1; c < test_threads[t]; c++) {
+            size_t pos = c * chunk_sz;
+
+            if (buf[pos - 1] != '\n') {
+                mid_line++;
+                if (_qid_at(buf, pos) == _qid_at(buf, pos
+                      + strcspn(buf + pos, "\n") + 1))
+                    mid_qid++;
+            }
+        }
+    }
+    assert(mid_line > 0 && mid_qid > 0);
+    free(buf);
+
+    rewind(fp);
+    run = load_run(fp, err_buf, ERR_BUF_SIZE);
+    assert(run != NULL);
+    assert(run_num_qdocs(run) == TEST_QIDS);
+    _check_loads(run, fp);
+    run_delete(&run);
+    fclose(fp);
+}
 
 int main(int argc, char ** argv) {
     char * fname;
@@ -259,8 +1107,11 @@ int main(int argc, char ** argv) {
     run_t * run;
     char err_buf[ERR_BUF_SIZE];
 
+    _test_generated_run();
+    if (argc == 1)
+        return 0;
     if (argc != 2) {
-        fprintf(stderr, "Usage: %s <run-file>\n", argv[0]);
+        fprintf(stderr, "Usage: %s [<run-file>]\n", argv[0]);
         return -1;
     }
     fname = argv[1];
@@ -276,6 +1127,7 @@ int main(int argc, char ** argv) {
         fclose(fp);
         return -1;
     }
+    _check_loads(run, fp);
     run_delete(&run);
     fclose(fp);
     return 0;
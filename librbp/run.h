@@ -14,8 +14,31 @@
  */
 typedef struct run run_t;
 
+/*
+ *  Load a run from FP.  If FP is a regular file, it is memory-mapped
+ *  rather than read through stdio.  Lines may be of any length.
+ *
+ *  FP may also hold a binary run, as written by run_write_binary; this
+ *  is recognised by its magic number, and loaded without parsing.
+ */
 run_t * load_run(FILE * fp, char * err_buf, unsigned err_buf_len);
 
+/*
+ *  Load a run from FP, parsing it with up to NUM_THREADS threads.  The
+ *  file is split into byte ranges at line boundaries, each range is
+ *  parsed in a thread of its own, and the results are merged in file
+ *  order, so that the run is the same as that given by load_run (in
+ *  particular, the QDOCS_ORD_OCCUR order of documents is preserved).
+ *  Errors, and the runid and comma-in-rank warnings, report the same
+ *  lines that load_run would; NaN-score warnings may be interleaved
+ *  differently.
+ *
+ *  Falls back to load_run if FP cannot be mapped, if it is too small
+ *  to be worth splitting, or if threads are not supported.
+ */
+run_t * load_run_parallel(FILE * fp, unsigned num_threads, char * err_buf,
+  unsigned err_buf_len);
+
 run_t * load_run_single_query(FILE * fp, char * qid, char * err_buf, 
   unsigned err_buf_len);
 
@@ -25,12 +48,28 @@ qdocs_t * run_get_qdocs_by_index(run_t * run, unsigned index);
 
 qdocs_t * run_get_qdocs_by_qid(run_t * run, char * qid);
 
+/*
+ *  Resolve the docids of every query in RUN against DOCIDS; see
+ *  qdocs_resolve_docnos.  Typically DOCIDS is the dictionary of a
+ *  qrels (qrels_get_docids), so that any number of runs can share it.
+ */
+void run_resolve_docnos(run_t * run, strid_t * docids);
+
 const char * run_get_runid(run_t * run);
 
 #ifdef RUN_MD5SUM
 char * run_get_md5sum(run_t * run);
 #endif
 
+/*
+ *  Write RUN to FP in binary form, which load_run reads back (much
+ *  faster than it parses a text run).  The binary form is specific to
+ *  the byte order of the machine it was written on.  Returns 0 on
+ *  success, -1 on error.
+ */
+int run_write_binary(run_t * run, FILE * fp, char * err_buf,
+  unsigned err_buf_len);
+
 void run_delete(run_t ** run);
 
 #endif /* RUN_H */
@@ -3,21 +3,61 @@
 #include <stdlib.h>
 #include <string.h>
 #include "strhash.h"
+#include "arena.h"
 #include "util.h"
 
-#define INIT_TBL_SIZE 4096
-#define RESIZE_LOAD 0.4 
-
-struct strhash_elem {
-    char * key;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/*
+ *  The table is open addressed over groups of GROUP_WIDTH slots.  Each
+ *  group leads with a control byte per slot: CTRL_EMPTY for an empty
+ *  slot, or a 7-bit fingerprint of the key's hash for a full one.  A
+ *  probe compares the fingerprint against all the group's control
+ *  bytes at once (with SSE2 where available), and only touches the
+ *  slots, and the keys, of the few that match; the control bytes sit
+ *  next to their slots, so a hit costs little more than the key
+ *  comparison.  Probing moves on to another group only if the group
+ *  is full.  There is no deletion, so no tombstones.
+ *
+ *  The full hash of each slot is kept to one side, so that the table
+ *  grows without rehashing its keys; keys are copied into an arena
+ *  rather than allocated one by one.
+ */
+
+#define GROUP_WIDTH 16
+#define CTRL_EMPTY 0x80
+#define MIN_TBL_SIZE GROUP_WIDTH
+
+/* grow once the table is 7/8 full */
+#define MAX_ELEMS(tbl_size) ((tbl_size) - (tbl_size) / 8)
+
+/* average bytes of key storage expected per entry, for sizing the
+ * first block of the key arena */
+#define KEY_SZ_GUESS 16
+#define MIN_KEY_BLOCK_SZ 256
+#define MAX_KEY_BLOCK_SZ (64 * 1024)
+
+struct strhash_slot {
+    const char * key;
     /*  make sure there is room to hold primitive data types directly */
     strhash_data_t data;
 };
 
+struct strhash_group {
+    unsigned char ctrl[GROUP_WIDTH];
+    struct strhash_slot slots[GROUP_WIDTH];
+};
+
 struct strhash {
-    struct strhash_elem * tbl;
+    struct strhash_group * groups;
+    unsigned * hashes;             /* full hash of each full slot */
+    unsigned num_groups;           /* a power of 2 */
     unsigned tbl_size;
     unsigned elem_count;
+    unsigned max_elems;
+    arena_t * keys;
 };
 
 struct strhash_iter {
@@ -25,33 +65,53 @@ struct strhash_iter {
     unsigned index;
 };
 
+/* slot I of the table, counting across groups */
+#define CTRL(h, i) ((h)->groups[(i) / GROUP_WIDTH].ctrl[(i) % GROUP_WIDTH])
+#define SLOT(h, i) ((h)->groups[(i) / GROUP_WIDTH].slots[(i) % GROUP_WIDTH])
+
+#define FINGERPRINT(hval) ((unsigned char) ((hval) >> 25))
+
 static unsigned int _str_hash(const char * key);
+static unsigned _lowest_bit(unsigned bits);
+static unsigned _group_match(const unsigned char * ctrl, unsigned char c);
+static unsigned _group_empty(const unsigned char * ctrl);
 
+static void _strhash_alloc_tbl(strhash_t * strhash, unsigned num_groups);
 static void _strhash_expand(strhash_t * strhash);
-static struct strhash_elem * _strhash_find_slot(strhash_t * strhash, 
-  const char * key);
+static struct strhash_slot * _strhash_find(strhash_t * strhash,
+  const char * key, unsigned hval);
+static unsigned _strhash_find_empty(strhash_t * strhash, unsigned hval);
+
+strhash_t * new_strhash(void) {
+    return new_strhash_sized(0);
+}
 
-strhash_t * new_strhash() {
+strhash_t * new_strhash_sized(unsigned capacity) {
     strhash_t * strhash;
-    unsigned i;
+    unsigned tbl_size;
+    size_t key_block_sz;
 
+    for (tbl_size = MIN_TBL_SIZE; MAX_ELEMS(tbl_size) < capacity; 
+      tbl_size *= 2)
+        ;
     strhash = util_malloc_or_die(sizeof(*strhash));
-    strhash->tbl_size = INIT_TBL_SIZE;
-    strhash->tbl = util_malloc_or_die(sizeof(*strhash->tbl) * INIT_TBL_SIZE);
-    for (i = 0; i < strhash->tbl_size; i++) {
-        strhash->tbl[i].key = NULL;
-        strhash->tbl[i].data.v = NULL;
-    }
+    _strhash_alloc_tbl(strhash, tbl_size / GROUP_WIDTH);
     strhash->elem_count = 0;
+    key_block_sz = (size_t) capacity * KEY_SZ_GUESS;
+    if (key_block_sz < MIN_KEY_BLOCK_SZ)
+        key_block_sz = MIN_KEY_BLOCK_SZ;
+    else if (key_block_sz > MAX_KEY_BLOCK_SZ)
+        key_block_sz = MAX_KEY_BLOCK_SZ;
+    strhash->keys = new_arena(key_block_sz);
     return strhash;
 }
 
 void strhash_foreach(strhash_t * strhash, strhash_foreach_fn_t fn,
   void * userdata) {
-    int i;
+    unsigned i;
     for (i = 0; i < strhash->tbl_size; i++) {
-        if (strhash->tbl[i].key != NULL) {
-            fn(strhash->tbl[i].key, strhash->tbl[i].data, userdata);
+        if (CTRL(strhash, i) != CTRL_EMPTY) {
+            fn(SLOT(strhash, i).key, SLOT(strhash, i).data, userdata);
         }
     }
 }
@@ -61,15 +121,15 @@ void strhash_delete(strhash_t ** strhash_p,
     strhash_t * strhash = *strhash_p;
     unsigned i;
 
-    for (i = 0; i < strhash->tbl_size; i++) {
-        if (strhash->tbl[i].key != NULL) {
-            free(strhash->tbl[i].key);
-            if (free_data_fn) {
-                free_data_fn(strhash->tbl[i].data.v);
+    if (free_data_fn) {
+        for (i = 0; i < strhash->tbl_size; i++) {
+            if (CTRL(strhash, i) != CTRL_EMPTY) {
+                free_data_fn(SLOT(strhash, i).data.v);
             }
         }
     }
-    free(strhash->tbl);
+    arena_delete(&strhash->keys);
+    free(strhash->groups);
     free(strhash);
     *strhash_p = NULL;
 }
@@ -81,22 +141,26 @@ strhash_data_t * strhash_update(strhash_t * strhash, const char * key,
 
 strhash_data_t * strhash_update_grab_key(strhash_t * strhash, const char * key,
   int * found, const char ** hashkey) {
-    struct strhash_elem * slot;
+    struct strhash_slot * slot;
+    unsigned hval;
+    unsigned s;
 
-    if (strhash->elem_count > strhash->tbl_size * RESIZE_LOAD) {
-        _strhash_expand(strhash);
-    }
-    slot = _strhash_find_slot(strhash, key);
+    hval = _str_hash(key);
+    slot = _strhash_find(strhash, key, hval);
     if (found) {
-        if (slot->key)
-            *found = 1;
-        else
-            *found = 0;
+        *found = slot != NULL;
     }
-    if (slot->key == NULL) {
-        slot->key = util_strdup_or_die(key);
-        strhash->elem_count++;
+    if (slot == NULL) {
+        if (strhash->elem_count >= strhash->max_elems) {
+            _strhash_expand(strhash);
+        }
+        s = _strhash_find_empty(strhash, hval);
+        CTRL(strhash, s) = FINGERPRINT(hval);
+        strhash->hashes[s] = hval;
+        slot = &SLOT(strhash, s);
+        slot->key = arena_strdup(strhash->keys, key);
         slot->data.v = NULL;
+        strhash->elem_count++;
     }
     if (hashkey != NULL) {
         *hashkey = slot->key;
@@ -105,14 +169,16 @@ strhash_data_t * strhash_update_grab_key(strhash_t * strhash, const char * key,
 }
 
 strhash_data_t strhash_get(strhash_t * strhash, const char * key, int * found) {
-    struct strhash_elem * slot;
-    slot = _strhash_find_slot(strhash, key);
+    struct strhash_slot * slot;
+    strhash_data_t none;
+
+    slot = _strhash_find(strhash, key, _str_hash(key));
     if (found) {
-        if (slot->key) {
-            *found = 1;
-        } else {
-            *found = 0;
-        }
+        *found = slot != NULL;
+    }
+    if (slot == NULL) {
+        memset(&none, 0, sizeof(none));
+        return none;
     }
     return slot->data;
 }
@@ -132,16 +198,16 @@ strhash_iter_t * strhash_get_iter(strhash_t * strhash) {
 const char * strhash_iter_next(strhash_iter_t * iter, strhash_data_t * dat) {
     unsigned i;
     strhash_t * hash = iter->hash;
-    struct strhash_elem * tbl = hash->tbl;
-    for (i = iter->index; i < hash->tbl_size && tbl[i].key == NULL; i++)
+    for (i = iter->index; i < hash->tbl_size && CTRL(hash, i) == CTRL_EMPTY;
+      i++)
         ;
     iter->index = i + 1;
     if (i >= hash->tbl_size) {
         return NULL;
     } else {
         if (dat != NULL)
-            *dat = tbl[i].data;
-        return tbl[i].key;
+            *dat = SLOT(hash, i).data;
+        return SLOT(hash, i).key;
     }
 }
 
@@ -163,51 +229,141 @@ static unsigned int _str_hash(const char *str) {
         h ^= ((h << 5) + c + (h >> 2));
     }
 
+    /* mix, since the group is taken from the low bits and the
+     * fingerprint from the high ones (murmur3's finaliser) */
+    h &= 0xffffffffU;
+    h ^= h >> 16;
+    h = (h * 0x85ebca6bU) & 0xffffffffU;
+    h ^= h >> 13;
+    h = (h * 0xc2b2ae35U) & 0xffffffffU;
+    h ^= h >> 16;
     return h;
 }
 
+static unsigned _lowest_bit(unsigned bits) {
+#ifdef __GNUC__
+    return __builtin_ctz(bits);
+#else
+    unsigned b = 0;
+
+    while ((bits & 1) == 0) {
+        bits >>= 1;
+        b++;
+    }
+    return b;
+#endif
+}
+
+/* Bitmask of the control bytes of a group equal to C. */
+static unsigned _group_match(const unsigned char * ctrl, unsigned char c) {
+#ifdef __SSE2__
+    __m128i g = _mm_loadu_si128((const __m128i *) ctrl);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) c)));
+#else
+    unsigned bits = 0;
+    unsigned i;
+
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        if (ctrl[i] == c)
+            bits |= 1U << i;
+    }
+    return bits;
+#endif
+}
+
+/* Bitmask of the empty slots of a group. */
+static unsigned _group_empty(const unsigned char * ctrl) {
+#ifdef __SSE2__
+    /* only CTRL_EMPTY has the high bit set */
+    return _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) ctrl));
+#else
+    return _group_match(ctrl, CTRL_EMPTY);
+#endif
+}
+
+static void _strhash_alloc_tbl(strhash_t * strhash, unsigned num_groups) {
+    unsigned g;
+
+    /* groups and hashes share an allocation */
+    strhash->groups = util_malloc_or_die(num_groups 
+      * (sizeof(*strhash->groups) + GROUP_WIDTH * sizeof(*strhash->hashes)));
+    strhash->hashes = (unsigned *) (strhash->groups + num_groups);
+    for (g = 0; g < num_groups; g++) {
+        memset(strhash->groups[g].ctrl, CTRL_EMPTY, GROUP_WIDTH);
+    }
+    strhash->num_groups = num_groups;
+    strhash->tbl_size = num_groups * GROUP_WIDTH;
+    strhash->max_elems = MAX_ELEMS(strhash->tbl_size);
+}
+
 static void _strhash_expand(strhash_t * strhash) {
+    struct strhash_group * old_groups = strhash->groups;
+    unsigned * old_hashes = strhash->hashes;
     unsigned old_tbl_size = strhash->tbl_size;
-    struct strhash_elem * old_tbl = strhash->tbl;
     unsigned i;
 
-    strhash->tbl_size = old_tbl_size * 2;
-    strhash->tbl = util_malloc_or_die(strhash->tbl_size 
-      * sizeof(*strhash->tbl));
-    for (i = 0; i < strhash->tbl_size; i++) {
-        strhash->tbl[i].key = NULL;
-        strhash->tbl[i].data.v = NULL;
-    }
+    _strhash_alloc_tbl(strhash, strhash->num_groups * 2);
     for (i = 0; i < old_tbl_size; i++) {
-        if (old_tbl[i].key != NULL) {
-            struct strhash_elem * slot;
-            slot = _strhash_find_slot(strhash, old_tbl[i].key);
-            slot->key = old_tbl[i].key;
-            slot->data = old_tbl[i].data;
+        unsigned char c = old_groups[i / GROUP_WIDTH].ctrl[i % GROUP_WIDTH];
+
+        if (c != CTRL_EMPTY) {
+            unsigned s;
+
+            s = _strhash_find_empty(strhash, old_hashes[i]);
+            CTRL(strhash, s) = c;
+            SLOT(strhash, s) 
+              = old_groups[i / GROUP_WIDTH].slots[i % GROUP_WIDTH];
+            strhash->hashes[s] = old_hashes[i];
         }
     }
-    free(old_tbl);
+    free(old_groups);
 }
 
-static struct strhash_elem * _strhash_find_slot(strhash_t * strhash,
-  const char * key) {
-    unsigned s;
-    unsigned hval;
-
-    hval = _str_hash(key);
-    for (s = hval % strhash->tbl_size; ; s++) {
-        struct strhash_elem * slot;
-
-        if (s == strhash->tbl_size) {
-            s = 0;
+/*
+ *  Groups are probed at triangular offsets from the home group, which
+ *  visits every group of a power-of-two table before repeating.  An
+ *  entry only goes past a group that is full, and the table is never
+ *  full, so a probe can stop at the first group with an empty slot.
+ */
+static struct strhash_slot * _strhash_find(strhash_t * strhash,
+  const char * key, unsigned hval) {
+    unsigned mask = strhash->num_groups - 1;
+    unsigned char fp = FINGERPRINT(hval);
+    unsigned g = hval & mask;
+    unsigned stride = 0;
+
+    for (;;) {
+        struct strhash_group * group = &strhash->groups[g];
+        unsigned match = _group_match(group->ctrl, fp);
+
+        while (match != 0) {
+            struct strhash_slot * slot = &group->slots[_lowest_bit(match)];
+
+            if (strcmp(slot->key, key) == 0) {
+                return slot;
+            }
+            match &= match - 1;
         }
-        slot = &strhash->tbl[s];
-        if (slot->key == NULL || strcmp(slot->key, key) == 0) {
-            return slot;
+        if (_group_empty(group->ctrl) != 0) {
+            return NULL;
         }
-        assert((s + 1) % strhash->tbl_size != hval);
+        stride++;
+        g = (g + stride) & mask;
     }
-    /* never reach here. */
+}
+
+/* Index of the slot at which an entry with hash HVAL is to go. */
+static unsigned _strhash_find_empty(strhash_t * strhash, unsigned hval) {
+    unsigned mask = strhash->num_groups - 1;
+    unsigned g = hval & mask;
+    unsigned stride = 0;
+    unsigned empty;
+
+    while ((empty = _group_empty(strhash->groups[g].ctrl)) == 0) {
+        stride++;
+        g = (g + stride) & mask;
+    }
+    return g * GROUP_WIDTH + _lowest_bit(empty);
 }
 
 #ifdef STRHASH_MAIN
@@ -268,6 +424,10 @@ int main(int argc, char ** argv) {
         assert(dat.lf == strlen(line_buf));
     }
 
+    dat = strhash_get(strhash, "not a line, as it has no newline", &found);
+    assert(!found);
+    assert(dat.v == NULL);
+
     iter = strhash_get_iter(strhash);
     elem_count = 0;
     while ( (key = strhash_iter_next(iter, &dat)) != NULL) {
@@ -281,6 +441,33 @@ int main(int argc, char ** argv) {
     }
     assert(elem_count == strhash_num_entries(strhash));
 
+    strhash_iter_delete(&iter);
+    strhash_delete(&strhash, NULL);
+
+    /* keys stay put while the table grows past its initial size */
+    strhash = new_strhash_sized(100);
+    {
+        const char * keys[1000];
+        const char * hashkey;
+        unsigned i;
+
+        for (i = 0; i < 1000; i++) {
+            sprintf(line_buf, "doc-%u", i);
+            dat.u = i;
+            *strhash_update_grab_key(strhash, line_buf, &found, 
+              &keys[i]) = dat;
+            assert(!found);
+        }
+        assert(strhash_num_entries(strhash) == 1000);
+        for (i = 0; i < 1000; i++) {
+            sprintf(line_buf, "doc-%u", i);
+            assert(strcmp(keys[i], line_buf) == 0);
+            assert(strhash_update_grab_key(strhash, line_buf, &found,
+                  &hashkey)->u == i);
+            assert(found);
+            assert(hashkey == keys[i]);
+        }
+    }
     strhash_delete(&strhash, NULL);
     return 0;
 }
@@ -3,6 +3,12 @@
 
 /*
  *  Simple hash table with strings as keys.
+ *
+ *  Keys are copied into the table, and the copies (as returned by
+ *  strhash_update_grab_key and the iterator) stay put until the table
+ *  is deleted.  Data slots move as the table grows, so a pointer
+ *  returned by strhash_update is only good until the next update.
+ *  Iteration order is arbitrary.
  */
 
 typedef struct strhash strhash_t;
@@ -19,6 +25,10 @@ typedef struct strhash_iter strhash_iter_t;
 
 strhash_t * new_strhash(void);
 
+/* Create a table with room for CAPACITY entries before it has to
+ * grow. */
+strhash_t * new_strhash_sized(unsigned capacity);
+
 typedef void (*strhash_free_data_fn_t)(void * data);
 
 typedef void (*strhash_foreach_fn_t)(const char * key, strhash_data_t data,
@@ -0,0 +1,252 @@
+/*
+ * Microbenchmark of strhash against the linear-probing table it
+ * replaced, which is kept here for comparison.
+ *
+ * Usage: strhash_bench [<keyfile>]
+ *
+ * Keys are read one per line from KEYFILE, or if none is given a
+ * million TREC-style docids are generated.  Each table times the
+ * insertion of every key, a lookup of every key, and a lookup of as
+ * many keys that are not present.  Lookups are made in a shuffled
+ * order, as a run's docids are against the qrels.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "strhash.h"
+#include "util.h"
+
+#define USAGE "%s [<keyfile>]\n"
+
+#define NUM_GEN_KEYS 1000000
+#define LINE_BUF_SZ 1024
+
+/*
+ *  The old table: linear probing over {key, data} slots, with keys
+ *  strdup'ed and hashes recomputed on every resize.
+ */
+
+#define OLD_INIT_TBL_SIZE 4096
+#define OLD_RESIZE_LOAD 0.4
+
+struct old_elem {
+    char * key;
+    strhash_data_t data;
+};
+
+typedef struct {
+    struct old_elem * tbl;
+    unsigned tbl_size;
+    unsigned elem_count;
+} old_strhash_t;
+
+static unsigned int _old_str_hash(const char * str) {
+    char c;
+    unsigned int h = 100000007;
+
+    for (; (c = *str) != '\0'; str++) {
+        h ^= ((h << 5) + c + (h >> 2));
+    }
+    return h;
+}
+
+static struct old_elem * _old_find_slot(old_strhash_t * h, const char * key) {
+    unsigned s;
+
+    for (s = _old_str_hash(key) % h->tbl_size; ; s++) {
+        if (s == h->tbl_size)
+            s = 0;
+        if (h->tbl[s].key == NULL || strcmp(h->tbl[s].key, key) == 0)
+            return &h->tbl[s];
+    }
+}
+
+static void _old_alloc(old_strhash_t * h, unsigned tbl_size) {
+    unsigned i;
+
+    h->tbl_size = tbl_size;
+    h->tbl = util_malloc_or_die(sizeof(*h->tbl) * tbl_size);
+    for (i = 0; i < tbl_size; i++) {
+        h->tbl[i].key = NULL;
+        h->tbl[i].data.v = NULL;
+    }
+}
+
+static old_strhash_t * _new_old_strhash(void) {
+    old_strhash_t * h = util_malloc_or_die(sizeof(*h));
+
+    _old_alloc(h, OLD_INIT_TBL_SIZE);
+    h->elem_count = 0;
+    return h;
+}
+
+static strhash_data_t * _old_update(old_strhash_t * h, const char * key) {
+    struct old_elem * slot;
+
+    if (h->elem_count > h->tbl_size * OLD_RESIZE_LOAD) {
+        struct old_elem * old_tbl = h->tbl;
+        unsigned old_tbl_size = h->tbl_size;
+        unsigned i;
+
+        _old_alloc(h, old_tbl_size * 2);
+        for (i = 0; i < old_tbl_size; i++) {
+            if (old_tbl[i].key != NULL)
+                *_old_find_slot(h, old_tbl[i].key) = old_tbl[i];
+        }
+        free(old_tbl);
+    }
+    slot = _old_find_slot(h, key);
+    if (slot->key == NULL) {
+        slot->key = util_strdup_or_die(key);
+        h->elem_count++;
+    }
+    return &slot->data;
+}
+
+static strhash_data_t _old_get(old_strhash_t * h, const char * key,
+  int * found) {
+    struct old_elem * slot = _old_find_slot(h, key);
+
+    *found = slot->key != NULL;
+    return slot->data;
+}
+
+static void _old_delete(old_strhash_t * h) {
+    unsigned i;
+
+    for (i = 0; i < h->tbl_size; i++)
+        free(h->tbl[i].key);
+    free(h->tbl);
+    free(h);
+}
+
+static double _secs_since(clock_t start) {
+    return (double) (clock() - start) / CLOCKS_PER_SEC;
+}
+
+static void _report(const char * name, double ins, double hit, double miss,
+  unsigned long sum) {
+    printf("%-8s %10.3f %10.3f %10.3f   (%lu)\n", name, ins, hit, miss, sum);
+}
+
+int main(int argc, char ** argv) {
+    char ** keys;
+    char ** misses;
+    unsigned * order;
+    unsigned num_keys = 0;
+    unsigned keys_space = 0;
+    char line_buf[LINE_BUF_SZ];
+    strhash_t * h;
+    old_strhash_t * oh;
+    clock_t start;
+    double ins, hit, miss;
+    unsigned long sum;
+    unsigned i;
+    int found;
+
+    if (argc > 2) {
+        fprintf(stderr, USAGE, argv[0]);
+        return 1;
+    }
+    if (argc == 2) {
+        FILE * fp = fopen(argv[1], "r");
+
+        if (fp == NULL) {
+            fprintf(stderr, "Can't open %s for reading\n", argv[1]);
+            return 1;
+        }
+        keys = NULL;
+        while (fgets(line_buf, LINE_BUF_SZ, fp) != NULL) {
+            line_buf[strcspn(line_buf, "\n")] = '\0';
+            if (num_keys == keys_space) {
+                keys_space = keys_space ? keys_space * 2 : 1024;
+                keys = util_realloc_or_die(keys, sizeof(*keys) * keys_space);
+            }
+            keys[num_keys++] = util_strdup_or_die(line_buf);
+        }
+        fclose(fp);
+    } else {
+        num_keys = NUM_GEN_KEYS;
+        keys = util_malloc_or_die(sizeof(*keys) * num_keys);
+        for (i = 0; i < num_keys; i++) {
+            sprintf(line_buf, "clueweb09-en%04u-%02u-%05u", i % 7919,
+              (i / 7919) % 100, i);
+            keys[i] = util_strdup_or_die(line_buf);
+        }
+    }
+    order = util_malloc_or_die(sizeof(*order) * (num_keys + 1));
+    misses = util_malloc_or_die(sizeof(*misses) * (num_keys + 1));
+    for (i = 0; i < num_keys; i++) {
+        sprintf(line_buf, "%s#", keys[i]);
+        misses[i] = util_strdup_or_die(line_buf);
+        order[i] = i;
+    }
+    srand(1);
+    for (i = num_keys; i > 1; i--) {
+        unsigned j = (unsigned) (((double) rand() / ((double) RAND_MAX + 1))
+          * i);
+        unsigned tmp = order[i - 1];
+
+        order[i - 1] = order[j];
+        order[j] = tmp;
+    }
+    printf("%u keys; seconds per pass\n", num_keys);
+    printf("%-8s %10s %10s %10s\n", "table", "insert", "hit", "miss");
+
+    oh = _new_old_strhash();
+    start = clock();
+    for (i = 0; i < num_keys; i++)
+        _old_update(oh, keys[i])->u = i;
+    ins = _secs_since(start);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < num_keys; i++)
+        sum += _old_get(oh, keys[order[i]], &found).u;
+    hit = _secs_since(start);
+    start = clock();
+    for (i = 0; i < num_keys; i++) {
+        _old_get(oh, misses[order[i]], &found);
+        sum += found;
+    }
+    miss = _secs_since(start);
+    _report("old", ins, hit, miss, sum);
+    _old_delete(oh);
+
+    h = new_strhash();
+    start = clock();
+    for (i = 0; i < num_keys; i++)
+        strhash_update(h, keys[i], NULL)->u = i;
+    ins = _secs_since(start);
+    sum = 0;
+    start = clock();
+    for (i = 0; i < num_keys; i++)
+        sum += strhash_get(h, keys[order[i]], &found).u;
+    hit = _secs_since(start);
+    start = clock();
+    for (i = 0; i < num_keys; i++) {
+        strhash_get(h, misses[order[i]], &found);
+        sum += found;
+    }
+    miss = _secs_since(start);
+    _report("strhash", ins, hit, miss, sum);
+    strhash_delete(&h, NULL);
+
+    h = new_strhash_sized(num_keys);
+    start = clock();
+    for (i = 0; i < num_keys; i++)
+        strhash_update(h, keys[i], NULL)->u = i;
+    ins = _secs_since(start);
+    _report("sized", ins, 0.0, 0.0, 0);
+    strhash_delete(&h, NULL);
+
+    for (i = 0; i < num_keys; i++) {
+        free(keys[i]);
+        free(misses[i]);
+    }
+    free(keys);
+    free(misses);
+    free(order);
+    return 0;
+}
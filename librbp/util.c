@@ -24,6 +24,10 @@ void * util_realloc_or_die(void * mem, size_t size) {
     return mem;
 }
 
+void * util_malloc_array_or_die(size_t num, size_t size) {
+    return util_malloc_or_die(num > 0 ? num * size : size);
+}
+
 char * util_strdup_or_die(const char * str) {
     char * dup = strdup(str);
     if (dup == NULL) {
@@ -10,6 +10,13 @@ void * util_malloc_or_die(size_t size);
 
 void * util_realloc_or_die(void * mem, size_t size);
 
+/**
+ *  Malloc an array of NUM elements of SIZE bytes and die if it fails.
+ *  NUM may be 0, still giving a pointer that can be freed (as malloc
+ *  need not for 0 bytes).
+ */
+void * util_malloc_array_or_die(size_t num, size_t size);
+
 char * util_strdup_or_die(const char * str);
 
 char * util_next_nonspace(char * str);
@@ -0,0 +1,152 @@
+#include "config.h"
+#include <math.h>
+#include "wgttab.h"
+#include "util.h"
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define WGTTAB_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
+/* tables are no shallower than this, and otherwise a power of two,
+ * up to WGTTAB_MAX_DEPTH */
+#define WGTTAB_MIN_DEPTH 1024
+
+typedef struct wgttab_entry {
+    wgttab_t tab;
+    struct wgttab_entry * next;
+} wgttab_entry_t;
+
+/* newest first, so the deepest table for a persistence is found
+ * before those it has replaced */
+static wgttab_entry_t * tables = NULL;
+
+#ifdef WGTTAB_THREADS
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif /* WGTTAB_THREADS */
+
+static wgttab_entry_t * _new_entry(double persist, unsigned depth);
+
+const wgttab_t * wgttab_get(double persist, unsigned depth) {
+    wgttab_entry_t * e;
+    unsigned tab_depth;
+
+#ifdef WGTTAB_THREADS
+    pthread_mutex_lock(&tables_lock);
+#endif /* WGTTAB_THREADS */
+    if (depth > WGTTAB_MAX_DEPTH)
+        depth = WGTTAB_MAX_DEPTH;
+    for (e = tables; e != NULL; e = e->next) {
+        if (e->tab.persist == persist && e->tab.depth >= depth)
+            break;
+    }
+    if (e == NULL) {
+        for (tab_depth = WGTTAB_MIN_DEPTH; tab_depth < depth; tab_depth *= 2)
+            ;
+        if (tab_depth > WGTTAB_MAX_DEPTH)
+            tab_depth = WGTTAB_MAX_DEPTH;
+        e = _new_entry(persist, tab_depth);
+        e->next = tables;
+        tables = e;
+    }
+#ifdef WGTTAB_THREADS
+    pthread_mutex_unlock(&tables_lock);
+#endif /* WGTTAB_THREADS */
+    return &e->tab;
+}
+
+void wgttab_clear(void) {
+    wgttab_entry_t * e;
+
+#ifdef WGTTAB_THREADS
+    pthread_mutex_lock(&tables_lock);
+#endif /* WGTTAB_THREADS */
+    while ((e = tables) != NULL) {
+        tables = e->next;
+        free(e);
+    }
+#ifdef WGTTAB_THREADS
+    pthread_mutex_unlock(&tables_lock);
+#endif /* WGTTAB_THREADS */
+}
+
+/*
+ *  Build a table, with the entry and both arrays in one allocation.
+ */
+static wgttab_entry_t * _new_entry(double persist, unsigned depth) {
+    wgttab_entry_t * e;
+    double * wgt;
+    double * resid;
+    double w;
+    unsigned d;
+
+    e = util_malloc_or_die(sizeof(*e) + sizeof(double)
+      * (2 * (size_t) depth + 1));
+    wgt = (double *) (e + 1);
+    resid = wgt + depth;
+    w = 1 - persist;
+    for (d = 0; d < depth; d++) {
+        wgt[d] = w;
+        w *= persist;
+    }
+    for (d = 0; d <= depth; d++) {
+        resid[d] = pow(persist, d);
+    }
+    e->tab.persist = persist;
+    e->tab.depth = depth;
+    e->tab.wgt = wgt;
+    e->tab.resid = resid;
+    e->next = NULL;
+    return e;
+}
+
+#ifdef WGTTAB_MAIN
+
+#include <assert.h>
+#include "rbp.h"
+
+int main(void) {
+    const wgttab_t * t1, * t2, * t3;
+    double wgts[WGTTAB_MIN_DEPTH];
+    unsigned d;
+
+    t1 = wgttab_get(0.8, 10);
+    assert(t1->depth == WGTTAB_MIN_DEPTH);
+    assert(t1->persist == 0.8);
+    rbp_weights(wgts, 0.8, WGTTAB_MIN_DEPTH);
+    for (d = 0; d < t1->depth; d++) {
+        assert(t1->wgt[d] == wgts[d]);
+        assert(t1->resid[d] == pow(0.8, d));
+    }
+    assert(t1->resid[t1->depth] == pow(0.8, t1->depth));
+
+    /* the same table is shared */
+    assert(wgttab_get(0.8, WGTTAB_MIN_DEPTH) == t1);
+    t2 = wgttab_get(0.95, 1);
+    assert(t2 != t1 && t2->persist == 0.95);
+
+    /* a deeper table is built alongside, and is then preferred */
+    t3 = wgttab_get(0.8, WGTTAB_MIN_DEPTH + 1);
+    assert(t3 != t1);
+    assert(t3->depth == 2 * WGTTAB_MIN_DEPTH);
+    assert(t1->wgt[5] == wgts[5]);
+    assert(t3->wgt[5] == wgts[5]);
+    assert(wgttab_get(0.8, 3) == t3);
+
+    /* no table runs past the cap, and lookups beyond it use pow() */
+    t3 = wgttab_get(0.8, 10 * WGTTAB_MAX_DEPTH);
+    assert(t3->depth == WGTTAB_MAX_DEPTH);
+    assert(wgttab_get(0.8, WGTTAB_MAX_DEPTH + 1) == t3);
+    assert(wgttab_wgt(t3, 5) == wgts[5]);
+    assert(wgttab_wgt(t3, WGTTAB_MAX_DEPTH) == (1 - 0.8) * pow(0.8,
+          WGTTAB_MAX_DEPTH));
+    assert(wgttab_resid(t3, WGTTAB_MAX_DEPTH) == pow(0.8,
+          WGTTAB_MAX_DEPTH));
+    assert(wgttab_resid(t3, WGTTAB_MAX_DEPTH + 7) == pow(0.8,
+          WGTTAB_MAX_DEPTH + 7));
+
+    wgttab_clear();
+    return 0;
+}
+
+#endif /* WGTTAB_MAIN */
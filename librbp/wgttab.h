@@ -0,0 +1,66 @@
+#ifndef WGTTAB_H
+#define WGTTAB_H
+
+#include <math.h>
+
+/*
+ *  Tables of rbp weights and residuals, cached for the life of the
+ *  process.  A table for a given persistence is built the first time
+ *  it is asked for, and shared thereafter, so that scoring a ranking
+ *  is a multiply-add over the table rather than a call to pow() at
+ *  each rank.  Tables are never changed once built, and so may be
+ *  read from any number of threads.
+ *
+ *  No table runs deeper than WGTTAB_MAX_DEPTH, so that the cache
+ *  holds at most a few tens of kilobytes per persistence however long
+ *  the rankings are; wgttab_wgt and wgttab_resid fall back to pow()
+ *  beyond a table's end.
+ */
+
+#define WGTTAB_MAX_DEPTH 4096
+
+typedef struct {
+    double persist;
+    /* the number of weights */
+    unsigned depth;
+    /* WGT[d] is the weight of rank d (counting from 0), (1 - p) p^d,
+     * found by repeated multiplication, as by rbp_weights. */
+    const double * wgt;
+    /* RESID[d] is the residual after d documents, p^d, for d from 0
+     * to DEPTH inclusive. */
+    const double * resid;
+} wgttab_t;
+
+/*
+ *  Get the table for PERSIST that runs to at least DEPTH, or to
+ *  WGTTAB_MAX_DEPTH if DEPTH is deeper.  Depths are rounded up, so
+ *  that a table serves rankings of similar lengths; if a deeper table
+ *  is needed, it is built alongside the shallower one, which remains
+ *  valid.
+ */
+const wgttab_t * wgttab_get(double persist, unsigned depth);
+
+/*
+ *  The weight of rank D (counting from 0), from TAB if it runs that
+ *  deep, and otherwise by pow().
+ */
+static inline double wgttab_wgt(const wgttab_t * tab, unsigned d) {
+    return d < tab->depth ? tab->wgt[d]
+        : (1 - tab->persist) * pow(tab->persist, d);
+}
+
+/*
+ *  The residual after D documents, from TAB if it runs that deep, and
+ *  otherwise by pow().
+ */
+static inline double wgttab_resid(const wgttab_t * tab, unsigned d) {
+    return d <= tab->depth ? tab->resid[d] : pow(tab->persist, d);
+}
+
+/*
+ *  Free every table.  No table obtained before the call may be used
+ *  after it, so this is for the end of a program, or of a test.
+ */
+void wgttab_clear(void);
+
+#endif /* WGTTAB_H */
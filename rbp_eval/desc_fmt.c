@@ -11,16 +11,19 @@
 #include <openssl/md5.h>
 #endif /* HAVE_OPENSSL_MD5_H */
 
-static void desc_fmt_qid(qid_res_t * qres, depth_t * d_spec,
-  persist_t * p_spec, FILE * fp); 
+static void desc_fmt_qid(qid_res_t * qres, res_t * res, const char * runid,
+  FILE * fp); 
 
 static void desc_header(fmt_args_t * args, FILE * fp);
 
+static void desc_fmt_curve_qid(qid_curve_t * qc, persist_t * persist,
+  const char * runid, FILE * fp);
+
 void desc_fmt(res_t * res, fmt_args_t * args, FILE * fp) {
     unsigned q;
     enum details_t details = args->details;
 
-    if (!args->opt->no_header)
+    if (args->header)
         desc_header(args, fp);
 
     for (q = 0; q < res->num_qid; q++) {
@@ -32,18 +35,25 @@ void desc_fmt(res_t * res, fmt_args_t * args, FILE * fp) {
             continue;
         }
         if (details & DETAILS_PER_QUERY) {
-            desc_fmt_qid(qres, res->depth, res->persist, fp);
+            desc_fmt_qid(qres, res, args->run_label, fp);
         }
     }
     if (details & DETAILS_AVERAGES) {
-        desc_fmt_qid(&res->ave_res, res->depth, res->persist, fp);
+        desc_fmt_qid(&res->ave_res, res, args->run_label, fp);
     }
 }
 
 #define DEPTH_BUF_SIZE 32
 
-static void desc_fmt_qid(qid_res_t * qres, depth_t * d_spec,
-  persist_t * p_spec, FILE * fp) {
+/* the points of a persistence sweep are usually closer together than
+ * hundredths */
+#define P_PRECISION 2
+#define SWEEP_P_PRECISION 4
+
+static void desc_fmt_qid(qid_res_t * qres, res_t * res, const char * runid,
+  FILE * fp) {
+    depth_t * d_spec = res->depth;
+    int p_prec = res->persist != NULL ? P_PRECISION : SWEEP_P_PRECISION;
     unsigned d, p;
     for (d = 0; d < d_spec->d_num; d++) {
         unsigned depth = d_spec->d[d];
@@ -55,21 +65,72 @@ static void desc_fmt_qid(qid_res_t * qres, depth_t * d_spec,
         } else {
             snprintf(depth_buf, DEPTH_BUF_SIZE, "%u", depth);
         }
-        for (p = 0; p < p_spec->p_num; p++) {
-            double persist = p_spec->p[p];
+        for (p = 0; p < res->p_num; p++) {
+            double persist = res->p[p];
             persist_res_t * pres = &dres->persist_res[p];
 
-            fprintf(fp, "p= %.2lf q= %4s d= %4s rbp= %.4f +%.4f\n",
-              persist, qres->qid, depth_buf, pres->sum, pres->err);
+            if (runid != NULL)
+                fprintf(fp, "run= %s ", runid);
+            fprintf(fp, "p= %.*lf q= %4s d= %4s rbp= %.4f +%.4f\n",
+              p_prec, persist, qres->qid, depth_buf, pres->sum, pres->err);
         }
     }
 }
 
+void desc_fmt_curve(curve_res_t * res, fmt_args_t * args, FILE * fp) {
+    unsigned q;
+    enum details_t details = args->details;
+
+    if (args->header)
+        desc_header(args, fp);
+
+    for (q = 0; q < res->num_qid; q++) {
+        qid_curve_t * qc;
+
+        qc = &res->qid_res[q];
+        if (qc->num_rel < 0) {
+            warning("there are no judgments for query id %s", qc->qid);
+            continue;
+        }
+        if (details & DETAILS_PER_QUERY) {
+            desc_fmt_curve_qid(qc, res->persist, args->run_label, fp);
+        }
+    }
+    if (details & DETAILS_AVERAGES) {
+        desc_fmt_curve_qid(&res->ave_res, res->persist, args->run_label, fp);
+    }
+}
+
+static void desc_fmt_curve_qid(qid_curve_t * qc, persist_t * persist,
+  const char * runid, FILE * fp) {
+    unsigned d, p;
+
+    for (p = 0; p < persist->p_num; p++) {
+        if (runid != NULL)
+            fprintf(fp, "run= %s ", runid);
+        fprintf(fp, "p= %.*lf q= %4s rbp=", P_PRECISION, persist->p[p],
+          qc->qid);
+        for (d = 0; d < qc->num_depths; d++) {
+            fprintf(fp, " %.4f", qc->sums[d * persist->p_num + p]);
+        }
+        fprintf(fp, "\n");
+        if (runid != NULL)
+            fprintf(fp, "run= %s ", runid);
+        fprintf(fp, "p= %.*lf q= %4s err=", P_PRECISION, persist->p[p],
+          qc->qid);
+        for (d = 0; d < qc->num_depths; d++) {
+            fprintf(fp, " %.4f", qc->errs[d * persist->p_num + p]);
+        }
+        fprintf(fp, "\n");
+    }
+}
+
 #define HOSTNAME_BUF_SIZE 1024
 #define CWD_BUF_SIZE 1024
 
 void desc_header(fmt_args_t * args, FILE * fp) {
     int a;
+    unsigned r;
     time_t now;
 #ifdef HAVE_GETHOSTNAME
     char hostname_buf[HOSTNAME_BUF_SIZE];
@@ -109,12 +170,16 @@ void desc_header(fmt_args_t * args, FILE * fp) {
         fprintf(fp, "# user: %s\n", pwd->pw_name);
     }
 #endif /* HAVE_GETUID && HAVE_GETPWUID */
-    if (stat(args->opt->run_fname, &run_stat) == 0) {
-        fprintf(fp, "# %s modification time: %s", args->opt->run_fname,
-          ctime(&run_stat.st_mtime));
+    for (r = 0; r < args->opt->num_run_fnames; r++) {
+        const char * run_fname = args->opt->run_fnames[r];
+
+        if (stat(run_fname, &run_stat) == 0) {
+            fprintf(fp, "# %s modification time: %s", run_fname,
+              ctime(&run_stat.st_mtime));
+        }
     }
 #ifdef RUN_MD5SUM
-    fprintf(fp, "# %s md5sum: %s\n", args->opt->run_fname,
+    fprintf(fp, "# %s md5sum: %s\n", args->run_fname,
       run_get_md5sum(args->run));
 #endif /* HAVE_OPENSSL_MD5_H */
 }
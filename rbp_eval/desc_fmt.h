@@ -7,4 +7,8 @@
 
 void desc_fmt(res_t * res, fmt_args_t * args, FILE * fp);
 
+/* The every-depth (-A) results: for each persistence and query, a line
+ * of rbp values and a line of residuals, giving depth 1 first. */
+void desc_fmt_curve(curve_res_t * res, fmt_args_t * args, FILE * fp);
+
 #endif /* DESC_FMT_H */
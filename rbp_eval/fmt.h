@@ -18,6 +18,13 @@ typedef struct {
     char ** argv;
     struct opt * opt;
     run_t * run;
+    const char * run_fname;
+    /* if not NULL, each result is labelled with this (the name of the
+     * run file), so that the results of several runs can be told
+     * apart. */
+    const char * run_label;
+    /* whether to print the header, if the format has one. */
+    int header;
 } fmt_args_t;
 
 typedef void (*fmt_fn)(res_t * res, fmt_args_t * args, FILE * fp);
@@ -1,12 +1,20 @@
 #include "help.h"
 
-static const char * usage_fmt = "USAGE: %s [options] <qrels-file> <run-file>\n";
+static const char * usage_fmt =
+    "USAGE: %s [options] <qrels-file> [<run-file>...]\n";
 static const char * options_str= "options:\n"
 "   -d DEPTH_SPEC    ranking depths to calculate rbp to.  A comma-separated\n"
 "                      list of positive integers, or 0 to indicate to\n"
 "                      calculate for all documents in the run.\n"
 "   -p PERSIST_SPEC  user persistences to calculate rbp with.  A \n"
 "                      comma-separated list of floats in range [0.0,1.0]\n"
+"   -S LO:HI:NUM     sweep persistence: calculate rbp with NUM persistences\n"
+"                      evenly spaced from LO to HI, inclusive.  Not limited\n"
+"                      in number, as -p is.  Cannot be used with -p.\n"
+"   -A               calculate rbp at every depth, from 1 to the end of\n"
+"                      each ranking, in a single pass.  Each line of\n"
+"                      output gives the values for one query at all\n"
+"                      depths.  Cannot be used with -d or -S.\n"
 "   -q               print rbp values for each query (default is only give\n"
 "                      the overall averages)\n"
 "   -T               do not print overall averages ('T'otals)\n"
@@ -34,6 +42,14 @@ static const char * options_str= "options:\n"
 "                      scaling (as with the -F option).\n"
 "   -H               do not add header comment to output.\n"
 "   -W               suppress warning messages.\n"
+"   -j THREADS       use up to THREADS threads.  Several run files are\n"
+"                      evaluated concurrently, with the threads shared\n"
+"                      among them; a single run file is parsed, and its\n"
+"                      topics evaluated, in parallel.\n"
+"   -l RUN_LIST      also evaluate the run files named in RUN_LIST, one\n"
+"                      per line.  If more than one run is evaluated, each\n"
+"                      line of output is labelled with the name of its\n"
+"                      run file.\n"
 "   -h               this help message\n";
 
 static const char * long_help = "";
@@ -1,3 +1,4 @@
+#include "config.h"
 #include "rbp.h"
 #include "opt.h"
 #include "qrels.h"
@@ -11,19 +12,209 @@
 #include "trec_fmt.h"
 #include "help.h"
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define RBP_EVAL_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
 #define ERR_BUF_LEN 1024
+#define COPY_BUF_LEN 8192
+
+static int _eval_runs_parallel(qrels_t * qrels, struct opt * opt,
+  fmt_args_t * fmt_args);
+
+/*
+ *  Load, evaluate and report to OUT the run RUN_FNAME against QRELS,
+ *  with up to NUM_THREADS threads.
+ */
+static int _eval_run(const char * run_fname, qrels_t * qrels,
+  struct opt * opt, fmt_args_t * fmt_args, unsigned num_threads,
+  FILE * out) {
+    FILE * run_fp;
+    run_t * run;
+    res_t * res = NULL;
+    curve_res_t * curve_res = NULL;
+    char err_buf[ERR_BUF_LEN];
+
+    run_fp = fopen(run_fname, "r");
+    if (run_fp == NULL) {
+        fprintf(stderr, "Unable to open run file %s for reading\n",
+          run_fname);
+        return -1;
+    }
+    run = load_run_parallel(run_fp, num_threads, err_buf, ERR_BUF_LEN);
+    fclose(run_fp);
+    if (run == NULL) {
+        fprintf(stderr, "Error loading run file %s: %s\n", run_fname,
+          err_buf);
+        return -1;
+    }
+
+    if (opt->all_depths) {
+        curve_res = evaluate_curve(qrels, run, opt->ord, &opt->persist,
+          num_threads);
+    } else if (opt->sweep != NULL) {
+        res = evaluate_res_sweep(qrels, run, opt->ord, opt->sweep,
+          opt->sweep_num, &opt->depth, num_threads);
+    } else {
+        res = evaluate_res_parallel(qrels, run, opt->ord, &opt->persist,
+          &opt->depth, num_threads);
+    }
+
+    fmt_args->run = run;
+    fmt_args->run_fname = run_fname;
+    /* by file name rather than runid, which runs often share */
+    if (opt->num_run_fnames > 1)
+        fmt_args->run_label = run_fname;
+    if (curve_res != NULL)
+        desc_fmt_curve(curve_res, fmt_args, out);
+    else
+        desc_fmt(res, fmt_args, out);
+    /* the header describes the whole batch, so is printed only once */
+    fmt_args->header = 0;
+
+    if (curve_res != NULL)
+        curve_res_delete(&curve_res);
+    else
+        res_delete(&res);
+    run_delete(&run);
+    return 0;
+}
+
+#ifdef RBP_EVAL_THREADS
+
+/*
+ *  The runs of a batch, shared out among threads.  Each run is written
+ *  to a temporary file of its own, and the files are copied out in
+ *  order once every run is done.
+ */
+typedef struct {
+    qrels_t * qrels;
+    struct opt * opt;
+    fmt_args_t * fmt_args;
+    unsigned threads_per_run;
+    FILE ** outs;
+    int * rets;
+    pthread_mutex_t lock;
+    unsigned next_r;
+} run_work_t;
+
+static void * _eval_run_worker(void * arg) {
+    run_work_t * work = arg;
+
+    for (;;) {
+        fmt_args_t fmt_args;
+        unsigned r;
+
+        pthread_mutex_lock(&work->lock);
+        r = work->next_r++;
+        pthread_mutex_unlock(&work->lock);
+        if (r >= work->opt->num_run_fnames)
+            break;
+        work->outs[r] = tmpfile();
+        if (work->outs[r] == NULL) {
+            fprintf(stderr, "Unable to create temporary file for "
+              "output of run file %s\n", work->opt->run_fnames[r]);
+            work->rets[r] = -1;
+            continue;
+        }
+        fmt_args = *work->fmt_args;
+        fmt_args.header = work->fmt_args->header && r == 0;
+        work->rets[r] = _eval_run(work->opt->run_fnames[r], work->qrels,
+          work->opt, &fmt_args, work->threads_per_run, work->outs[r]);
+    }
+    return NULL;
+}
+
+/*
+ *  Evaluate the runs of OPT with up to OPT->THREADS threads between
+ *  them, reporting them in order.  The threads are shared evenly among
+ *  as many runs at a time as there are threads, or as there are runs.
+ */
+static int _eval_runs_parallel(qrels_t * qrels, struct opt * opt,
+  fmt_args_t * fmt_args) {
+    run_work_t work;
+    pthread_t * threads;
+    unsigned num_workers;
+    unsigned num_started;
+    unsigned r;
+    int ret = 0;
+
+    num_workers = opt->threads;
+    if (num_workers > opt->num_run_fnames)
+        num_workers = opt->num_run_fnames;
+    work.qrels = qrels;
+    work.opt = opt;
+    work.fmt_args = fmt_args;
+    work.threads_per_run = opt->threads / num_workers;
+    work.outs = util_malloc_or_die(sizeof(*work.outs)
+      * opt->num_run_fnames);
+    work.rets = util_malloc_or_die(sizeof(*work.rets)
+      * opt->num_run_fnames);
+    for (r = 0; r < opt->num_run_fnames; r++) {
+        work.outs[r] = NULL;
+        work.rets[r] = 0;
+    }
+    pthread_mutex_init(&work.lock, NULL);
+    work.next_r = 0;
+    threads = util_malloc_or_die(sizeof(*threads) * num_workers);
+    for (num_started = 0; num_started < num_workers; num_started++) {
+        if (pthread_create(&threads[num_started], NULL, _eval_run_worker,
+              &work) != 0)
+            break;
+    }
+    /* if no thread could be created, do the work here */
+    if (num_started == 0)
+        _eval_run_worker(&work);
+    for (r = 0; r < num_started; r++)
+        pthread_join(threads[r], NULL);
+    free(threads);
+    pthread_mutex_destroy(&work.lock);
+
+    for (r = 0; r < opt->num_run_fnames; r++) {
+        char buf[COPY_BUF_LEN];
+        size_t n;
+
+        if (work.rets[r] < 0)
+            ret = -1;
+        if (work.outs[r] == NULL)
+            continue;
+        rewind(work.outs[r]);
+        while ((n = fread(buf, 1, COPY_BUF_LEN, work.outs[r])) > 0)
+            fwrite(buf, 1, n, stdout);
+        fclose(work.outs[r]);
+    }
+    free(work.outs);
+    free(work.rets);
+    return ret;
+}
+
+#else
+
+static int _eval_runs_parallel(qrels_t * qrels, struct opt * opt,
+  fmt_args_t * fmt_args) {
+    unsigned r;
+    int ret = 0;
+
+    for (r = 0; r < opt->num_run_fnames; r++) {
+        if (_eval_run(opt->run_fnames[r], qrels, opt, fmt_args, 1,
+              stdout) < 0)
+            ret = -1;
+    }
+    return ret;
+}
+
+#endif /* RBP_EVAL_THREADS */
 
 int main(int argc, char ** argv) {
     int ret;
     struct opt opt;
     FILE * qrels_fp = NULL;
-    FILE * run_fp = NULL;
-    run_t * run = NULL;
     qrels_t * qrels = NULL;
-    res_t * res = NULL;
     char err_buf[ERR_BUF_LEN];
     double max_rel;
     fmt_args_t fmt_args;
+    unsigned r;
 
     ret = opt_process(&opt, argc, argv);
     if (ret != 1)
@@ -33,6 +224,7 @@ int main(int argc, char ** argv) {
         warning_set_stream(NULL);
     }
 
+    /* the qrels are loaded once, and shared by all the runs */
     qrels_fp = fopen(opt.qrels_fname, "r");
     if (qrels_fp == NULL) {
         fprintf(stderr, "Unable to open qrels file %s for reading\n",
@@ -40,21 +232,6 @@ int main(int argc, char ** argv) {
         print_help(argv[0], stderr);
         goto ERROR;
     }
-    run_fp = fopen(opt.run_fname, "r");
-    if (run_fp == NULL) {
-        fprintf(stderr, "Unable to open run file %s for reading\n",
-          opt.run_fname);
-        print_help(argv[0], stderr);
-        goto ERROR;
-    }
-
-    run = load_run(run_fp, err_buf, ERR_BUF_LEN);
-    if (run == NULL) {
-        fprintf(stderr, "Error loading run file: %s\n", err_buf);
-        print_help(argv[0], stderr);
-        goto ERROR;
-    }
-
     qrels = load_qrels(qrels_fp, err_buf, ERR_BUF_LEN);
     if (qrels == NULL) {
         fprintf(stderr, "Error loading qrels: %s\n", err_buf);
@@ -69,16 +246,24 @@ int main(int argc, char ** argv) {
         warning("maximum effective relevance of %.2lf exceeds 1.0", max_rel);
     }
 
-    res = evaluate_res(qrels, run, opt.ord, &opt.persist, &opt.depth);
-
     fmt_args.argc = argc;
     fmt_args.argv = argv;
     fmt_args.details = opt.details;
     fmt_args.opt = &opt;
-    fmt_args.run = run;
-    desc_fmt(res, &fmt_args, stdout);
-
+    fmt_args.run_label = NULL;
+    fmt_args.header = !opt.no_header;
     ret = 0;
+    if (opt.threads > 1 && opt.num_run_fnames > 1) {
+        /* the runs of a batch are spread across the threads */
+        ret = _eval_runs_parallel(qrels, &opt, &fmt_args);
+    } else {
+        for (r = 0; r < opt.num_run_fnames; r++) {
+            /* a bad run is reported, but does not stop the rest */
+            if (_eval_run(opt.run_fnames[r], qrels, &opt, &fmt_args,
+                  opt.threads, stdout) < 0)
+                ret = -1;
+        }
+    }
     goto END;
 
 ERROR:
@@ -87,14 +272,9 @@ ERROR:
 END:
     if (qrels_fp)
         fclose(qrels_fp);
-    if (run_fp)
-        fclose(run_fp);
-    if (run)
-        run_delete(&run);
     if (qrels)
         qrels_delete(&qrels);
-    if (res)
-        res_delete(&res);
+    opt_cleanup(&opt);
 
     return ret;
 }
@@ -1,10 +1,15 @@
 #include "opt.h"
 #include "error.h"
 #include "help.h"
+#include "util.h"
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include <stdarg.h>
 
+#define RUN_LIST_LINE_BUF_SZ 4096
+
 void opt_error(char * fmt, ...) {
     va_list ap;
 
@@ -18,6 +23,9 @@ void opt_error(char * fmt, ...) {
 void opt_init(struct opt * opt) {
     opt->depth.d_num = 0;
     opt->persist.p_num = 0;
+    opt->sweep = NULL;
+    opt->sweep_num = 0;
+    opt->all_depths = -1;
     opt->ord = -1;
     /* because the detail field is a bitmask of flags, we have to
      * set it its default values here. */
@@ -27,12 +35,18 @@ void opt_init(struct opt * opt) {
     opt->help_and_exit = -1;
     opt->no_header = -1;
     opt->no_warnings = -1;
+    opt->threads = -1;
+    opt->run_list_fname = NULL;
+    opt->run_fnames = NULL;
+    opt->num_run_fnames = 0;
 }
 
 void opt_set_defaults(struct opt * opt) {
+    if (opt->all_depths == -1)
+        opt->all_depths = 0;
     if (opt->depth.d_num == 0)
         parse_depth(&opt->depth, DEFAULT_DEPTH, NULL, 0);
-    if (opt->persist.p_num == 0)
+    if (opt->persist.p_num == 0 && opt->sweep == NULL)
         parse_persist(&opt->persist, DEFAULT_PERSIST, NULL, 0);
     if (opt->ord == -1)
         opt->ord = QDOCS_DEFAULT_ORDERING;
@@ -47,12 +61,61 @@ void opt_set_defaults(struct opt * opt) {
         opt->no_header = 0;
     if (opt->no_warnings == -1)
         opt->no_warnings = 0;
+    if (opt->threads == -1)
+        opt->threads = 1;
 }
 
 #define ERR_BUF_LEN 1024
 
+static void _add_run_fname(struct opt * opt, const char * fname) {
+    opt->run_fnames = util_realloc_or_die(opt->run_fnames,
+      sizeof(*opt->run_fnames) * (opt->num_run_fnames + 1));
+    opt->run_fnames[opt->num_run_fnames++] = util_strdup_or_die(fname);
+}
+
+/*
+ *  Add the runs named in the run list FNAME, one per line.  Leading
+ *  and trailing whitespace is ignored, as are blank lines.
+ */
+static int _load_run_list(struct opt * opt, const char * fname) {
+    FILE * fp;
+    char line_buf[RUN_LIST_LINE_BUF_SZ];
+    unsigned line = 0;
+
+    fp = fopen(fname, "r");
+    if (fp == NULL) {
+        opt_error("unable to open run list %s for reading", fname);
+        return -1;
+    }
+    while (fgets(line_buf, RUN_LIST_LINE_BUF_SZ, fp) != NULL) {
+        char * start;
+        char * end;
+
+        line++;
+        if (strchr(line_buf, '\n') == NULL && !feof(fp)) {
+            opt_error("line %u of run list %s is too long", line, fname);
+            fclose(fp);
+            return -1;
+        }
+        start = util_next_nonspace(line_buf);
+        end = start + strlen(start);
+        while (end > start && isspace((unsigned char) end[-1]))
+            end--;
+        *end = '\0';
+        if (*start != '\0')
+            _add_run_fname(opt, start);
+    }
+    if (ferror(fp)) {
+        opt_error("error reading run list %s", fname);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    return 0;
+}
+
 int opt_getopt(struct opt * opt, int argc, char * const argv[]) {
-    const char * optstring = "aBb:Ff:d:p:qTrshHoW";
+    const char * optstring = "aABb:Ff:d:p:S:qTrshHoWj:l:";
     int optflag;
     int error = 0;
     char err_buf[ERR_BUF_LEN];
@@ -74,9 +137,17 @@ int opt_getopt(struct opt * opt, int argc, char * const argv[]) {
                 }
             }
             break;
+        case 'A':
+            if (opt->all_depths != -1) {
+                opt_error("every-depth option (-A) already specified");
+                error = 1;
+            } else {
+                opt->all_depths = 1;
+            }
+            break;
         case 'p':
-            if (opt->persist.p_num != 0) {
-                opt_error("persist spec (-p) already given");
+            if (opt->persist.p_num != 0 || opt->sweep != NULL) {
+                opt_error("persist spec (-p, -S) already given");
                 error = 1;
             } else {
                 if (parse_persist(&opt->persist, optarg, err_buf, ERR_BUF_LEN) 
@@ -89,6 +160,19 @@ int opt_getopt(struct opt * opt, int argc, char * const argv[]) {
                 }
             }
             break;
+        case 'S':
+            if (opt->persist.p_num != 0 || opt->sweep != NULL) {
+                opt_error("persist spec (-p, -S) already given");
+                error = 1;
+            } else {
+                opt->sweep = parse_persist_sweep(optarg, &opt->sweep_num,
+                  err_buf, ERR_BUF_LEN);
+                if (opt->sweep == NULL) {
+                    opt_error(err_buf);
+                    error = 1;
+                }
+            }
+            break;
         case 'q':
             if (opt->details & DETAILS_PER_QUERY) {
                 opt_error("per-query output (-q) already specified");
@@ -208,6 +292,30 @@ int opt_getopt(struct opt * opt, int argc, char * const argv[]) {
                 opt->no_warnings = 1;
             }
             break;
+        case 'j':
+            if (opt->threads != -1) {
+                opt_error("thread count (-j) already specified");
+                error = 1;
+            } else {
+                char * endptr;
+                long val;
+                val = strtol(optarg, &endptr, 10);
+                if (*endptr != '\0' || val <= 0) {
+                    opt_error("invalid argument to -j option");
+                    error = 1;
+                } else {
+                    opt->threads = val;
+                }
+            }
+            break;
+        case 'l':
+            if (opt->run_list_fname != NULL) {
+                opt_error("run list (-l) already specified");
+                error = 1;
+            } else {
+                opt->run_list_fname = optarg;
+            }
+            break;
         case 'h':
             opt->help_and_exit = 1;
             break;
@@ -216,16 +324,32 @@ int opt_getopt(struct opt * opt, int argc, char * const argv[]) {
             break;
         }
     }
+    if (opt->all_depths == 1 && opt->depth.d_num != 0) {
+        opt_error("every-depth option (-A) cannot be used with -d");
+        error = 1;
+    }
+    if (opt->all_depths == 1 && opt->sweep != NULL) {
+        opt_error("every-depth option (-A) cannot be used with -S");
+        error = 1;
+    }
     if (opt->help_and_exit != 1) {
-        if (optind > argc - 2) {
-            opt_error("both qrels and run files must be specified");
-            error = 1;
-        } else if (optind < argc - 2) {
-            opt_error("trailing arguments");
+        if (optind >= argc) {
+            opt_error("qrels file must be specified");
             error = 1;
         } else {
+            int a;
+
             opt->qrels_fname = argv[optind];
-            opt->run_fname = argv[optind + 1];
+            for (a = optind + 1; a < argc; a++) {
+                _add_run_fname(opt, argv[a]);
+            }
+            if (opt->run_list_fname != NULL
+              && _load_run_list(opt, opt->run_list_fname) < 0) {
+                error = 1;
+            } else if (opt->num_run_fnames == 0) {
+                opt_error("at least one run file must be specified");
+                error = 1;
+            }
         }
     }
     if (error)
@@ -251,6 +375,20 @@ int opt_process(struct opt * opt, int argc, char * const argv[]) {
     return 1;
 }
 
+void opt_cleanup(struct opt * opt) {
+    unsigned r;
+
+    for (r = 0; r < opt->num_run_fnames; r++) {
+        free(opt->run_fnames[r]);
+    }
+    free(opt->run_fnames);
+    opt->run_fnames = NULL;
+    opt->num_run_fnames = 0;
+    free(opt->sweep);
+    opt->sweep = NULL;
+    opt->sweep_num = 0;
+}
+
 #ifdef OPT_MAIN
 
 int main(int argc, char ** argv) {
@@ -266,6 +404,7 @@ int main(int argc, char ** argv) {
         if (opt.help_and_exit)
             print_help(argv[0], stdout);
     }
+    opt_cleanup(&opt);
     return ret;
 }
 
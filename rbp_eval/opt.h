@@ -15,6 +15,12 @@
 struct opt {
     depth_t depth;
     persist_t persist;
+    /* if not NULL, a persistence sweep (-S) of SWEEP_NUM values, used
+     * instead of PERSIST */
+    double * sweep;
+    unsigned sweep_num;
+    /* rbp at every depth (-A), in place of DEPTH */
+    int all_depths;
     enum qdocs_ord_t ord;
     enum details_t details;
     enum reltype_t reltype;
@@ -22,9 +28,14 @@ struct opt {
     int no_header;
     int help_and_exit;
     int no_warnings;
+    int threads;
 
     const char * qrels_fname;
-    const char * run_fname;
+    const char * run_list_fname;
+    /* the runs named on the command line, followed by those in the
+     * run list, if any. */
+    char ** run_fnames;
+    unsigned num_run_fnames;
 };
 
 void opt_init(struct opt * opt); 
@@ -35,4 +46,6 @@ int opt_getopt(struct opt * opt, int argc, char * const argv[]);
 
 int opt_process(struct opt * opt, int argc, char * const argv[]);
 
+void opt_cleanup(struct opt * opt);
+
 #endif /* OPT_H */
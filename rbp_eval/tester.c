@@ -122,7 +122,7 @@ int main(int argc, char ** argv) {
     fclose(fp);
 
     /* run file */
-    fp = fopen_or_die(opt.run_fname);
+    fp = fopen_or_die(opt.run_fnames[0]);
     run = load_run(fp, NULL, 0);
     if (run == NULL) {
         fprintf(stderr, "Error loading run file '%s'\n", spec_buf);
@@ -94,7 +94,7 @@ runerr_t * init_runerr(struct common * c, char ** run_fnames, unsigned num_run_f
 
     if (c->signif_log_fp) {
         runerr_log_significance(runerr, c->signif_log_fp,
-          c->signif_fn, NULL /* no data for signif function */,
+          c->signif_fn, c->signif_fn_data,
           c->signif_mode, DEFAULT_SIGNIFICANCE_P_THRESHOLD,
           c->signif_log_interval, c->signif_proportion);
     }
@@ -172,6 +172,11 @@ void common_init(struct common * c) {
     c->signif_log_fp = NULL;
     c->lacking_log_fp = NULL;
     c->signif_fn = DEFAULT_SIGNIFICANCE_FUNCTION;
+    c->signif_fn_data = NULL;
+    randomization_opts_init(&c->randomization_opts);
+    /* significance is logged at this threshold, so stop trials
+     * once the p-value is clearly either side of it */
+    c->randomization_opts.p_threshold = DEFAULT_SIGNIFICANCE_P_THRESHOLD;
     c->signif_log_interval = DEFAULT_SIGNIFICANCE_LOG_INTERVAL;
     c->signif_mode = DEFAULT_SIGNIFICANCE_MODE;
     c->signif_proportion = DEFAULT_SIGNIFICANCE_PROPORTION;
@@ -244,6 +249,7 @@ int common_process_option(struct common * c, int optflag, char * optarg) {
         }
         return 1;
     case 'P':
+        c->signif_fn_data = NULL;
         if (strcasecmp(optarg, "wilcoxon") == 0) {
             c->signif_fn = paired_wilcoxon_test_p;
         } else if (strcasecmp(optarg, "sign") == 0) {
@@ -252,6 +258,9 @@ int common_process_option(struct common * c, int optflag, char * optarg) {
             c->signif_fn = paired_t_test_p;
         } else if (strcasecmp(optarg, "bootstrap") == 0) {
             c->signif_fn = paired_bootstrap_test_p;
+        } else if (strcasecmp(optarg, "randomization") == 0) {
+            c->signif_fn = paired_randomization_test_p;
+            c->signif_fn_data = &c->randomization_opts;
         } else {
             fprintf(stderr, "Unknown significance function '%s'\n", optarg);
             return -1;
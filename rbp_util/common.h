@@ -6,6 +6,7 @@
 
 #include <stdio.h>
 #include "array.h"
+#include "randomization.h"
 #include "runerr.h"
 #include "strid.h"
 
@@ -40,6 +41,8 @@ struct common {
     FILE * signif_log_fp;
     FILE * lacking_log_fp;
     paired_test_p_fn_t signif_fn;
+    void * signif_fn_data;
+    randomization_opts_t randomization_opts;
     unsigned signif_log_interval;
     enum signif_mode_t signif_mode;
     double signif_proportion;
@@ -0,0 +1,72 @@
+/*
+ * Convert a qrels file into a qrels image.
+ *
+ * Usage: qrelsconv <qrels> <qrels-image>
+ *
+ * The image can be given in place of the text qrels to rbp_eval,
+ * dcg_eval, and the other rbp_util tools, which recognise it by its
+ * magic number.  It is mapped into memory and used as it stands, so
+ * even very large qrels load at once.  By convention, qrels images
+ * have the suffix ".rbpqrels".
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "qrels.h"
+
+#define USAGE "%s <qrels> <qrels-image>\n"
+
+#define ERR_BUF_LEN 1024
+
+int main(int argc, char ** argv) {
+    char * qrels_fname;
+    char * img_fname;
+    FILE * qrels_fp;
+    FILE * img_fp;
+    qrels_t * qrels;
+    char err_buf[ERR_BUF_LEN];
+    int ret;
+
+    if (argc != 3) {
+        fprintf(stderr, USAGE, argv[0]);
+        exit(1);
+    }
+    qrels_fname = argv[1];
+    img_fname = argv[2];
+
+    qrels_fp = fopen(qrels_fname, "r");
+    if (qrels_fp == NULL) {
+        fprintf(stderr, "Unable to open qrels file '%s' for reading: %s\n",
+          qrels_fname, strerror(errno));
+        exit(1);
+    }
+    qrels = load_qrels(qrels_fp, err_buf, ERR_BUF_LEN);
+    fclose(qrels_fp);
+    if (qrels == NULL) {
+        fprintf(stderr, "Error loading qrels file '%s': %s\n", qrels_fname,
+          err_buf);
+        exit(1);
+    }
+
+    img_fp = fopen(img_fname, "w");
+    if (img_fp == NULL) {
+        fprintf(stderr, "Unable to open output file '%s' for writing: %s\n",
+          img_fname, strerror(errno));
+        qrels_delete(&qrels);
+        exit(1);
+    }
+    ret = qrels_write_image(qrels, img_fp, err_buf, ERR_BUF_LEN);
+    if (fclose(img_fp) != 0 && ret == 0) {
+        snprintf(err_buf, ERR_BUF_LEN, "error writing qrels image: %s",
+          strerror(errno));
+        ret = -1;
+    }
+    qrels_delete(&qrels);
+    if (ret < 0) {
+        fprintf(stderr, "Error writing '%s': %s\n", img_fname, err_buf);
+        remove(img_fname);
+        exit(1);
+    }
+    return 0;
+}
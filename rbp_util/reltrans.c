@@ -26,16 +26,15 @@
 
 #define ERR_BUF_LEN 1024
 
-static int trans_query(FILE * fp, qdocs_t * qdocs, qid_qrels_t * qid_qrels) {
+static int trans_query(FILE * fp, qdocs_t * qdocs, qrels_t * qrels) {
     unsigned num_scores;
     unsigned s;
-    doc_score_t * scores;
+    const rel_t * rels;
 
     num_scores = qdocs_num_scores(qdocs);
-    scores = qdocs_get_scores(qdocs, QDOCS_DEFAULT_ORDERING);
+    rels = qdocs_get_rels(qdocs, qrels, QDOCS_DEFAULT_ORDERING);
     for (s = 0; s < num_scores; s++) {
-        rel_t rel;
-        rel = qid_qrels_get_rel(qid_qrels, scores[s].docid);
+        rel_t rel = rels[s];
         if (rel < 0.0) {
             fprintf(fp, "NA\n");
         } else {
@@ -60,15 +59,13 @@ static int trans_run(char * output_dir, qrels_t * qrels, run_t * run) {
     num_qdocs = run_num_qdocs(run);
     for (q = 0; q < num_qdocs; q++) {
         qdocs_t * qdocs;
-        qid_qrels_t * qid_qrels;
         char * qid;
         FILE * fp;
         int trans_ret;
         
         qdocs = run_get_qdocs_by_index(run, q);
         qid = qdocs_qid(qdocs);
-        qid_qrels = qrels_get_qid_qrels(qrels, qid);
-        if (qid_qrels == NULL) {
+        if (qrels_get_qid_qrels(qrels, qid) == NULL) {
             warning("unjudged qid '%s' in run '%s'", qid, run_get_runid(run));
             continue;
         }
@@ -79,7 +76,7 @@ static int trans_run(char * output_dir, qrels_t * qrels, run_t * run) {
               fname_buf, strerror(errno));
             return -1;
         }
-        trans_ret = trans_query(fp, qdocs, qid_qrels);
+        trans_ret = trans_query(fp, qdocs, qrels);
         fclose(fp);
         if (trans_ret < 0) {
             return -1;
@@ -0,0 +1,71 @@
+/*
+ * Convert a run file into binary form.
+ *
+ * Usage: runconv <run> <binary-run>
+ *
+ * The binary run can be given in place of the text run to rbp_eval,
+ * dcg_eval, and the other rbp_util tools, which recognise it by its
+ * magic number.  It loads much faster than the text run parses.  By
+ * convention, binary runs have the suffix ".rbprun".
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include "run.h"
+
+#define USAGE "%s <run> <binary-run>\n"
+
+#define ERR_BUF_LEN 1024
+
+int main(int argc, char ** argv) {
+    char * run_fname;
+    char * bin_fname;
+    FILE * run_fp;
+    FILE * bin_fp;
+    run_t * run;
+    char err_buf[ERR_BUF_LEN];
+    int ret;
+
+    if (argc != 3) {
+        fprintf(stderr, USAGE, argv[0]);
+        exit(1);
+    }
+    run_fname = argv[1];
+    bin_fname = argv[2];
+
+    run_fp = fopen(run_fname, "r");
+    if (run_fp == NULL) {
+        fprintf(stderr, "Unable to open run file '%s' for reading: %s\n",
+          run_fname, strerror(errno));
+        exit(1);
+    }
+    run = load_run(run_fp, err_buf, ERR_BUF_LEN);
+    fclose(run_fp);
+    if (run == NULL) {
+        fprintf(stderr, "Error loading run file '%s': %s\n", run_fname,
+          err_buf);
+        exit(1);
+    }
+
+    bin_fp = fopen(bin_fname, "w");
+    if (bin_fp == NULL) {
+        fprintf(stderr, "Unable to open output file '%s' for writing: %s\n",
+          bin_fname, strerror(errno));
+        run_delete(&run);
+        exit(1);
+    }
+    ret = run_write_binary(run, bin_fp, err_buf, ERR_BUF_LEN);
+    if (fclose(bin_fp) != 0 && ret == 0) {
+        snprintf(err_buf, ERR_BUF_LEN, "error writing binary run file: %s",
+          strerror(errno));
+        ret = -1;
+    }
+    run_delete(&run);
+    if (ret < 0) {
+        fprintf(stderr, "Error writing '%s': %s\n", bin_fname, err_buf);
+        remove(bin_fname);
+        exit(1);
+    }
+    return 0;
+}
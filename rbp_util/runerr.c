@@ -47,7 +47,6 @@ struct runerr {
 
     dococcur_t * dcr;
     double * rbp_wgts;
-    unsigned rbp_wgts_len;
     double persist;
     unsigned num_judged;
     strid_t * qidid;
@@ -110,6 +109,7 @@ runerr_t * new_runerr(double persist, strid_t * qidid, unsigned depth) {
     runerr->depth = depth;
     runerr->max_num_judgments = UINT_MAX;
     runerr->lacking_judgments = 0;
+    runerr->lacking_judgments_log_fp = NULL;
 
     runerr->rbp_wgts = util_malloc_or_die(sizeof(*runerr->rbp_wgts)
       * runerr->depth);
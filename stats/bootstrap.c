@@ -1,74 +1,366 @@
+#include "config.h"
 #include "bootstrap.h"
+#include "splitmix.h"
 #include "util.h"
 
 #include <stdlib.h>
-#include <unistd.h>
+#include <string.h>
 
-#define BOOTSTRAP_NUM_TRIALS 1000
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define BOOTSTRAP_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
 
-double paired_bootstrap_test_p(double * dist_x, double * dist_y,
-  unsigned dist_size, void * data) {
-    double * diff;
-    double * dist_w;
-    unsigned i;
-    double mean_diff;
-    double tot_diff = 0.0;
-    unsigned asl_count = 0;
-
-    diff = util_malloc_or_die(sizeof(*diff) * dist_size);
-    for (i = 0; i < dist_size; i++) {
-        diff[i] = dist_x[i] - dist_y[i];
-        tot_diff += diff[i];
-    }
-    mean_diff = tot_diff / dist_size;
-    dist_w = util_malloc_or_die(sizeof(*dist_w) * dist_size);
-    for (i = 0; i < dist_size; i++) {
-        dist_w[i] = diff[i] - mean_diff;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif /* __SSE2__ */
+
+struct bootstrap {
+    unsigned dist_size;
+    unsigned num_trials;
+    unsigned num_threads;
+    /* num_trials rows of dist_size counts */
+    double * counts;
+};
+
+void bootstrap_opts_init(bootstrap_opts_t * opts) {
+    opts->num_trials = BOOTSTRAP_DEFAULT_NUM_TRIALS;
+    opts->seed = BOOTSTRAP_DEFAULT_SEED;
+    opts->num_threads = 1;
+}
+
+bootstrap_t * new_bootstrap(unsigned dist_size,
+  const bootstrap_opts_t * opts) {
+    bootstrap_opts_t default_opts;
+    bootstrap_t * bs;
+    unsigned t, c;
+
+    if (opts == NULL) {
+        bootstrap_opts_init(&default_opts);
+        opts = &default_opts;
     }
+    bs = util_malloc_or_die(sizeof(*bs));
+    bs->dist_size = dist_size;
+    bs->num_trials = opts->num_trials;
+    bs->num_threads = opts->num_threads > 0 ? opts->num_threads : 1;
+    bs->counts = util_malloc_array_or_die((size_t) bs->num_trials
+      * dist_size, sizeof(*bs->counts));
+    memset(bs->counts, 0, sizeof(*bs->counts)
+      * ((size_t) bs->num_trials * dist_size));
+    for (t = 0; t < bs->num_trials; t++) {
+        double * row = bs->counts + (size_t) t * dist_size;
 
-    srandom(getpid());
-    for (i = 0; i < BOOTSTRAP_NUM_TRIALS ; i++) {
-        /* we're depending on the goodness of the random-number
-         * generator... */
-        double sample_tot = 0.0;
-        unsigned c;
         for (c = 0; c < dist_size; c++) {
-            unsigned choice = random() % dist_size;
-            sample_tot += dist_w[choice];
+            unsigned long long r = splitmix64(opts->seed,
+              (unsigned long long) t * dist_size + c);
+            /* scale the top 32 bits into [0, dist_size) */
+            unsigned choice = (unsigned) (((r >> 32) * dist_size) >> 32);
+
+            row[choice] += 1.0;
+        }
+    }
+    return bs;
+}
+
+void bootstrap_delete(bootstrap_t ** bs_p) {
+    bootstrap_t * bs = *bs_p;
+
+    free(bs->counts);
+    free(bs);
+    *bs_p = NULL;
+}
+
+/*
+ *  The dot product of A and B, of SIZE values.  The scalar code sums
+ *  in the same order as the SSE2 code, so that they agree exactly.
+ */
+static double _dot(const double * a, const double * b, unsigned size) {
+    double sum;
+    unsigned i = 0;
+#ifdef __SSE2__
+    __m128d acc0 = _mm_setzero_pd();
+    __m128d acc1 = _mm_setzero_pd();
+    double lanes[2];
+
+    for ( ; i + 4 <= size; i += 4) {
+        acc0 = _mm_add_pd(acc0, _mm_mul_pd(_mm_loadu_pd(a + i),
+              _mm_loadu_pd(b + i)));
+        acc1 = _mm_add_pd(acc1, _mm_mul_pd(_mm_loadu_pd(a + i + 2),
+              _mm_loadu_pd(b + i + 2)));
+    }
+    _mm_storeu_pd(lanes, _mm_add_pd(acc0, acc1));
+    sum = lanes[0] + lanes[1];
+#else
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+
+    for ( ; i + 4 <= size; i += 4) {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    sum = (s0 + s2) + (s1 + s3);
+#endif /* __SSE2__ */
+    for ( ; i < size; i++)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+/*
+ *  A range of trials to run against a batch of distributions.
+ */
+typedef struct {
+    bootstrap_t * bs;
+    unsigned num_dists;
+    /* num_dists rows of differences less their means */
+    double * ws;
+    double * means;
+    unsigned trial_start;
+    unsigned trial_end;
+    /* per distribution, the trials with a mean at least the actual */
+    unsigned * asl_counts;
+} bootstrap_job_t;
+
+static void * _run_trials(void * arg) {
+    bootstrap_job_t * job = arg;
+    unsigned size = job->bs->dist_size;
+    unsigned t, d;
+
+    for (t = job->trial_start; t < job->trial_end; t++) {
+        const double * row = job->bs->counts + (size_t) t * size;
+
+        for (d = 0; d < job->num_dists; d++) {
+            double sample_tot = _dot(row, job->ws + (size_t) d * size,
+              size);
+
+            /* XXX we count '>=' rather than just '>' because this
+             * gives a reasonable handling if dist_x and dist_y are
+             * identical (p = 1.0, rather than p = 0.0) */
+            if (sample_tot / size >= job->means[d]) {
+                job->asl_counts[d]++;
+            }
+        }
+    }
+    return NULL;
+}
+
+void bootstrap_test_p_batch(bootstrap_t * bs, double * dist_x,
+  double ** dists_y, unsigned num_dists, double * ps) {
+    unsigned size = bs->dist_size;
+    unsigned num_jobs = bs->num_threads;
+    bootstrap_job_t * jobs;
+    double * ws;
+    double * means;
+    unsigned * asl_counts;
+    unsigned d, i, j;
+
+    if (size == 0 || bs->num_trials == 0) {
+        /* no evidence either way */
+        for (d = 0; d < num_dists; d++)
+            ps[d] = 1.0;
+        return;
+    }
+    ws = util_malloc_array_or_die((size_t) num_dists * size, sizeof(*ws));
+    means = util_malloc_array_or_die(num_dists, sizeof(*means));
+    for (d = 0; d < num_dists; d++) {
+        double * w = ws + (size_t) d * size;
+        double tot_diff = 0.0;
+
+        for (i = 0; i < size; i++) {
+            w[i] = dist_x[i] - dists_y[d][i];
+            tot_diff += w[i];
         }
-        /* XXX we count '>=' rather than just '>' because this
-         * gives a reasonable handling if dist_x and dist_y are
-         * identical (p = 1.0, rather than p = 0.0) */
-        if (sample_tot / dist_size >= mean_diff) {
-            asl_count++;
+        means[d] = tot_diff / size;
+        for (i = 0; i < size; i++) {
+            w[i] -= means[d];
         }
     }
-    return (double) asl_count / BOOTSTRAP_NUM_TRIALS;
+
+    if (num_jobs > bs->num_trials)
+        num_jobs = bs->num_trials;
+#ifndef BOOTSTRAP_THREADS
+    num_jobs = 1;
+#endif /* BOOTSTRAP_THREADS */
+    jobs = util_malloc_or_die(sizeof(*jobs) * num_jobs);
+    asl_counts = util_malloc_array_or_die((size_t) num_jobs * num_dists,
+      sizeof(*asl_counts));
+    memset(asl_counts, 0, sizeof(*asl_counts)
+      * ((size_t) num_jobs * num_dists));
+    for (j = 0; j < num_jobs; j++) {
+        jobs[j].bs = bs;
+        jobs[j].num_dists = num_dists;
+        jobs[j].ws = ws;
+        jobs[j].means = means;
+        jobs[j].trial_start = (unsigned) ((unsigned long long) bs->num_trials
+          * j / num_jobs);
+        jobs[j].trial_end = (unsigned) ((unsigned long long) bs->num_trials
+          * (j + 1) / num_jobs);
+        jobs[j].asl_counts = asl_counts + (size_t) j * num_dists;
+    }
+#ifdef BOOTSTRAP_THREADS
+    if (num_jobs > 1) {
+        pthread_t * threads = util_malloc_or_die(sizeof(*threads)
+          * num_jobs);
+        int * started = util_malloc_or_die(sizeof(*started) * num_jobs);
+
+        /* the first range is run on this thread, and any that cannot
+         * be given a thread of their own after it */
+        for (j = 1; j < num_jobs; j++) {
+            started[j] = pthread_create(&threads[j], NULL, _run_trials,
+              &jobs[j]) == 0;
+        }
+        _run_trials(&jobs[0]);
+        for (j = 1; j < num_jobs; j++) {
+            if (started[j])
+                pthread_join(threads[j], NULL);
+            else
+                _run_trials(&jobs[j]);
+        }
+        free(threads);
+        free(started);
+    } else {
+        _run_trials(&jobs[0]);
+    }
+#else
+    _run_trials(&jobs[0]);
+#endif /* BOOTSTRAP_THREADS */
+
+    for (d = 0; d < num_dists; d++) {
+        unsigned asl_count = 0;
+
+        for (j = 0; j < num_jobs; j++)
+            asl_count += jobs[j].asl_counts[d];
+        ps[d] = (double) asl_count / bs->num_trials;
+    }
+    free(asl_counts);
+    free(jobs);
+    free(means);
+    free(ws);
+}
+
+double bootstrap_test_p(bootstrap_t * bs, double * dist_x,
+  double * dist_y) {
+    double p;
+
+    bootstrap_test_p_batch(bs, dist_x, &dist_y, 1, &p);
+    return p;
+}
+
+/*
+ *  The engines made by paired_bootstrap_test_p, one for each size and
+ *  set of options it has been called with.  An engine does not change
+ *  once made, so it is used without holding the lock; and so it is
+ *  kept for the life of the process, lest another thread be using it.
+ */
+typedef struct bootstrap_entry {
+    unsigned dist_size;
+    bootstrap_opts_t opts;
+    bootstrap_t * bs;
+    struct bootstrap_entry * next;
+} bootstrap_entry_t;
+
+static bootstrap_entry_t * engines = NULL;
+
+#ifdef BOOTSTRAP_THREADS
+static pthread_mutex_t engines_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif /* BOOTSTRAP_THREADS */
+
+static bootstrap_t * _get_engine(unsigned dist_size,
+  const bootstrap_opts_t * opts) {
+    bootstrap_entry_t * e;
+
+#ifdef BOOTSTRAP_THREADS
+    pthread_mutex_lock(&engines_lock);
+#endif /* BOOTSTRAP_THREADS */
+    for (e = engines; e != NULL; e = e->next) {
+        if (e->dist_size == dist_size
+          && e->opts.num_trials == opts->num_trials
+          && e->opts.seed == opts->seed
+          && e->opts.num_threads == opts->num_threads)
+            break;
+    }
+    if (e == NULL) {
+        e = util_malloc_or_die(sizeof(*e));
+        e->dist_size = dist_size;
+        e->opts = *opts;
+        e->bs = new_bootstrap(dist_size, opts);
+        e->next = engines;
+        engines = e;
+    }
+#ifdef BOOTSTRAP_THREADS
+    pthread_mutex_unlock(&engines_lock);
+#endif /* BOOTSTRAP_THREADS */
+    return e->bs;
+}
+
+double paired_bootstrap_test_p(double * dist_x, double * dist_y,
+  unsigned dist_size, void * data) {
+    bootstrap_opts_t default_opts;
+    bootstrap_opts_t * opts = data;
+
+    if (opts == NULL) {
+        bootstrap_opts_init(&default_opts);
+        opts = &default_opts;
+    }
+    return bootstrap_test_p(_get_engine(dist_size, opts), dist_x, dist_y);
 }
 
 #ifdef BOOTSTRAP_MAIN
 
-#define MAX_DIST_SIZE 1000
 #define LINE_BUF_SIZE 1024
+#define INIT_DIST_SIZE 1024
 
 #include <stdio.h>
+#include <unistd.h>
 
-int main(void) {
+/*
+ *  Read lines of paired values from stdin, and print the p-value.
+ *  There is no limit on the number of lines.  "-n N" sets the number
+ *  of trials, "-s S" the seed, and "-j J" the number of threads.
+ */
+int main(int argc, char ** argv) {
     char line_buf[LINE_BUF_SIZE];
-    double dist_x[MAX_DIST_SIZE];
-    double dist_y[MAX_DIST_SIZE];
+    double * dist_x = NULL;
+    double * dist_y = NULL;
+    unsigned x_sz = 0, y_sz = 0;
     unsigned d;
     double p;
+    bootstrap_opts_t opts;
+    int optflag;
+
+    bootstrap_opts_init(&opts);
+    while ( (optflag = getopt(argc, argv, "n:s:j:")) != -1) {
+        switch (optflag) {
+        case 'n':
+            opts.num_trials = atoi(optarg);
+            break;
+        case 's':
+            opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            opts.num_threads = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "USAGE: %s [-n trials] [-s seed] [-j threads] "
+              "< pairs\n", argv[0]);
+            return 1;
+        }
+    }
 
-    for (d = 0; d < MAX_DIST_SIZE && fgets(line_buf, LINE_BUF_SIZE, 
-          stdin) != NULL; d++) {
-        if (!sscanf(line_buf, "%lf %lf", &dist_x[d], &dist_y[d])) {
+    for (d = 0; fgets(line_buf, LINE_BUF_SIZE, stdin) != NULL; d++) {
+        util_ensure_array_space((void **) &dist_x, &x_sz, d,
+          sizeof(*dist_x), INIT_DIST_SIZE, 2.0);
+        util_ensure_array_space((void **) &dist_y, &y_sz, d,
+          sizeof(*dist_y), INIT_DIST_SIZE, 2.0);
+        if (sscanf(line_buf, "%lf %lf", &dist_x[d], &dist_y[d]) != 2) {
             fprintf(stderr, "Error on line %d of input\n", d + 1);
             return 1;
         }
     }
-    p = paired_bootstrap_test_p(dist_x, dist_y, d, NULL);
+    p = paired_bootstrap_test_p(dist_x, dist_y, d, &opts);
     fprintf(stdout, "%lf\n", p);
+    free(dist_x);
+    free(dist_y);
     return 0;
 }
 
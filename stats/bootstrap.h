@@ -7,8 +7,68 @@
  *  The test statistic is mean.  (I know Sakai proposes a
  *  "studentized" test statistic as giving greater accuracy, but
  *  I don't understand _why_ it gives greater accuracy...)
+ *
+ *  DATA may point to a bootstrap_opts_t; if it is NULL, the defaults
+ *  are used.  The resamples are drawn once for each size of
+ *  distribution and set of options, and are then kept (safely shared
+ *  between threads) for later calls, so that testing many pairs of
+ *  distributions, as runerr_significance does, draws them just once.
  */
 double paired_bootstrap_test_p(double * dist_x, double * dist_y,
   unsigned dist_size, void * data);
 
+/*
+ *  Options for the bootstrap test.
+ *
+ *  The resamples are drawn by a counter-based generator from SEED,
+ *  so that the same seed gives the same p-values, whatever the
+ *  number of threads.  If NUM_THREADS is more than one (and threads
+ *  are supported), the trials are spread over that many threads.
+ */
+typedef struct {
+    unsigned num_trials;
+    unsigned long long seed;
+    unsigned num_threads;
+} bootstrap_opts_t;
+
+#define BOOTSTRAP_DEFAULT_NUM_TRIALS 1000
+#define BOOTSTRAP_DEFAULT_SEED 1ULL
+
+/*
+ *  Set OPTS to the defaults.
+ */
+void bootstrap_opts_init(bootstrap_opts_t * opts);
+
+/*
+ *  A bootstrap engine, holding the resamples for distributions of a
+ *  given size.
+ */
+typedef struct bootstrap bootstrap_t;
+
+/*
+ *  Create a bootstrap engine for distributions of DIST_SIZE values,
+ *  drawing its resamples as OPTS say (or by the defaults, if OPTS is
+ *  NULL).  The resamples are held as an OPTS->num_trials by
+ *  DIST_SIZE matrix of counts, of the times each value is drawn in
+ *  each trial.
+ */
+bootstrap_t * new_bootstrap(unsigned dist_size,
+  const bootstrap_opts_t * opts);
+
+void bootstrap_delete(bootstrap_t ** bs_p);
+
+/*
+ *  Calculate the p-value that DIST_X has a higher mean than DIST_Y,
+ *  each of the size of BS.
+ */
+double bootstrap_test_p(bootstrap_t * bs, double * dist_x,
+  double * dist_y);
+
+/*
+ *  Test DIST_X against each of the NUM_DISTS distributions of
+ *  DISTS_Y, all on the same resamples, writing the p-values to PS.
+ */
+void bootstrap_test_p_batch(bootstrap_t * bs, double * dist_x,
+  double ** dists_y, unsigned num_dists, double * ps);
+
 #endif /* BOOTSTRAP_H */
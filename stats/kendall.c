@@ -1,69 +1,336 @@
+#include "kendall.h"
+#include "util.h"
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
-double kendall_tau(double * dat1, double * dat2, unsigned dat_size) {
-    unsigned i, j;
-    int concordant, discordant;
-    double tau;
+/*
+ *  A value of the reference list, and where it came from.
+ */
+typedef struct {
+    double val;
+    unsigned idx;
+} ref_val_t;
 
-    if (dat_size < 2) {
-        /* doesn't really make sense, but... */
-        return 1.0;
+/*
+ *  Numbers of pairs, counted by Knight's algorithm.  Held as doubles,
+ *  which count exactly far beyond what an unsigned could hold.
+ */
+typedef struct {
+    double pairs;       /* all pairs, n(n-1)/2 */
+    double ties_ref;    /* pairs tied in the reference list */
+    double ties_dat;    /* pairs tied in the other list */
+    double ties_both;   /* pairs tied in both lists */
+    double discordant;  /* pairs ordered differently, tied in neither */
+} pair_counts_t;
+
+/*
+ *  Working space for correlating lists of SIZE values against one
+ *  reference list.
+ */
+typedef struct {
+    unsigned size;
+    /* the reference values, sorted */
+    ref_val_t * ref;
+    double ties_ref;
+    /* the other list, in the order of the reference */
+    double * dat;
+    double * tmp;
+} kendall_work_t;
+
+static int _cmp_ref_val(const void * a, const void * b) {
+    const ref_val_t * ra = a;
+    const ref_val_t * rb = b;
+
+    if (ra->val < rb->val)
+        return -1;
+    else if (ra->val > rb->val)
+        return 1;
+    else
+        return ra->idx < rb->idx ? -1 : ra->idx > rb->idx;
+}
+
+static int _cmp_double(const void * a, const void * b) {
+    double da = *(const double *) a;
+    double db = *(const double *) b;
+
+    return da < db ? -1 : da > db;
+}
+
+/*
+ *  The number of pairs in a run of RUN tied values.
+ */
+#define RUN_PAIRS(run) ((double) (run) * ((run) - 1) / 2)
+
+/*
+ *  Count the pairs tied in sorted VALS, of which there are SIZE.
+ */
+static double _tied_pairs(const double * vals, unsigned size) {
+    double ties = 0.0;
+    unsigned i, run = 1;
+
+    for (i = 1; i < size; i++) {
+        if (vals[i] == vals[i - 1]) {
+            run++;
+        } else {
+            ties += RUN_PAIRS(run);
+            run = 1;
+        }
     }
-    concordant = discordant = 0;
-    for (i = 0; i < dat_size; i++) {
-        for (j = i + 1; j < dat_size; j++) {
-            if (dat1[i] > dat1[j]) {
-                if (dat2[i] > dat2[j]) {
-                    concordant += 1;
-                } else {
-                    discordant += 1;
-                }
-            } else if (dat1[i] < dat1[j]) {
-                if (dat2[i] < dat2[j]) {
-                    concordant += 1;
-                } else {
-                    discordant += 1;
-                }
-            } else {
-                if (dat2[i] == dat2[j]) {
-                    concordant += 1;
+    return ties + RUN_PAIRS(run);
+}
+
+/*
+ *  Sort DAT, of SIZE values, by a bottom-up merge sort, using TMP
+ *  (of the same size) as scratch space.  Returns the number of
+ *  exchanges, that is, of pairs out of order; equal values are not
+ *  out of order.
+ */
+static double _merge_sort_exchanges(double * dat, double * tmp,
+  unsigned size) {
+    double exchanges = 0.0;
+    double * in = dat;
+    double * out = tmp;
+    unsigned width, lo;
+
+    for (width = 1; width < size; width *= 2) {
+        for (lo = 0; lo < size; lo += 2 * width) {
+            unsigned mid = lo + width < size ? lo + width : size;
+            unsigned hi = mid + width < size ? mid + width : size;
+            unsigned l = lo, r = mid, o = lo;
+
+            while (l < mid && r < hi) {
+                if (in[r] < in[l]) {
+                    /* it passes over the rest of the left run */
+                    exchanges += mid - l;
+                    out[o++] = in[r++];
                 } else {
-                    discordant += 1;
+                    out[o++] = in[l++];
                 }
             }
+            while (l < mid)
+                out[o++] = in[l++];
+            while (r < hi)
+                out[o++] = in[r++];
+        }
+        /* the merged runs are the input of the next pass */
+        {
+            double * swap = in;
+
+            in = out;
+            out = swap;
+        }
+    }
+    if (in != dat)
+        memcpy(dat, in, sizeof(*dat) * size);
+    return exchanges;
+}
+
+static void _work_init(kendall_work_t * work, double * ref,
+  unsigned size) {
+    unsigned i, run = 1;
+
+    work->size = size;
+    work->ref = util_malloc_array_or_die(size, sizeof(*work->ref));
+    work->dat = util_malloc_array_or_die(size, sizeof(*work->dat));
+    work->tmp = util_malloc_array_or_die(size, sizeof(*work->tmp));
+    for (i = 0; i < size; i++) {
+        work->ref[i].val = ref[i];
+        work->ref[i].idx = i;
+    }
+    qsort(work->ref, size, sizeof(*work->ref), _cmp_ref_val);
+    work->ties_ref = 0.0;
+    for (i = 1; i < size; i++) {
+        if (work->ref[i].val == work->ref[i - 1].val) {
+            run++;
+        } else {
+            work->ties_ref += RUN_PAIRS(run);
+            run = 1;
+        }
+    }
+    work->ties_ref += RUN_PAIRS(run);
+}
+
+static void _work_cleanup(kendall_work_t * work) {
+    free(work->ref);
+    free(work->dat);
+    free(work->tmp);
+}
+
+/*
+ *  Count the pairs of DAT against the reference of WORK.
+ */
+static void _count_pairs(kendall_work_t * work, double * dat,
+  pair_counts_t * counts) {
+    unsigned size = work->size;
+    unsigned i, start;
+
+    for (i = 0; i < size; i++)
+        work->dat[i] = dat[work->ref[i].idx];
+    /* within a run of tied reference values, order by DAT, so that
+     * the merge sort counts none of them as exchanged */
+    counts->ties_both = 0.0;
+    for (start = 0; start < size; start = i) {
+        for (i = start + 1; i < size
+          && work->ref[i].val == work->ref[start].val; i++)
+            ;
+        if (i - start > 1) {
+            qsort(&work->dat[start], i - start, sizeof(*work->dat),
+              _cmp_double);
+            counts->ties_both += _tied_pairs(&work->dat[start],
+              i - start);
         }
     }
-    tau = (float) (concordant - discordant) / ((dat_size * (dat_size - 1) / 2));
-    assert(tau <= 1.0);
-    assert(tau >= -1.0);
+    counts->pairs = RUN_PAIRS(size);
+    counts->ties_ref = work->ties_ref;
+    counts->discordant = _merge_sort_exchanges(work->dat, work->tmp, size);
+    counts->ties_dat = _tied_pairs(work->dat, size);
+}
+
+static double _tau(pair_counts_t * counts,
+  enum kendall_variant_t variant) {
+    /* concordant less discordant, amongst the pairs tied in neither
+     * list */
+    double s = counts->pairs - counts->ties_ref - counts->ties_dat
+        + counts->ties_both - 2 * counts->discordant;
+    double tau;
+
+    if (counts->pairs == 0) {
+        /* doesn't really make sense, but... */
+        return 1.0;
+    }
+    if (variant == KENDALL_TAU_B) {
+        double denom = sqrt((counts->pairs - counts->ties_ref)
+          * (counts->pairs - counts->ties_dat));
+
+        if (denom == 0)
+            return 0.0;
+        tau = s / denom;
+    } else {
+        /* the pairs tied in both are concordant, those tied in just
+         * one discordant */
+        tau = (s + counts->ties_both
+          - (counts->ties_ref - counts->ties_both)
+          - (counts->ties_dat - counts->ties_both)) / counts->pairs;
+    }
+    assert(tau <= 1.0 + 1e-9);
+    assert(tau >= -1.0 - 1e-9);
+    return tau;
+}
+
+void kendall_tau_batch(double * ref, double ** dats, unsigned num_dats,
+  unsigned dat_size, enum kendall_variant_t variant, double * taus) {
+    kendall_work_t work;
+    pair_counts_t counts;
+    unsigned d;
+
+    _work_init(&work, ref, dat_size);
+    for (d = 0; d < num_dats; d++) {
+        _count_pairs(&work, dats[d], &counts);
+        taus[d] = _tau(&counts, variant);
+    }
+    _work_cleanup(&work);
+}
+
+double kendall_tau(double * dat1, double * dat2, unsigned dat_size) {
+    double tau;
+
+    kendall_tau_batch(dat1, &dat2, 1, dat_size, KENDALL_TAU, &tau);
+    return tau;
+}
+
+double kendall_tau_b(double * dat1, double * dat2, unsigned dat_size) {
+    double tau;
+
+    kendall_tau_batch(dat1, &dat2, 1, dat_size, KENDALL_TAU_B, &tau);
     return tau;
 }
 
 #ifdef KENDALL_MAIN
 
-#include <stdio.h>
-#include <stdlib.h>
+#include <unistd.h>
 
-#define MAX_DIST_SIZE 1000
-#define LINE_BUF_SIZE 1024
+#define LINE_BUF_SIZE 65536
+#define INIT_ROWS 1024
 
-int main(void) {
+/*
+ *  Read lines of two or more columns of values from stdin, and print
+ *  the tau of each column after the first against the first.  There
+ *  is no limit on the number of lines.
+ */
+int main(int argc, char ** argv) {
     char line_buf[LINE_BUF_SIZE];
-    double dat1[MAX_DIST_SIZE];
-    double dat2[MAX_DIST_SIZE];
-    unsigned d;
-    double tau;
+    double * rows = NULL;
+    unsigned rows_sz = 0;
+    unsigned num_vals = 0;
+    unsigned num_cols = 0;
+    unsigned num_rows;
+    double ** cols;
+    double * taus;
+    enum kendall_variant_t variant = KENDALL_TAU;
+    unsigned line, c, r;
+    int optflag;
 
-    for (d = 0; d < MAX_DIST_SIZE && fgets(line_buf, LINE_BUF_SIZE, 
-          stdin) != NULL; d++) {
-        if (!sscanf(line_buf, "%lf %lf", &dat1[d], &dat2[d])) {
-            fprintf(stderr, "Error on line %d of input\n", d + 1);
+    while ( (optflag = getopt(argc, argv, "b")) != -1) {
+        switch (optflag) {
+        case 'b':
+            variant = KENDALL_TAU_B;
+            break;
+        default:
+            fprintf(stderr, "USAGE: %s [-b] < columns\n", argv[0]);
             return 1;
         }
     }
-    tau = kendall_tau(dat1, dat2, d);
-    fprintf(stdout, "%lf\n", tau);
+
+    for (line = 1; fgets(line_buf, LINE_BUF_SIZE, stdin) != NULL; line++) {
+        char * p = line_buf;
+        char * end;
+        unsigned line_cols = 0;
+        double val;
+
+        for (;;) {
+            val = strtod(p, &end);
+            if (end == p)
+                break;
+            util_ensure_array_space((void **) &rows, &rows_sz, num_vals,
+              sizeof(*rows), INIT_ROWS, 2.0);
+            rows[num_vals++] = val;
+            line_cols++;
+            p = end;
+        }
+        if (line_cols < 2 || (num_cols != 0 && line_cols != num_cols)) {
+            fprintf(stderr, "Error on line %u of input\n", line);
+            return 1;
+        }
+        num_cols = line_cols;
+    }
+    if (num_cols == 0) {
+        /* no input; as for a single value */
+        fprintf(stdout, "%lf\n", 1.0);
+        return 0;
+    }
+
+    num_rows = num_vals / num_cols;
+    cols = util_malloc_or_die(sizeof(*cols) * num_cols);
+    for (c = 0; c < num_cols; c++) {
+        cols[c] = util_malloc_or_die(sizeof(*cols[c]) * num_rows);
+        for (r = 0; r < num_rows; r++)
+            cols[c][r] = rows[r * num_cols + c];
+    }
+    taus = util_malloc_or_die(sizeof(*taus) * num_cols);
+    kendall_tau_batch(cols[0], cols + 1, num_cols - 1, num_rows, variant,
+      taus);
+    for (c = 0; c < num_cols - 1; c++)
+        fprintf(stdout, c > 0 ? " %lf" : "%lf", taus[c]);
+    fprintf(stdout, "\n");
+
+    for (c = 0; c < num_cols; c++)
+        free(cols[c]);
+    free(cols);
+    free(taus);
+    free(rows);
     return 0;
 }
 
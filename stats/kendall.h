@@ -1,12 +1,46 @@
 #ifndef KENDALL_H
 #define KENDALL_H
 
+/*
+ *  Kendall's tau rank correlation between lists.
+ *
+ *  All variants are calculated in O(n log n) time by Knight's
+ *  algorithm: sort the pairs by the first list (breaking ties by the
+ *  second), then count the discordant pairs as the exchanges a merge
+ *  sort of the second list makes.  See Knight, ``A computer method
+ *  for calculating Kendall's tau with ungrouped data'', JASA (1966).
+ */
+
+enum kendall_variant_t {
+    /* ties are not adjusted for: a pair tied in both lists counts as
+     * concordant, and one tied in only one list as discordant, over
+     * all n(n-1)/2 pairs.  This is what kendall_tau calculates. */
+    KENDALL_TAU,
+    /* tau-b, which adjusts for ties in either list */
+    KENDALL_TAU_B
+};
+
 /*
  *  Calculate Kendall's tau rank correlation between two lists.
  *
- *  Note that we do NOT adjust for ties (i.e. this is Kendall's
- *  tau-a, not tau-b or tau-c).
+ *  Note that we do NOT adjust for ties (see KENDALL_TAU above).
  */
 double kendall_tau(double * dat1, double * dat2, unsigned dat_size);
 
+/*
+ *  Calculate Kendall's tau-b rank correlation between two lists,
+ *  which adjusts for ties.  If either list is all ties, tau-b is
+ *  undefined, and 0 is returned.
+ */
+double kendall_tau_b(double * dat1, double * dat2, unsigned dat_size);
+
+/*
+ *  Correlate each of the NUM_DATS lists DATS against the reference
+ *  list REF, all of DAT_SIZE values, writing the tau of each into
+ *  TAUS.  REF is sorted only once, and working space allocated only
+ *  once, for the whole batch.
+ */
+void kendall_tau_batch(double * ref, double ** dats, unsigned num_dats,
+  unsigned dat_size, enum kendall_variant_t variant, double * taus);
+
 #endif /* KENDALL_H */
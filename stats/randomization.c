@@ -0,0 +1,208 @@
+#include "randomization.h"
+#include "splitmix.h"
+#include "util.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+void randomization_opts_init(randomization_opts_t * opts) {
+    opts->num_trials = RANDOMIZATION_DEFAULT_NUM_TRIALS;
+    opts->seed = RANDOMIZATION_DEFAULT_SEED;
+    opts->p_threshold = 0.0;
+}
+
+/*
+ *  Flipping the signs of some differences gives a sum at least that
+ *  observed if and only if the flipped differences sum to at most 0.
+ *  Each assignment of signs is a bit mask, a set bit flipping a
+ *  difference.  The differences are taken in blocks of 8, and for
+ *  each block the sums of all 256 subsets are tabulated, so that the
+ *  flipped sum of a mask is found by one lookup per byte.
+ */
+typedef struct {
+    unsigned num_blocks;
+    double * sums;  /* num_blocks rows of 256 */
+    /* sums at most this are taken as 0, allowing for rounding */
+    double tolerance;
+} flip_sums_t;
+
+static void _flip_sums_init(flip_sums_t * fs, const double * diff,
+  unsigned size) {
+    unsigned b, m;
+    double tot_abs = 0.0;
+
+    fs->num_blocks = (size + 7) / 8;
+    fs->sums = util_malloc_or_die(sizeof(*fs->sums) * 256
+      * fs->num_blocks);
+    for (b = 0; b < fs->num_blocks; b++) {
+        double * row = fs->sums + 256 * b;
+
+        row[0] = 0.0;
+        for (m = 1; m < 256; m++) {
+            /* the sum without the lowest bit, plus that bit */
+            unsigned low = 0;
+            double d;
+
+            while (!(m & (1 << low)))
+                low++;
+            d = b * 8 + low < size ? diff[b * 8 + low] : 0.0;
+            row[m] = row[m & (m - 1)] + d;
+        }
+    }
+    for (m = 0; m < size; m++)
+        tot_abs += fabs(diff[m]);
+    fs->tolerance = tot_abs * 1e-12;
+}
+
+static int _flip_extreme(const flip_sums_t * fs,
+  const unsigned long long * mask) {
+    double sum = 0.0;
+    unsigned b;
+
+    for (b = 0; b < fs->num_blocks; b++) {
+        unsigned byte = (unsigned) (mask[b / 8] >> (8 * (b % 8))) & 0xff;
+
+        sum += fs->sums[256 * b + byte];
+    }
+    return sum <= fs->tolerance;
+}
+
+/*
+ *  Whether, after EXTREME of TRIALS trials, the p-value is clearly
+ *  above or below P_THRESHOLD, by the Wilson score interval.
+ */
+static int _decided(unsigned extreme, unsigned trials,
+  double p_threshold) {
+    double z = RANDOMIZATION_STOP_Z;
+    double n = trials;
+    double p = extreme / n;
+    double centre = (p + z * z / (2 * n)) / (1 + z * z / n);
+    double half = z / (1 + z * z / n)
+        * sqrt(p * (1 - p) / n + z * z / (4 * n * n));
+
+    return p_threshold < centre - half || p_threshold > centre + half;
+}
+
+double paired_randomization_test_p(double * dist_x, double * dist_y,
+  unsigned dist_size, void * data) {
+    randomization_opts_t default_opts;
+    randomization_opts_t * opts = data;
+    double * diff = util_malloc_array_or_die(dist_size, sizeof(*diff));
+    unsigned diff_size = 0;
+    unsigned num_words;
+    unsigned long long * mask;
+    flip_sums_t fs;
+    unsigned extreme = 0;
+    unsigned trials = 0;
+    unsigned i;
+
+    if (opts == NULL) {
+        randomization_opts_init(&default_opts);
+        opts = &default_opts;
+    }
+    /* a zero difference is the same whatever its sign */
+    for (i = 0; i < dist_size; i++) {
+        if (dist_x[i] != dist_y[i])
+            diff[diff_size++] = dist_x[i] - dist_y[i];
+    }
+    if (diff_size == 0 || opts->num_trials == 0) {
+        free(diff);
+        return 1.0;
+    }
+    _flip_sums_init(&fs, diff, diff_size);
+    num_words = (diff_size + 63) / 64;
+    mask = util_malloc_or_die(sizeof(*mask) * num_words);
+
+    if (diff_size < 64
+      && (1ULL << diff_size) <= (unsigned long long) opts->num_trials) {
+        /* exactly, over every assignment */
+        unsigned long long m;
+
+        for (m = 0; m < (1ULL << diff_size); m++) {
+            mask[0] = m;
+            extreme += _flip_extreme(&fs, mask);
+        }
+        trials = (unsigned) (1ULL << diff_size);
+    } else {
+        while (trials < opts->num_trials) {
+            unsigned w;
+
+            for (w = 0; w < num_words; w++) {
+                mask[w] = splitmix64(opts->seed,
+                  (unsigned long long) trials * num_words + w);
+            }
+            extreme += _flip_extreme(&fs, mask);
+            trials++;
+            if (opts->p_threshold > 0.0
+              && trials % RANDOMIZATION_STOP_INTERVAL == 0
+              && _decided(extreme, trials, opts->p_threshold))
+                break;
+        }
+    }
+    free(mask);
+    free(fs.sums);
+    free(diff);
+    return (double) extreme / trials;
+}
+
+#ifdef RANDOMIZATION_MAIN
+
+#define LINE_BUF_SIZE 1024
+#define INIT_DIST_SIZE 1024
+
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ *  Read lines of paired values from stdin, and print the p-value.
+ *  There is no limit on the number of lines.  "-n N" sets the most
+ *  trials, "-s S" the seed, and "-a A" a threshold to stop early
+ *  around.
+ */
+int main(int argc, char ** argv) {
+    char line_buf[LINE_BUF_SIZE];
+    double * dist_x = NULL;
+    double * dist_y = NULL;
+    unsigned x_sz = 0, y_sz = 0;
+    unsigned d;
+    double p;
+    randomization_opts_t opts;
+    int optflag;
+
+    randomization_opts_init(&opts);
+    while ( (optflag = getopt(argc, argv, "n:s:a:")) != -1) {
+        switch (optflag) {
+        case 'n':
+            opts.num_trials = atoi(optarg);
+            break;
+        case 's':
+            opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'a':
+            opts.p_threshold = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "USAGE: %s [-n trials] [-s seed] "
+              "[-a threshold] < pairs\n", argv[0]);
+            return 1;
+        }
+    }
+
+    for (d = 0; fgets(line_buf, LINE_BUF_SIZE, stdin) != NULL; d++) {
+        util_ensure_array_space((void **) &dist_x, &x_sz, d,
+          sizeof(*dist_x), INIT_DIST_SIZE, 2.0);
+        util_ensure_array_space((void **) &dist_y, &y_sz, d,
+          sizeof(*dist_y), INIT_DIST_SIZE, 2.0);
+        if (sscanf(line_buf, "%lf %lf", &dist_x[d], &dist_y[d]) != 2) {
+            fprintf(stderr, "Error on line %d of input\n", d + 1);
+            return 1;
+        }
+    }
+    p = paired_randomization_test_p(dist_x, dist_y, d, &opts);
+    fprintf(stdout, "%lf\n", p);
+    free(dist_x);
+    free(dist_y);
+    return 0;
+}
+
+#endif /* RANDOMIZATION_MAIN */
@@ -0,0 +1,52 @@
+#ifndef RANDOMIZATION_H
+#define RANDOMIZATION_H
+
+/*
+ *  Calculate p-value for a paired, one-tailed randomization test.
+ *
+ *  Under the null hypothesis, the sign of each difference x_i - y_i
+ *  is as likely to be positive as negative.  The p-value is the
+ *  proportion of the assignments of signs to the differences that
+ *  give a sum at least that observed.  (This is Fisher's
+ *  randomization, or permutation, test, as recommended for IR by
+ *  Smucker, Allan and Carterette, CIKM 2007.)
+ *
+ *  If there are few enough non-zero differences, every assignment is
+ *  tried, and the p-value is exact; otherwise, it is estimated from
+ *  random assignments.  DATA may point to a randomization_opts_t; if
+ *  it is NULL, the defaults are used.
+ */
+double paired_randomization_test_p(double * dist_x, double * dist_y,
+  unsigned dist_size, void * data);
+
+/*
+ *  Options for the randomization test.
+ *
+ *  At most NUM_TRIALS random assignments are tried, drawn from SEED,
+ *  so that the same seed gives the same p-values.  If P_THRESHOLD is
+ *  more than 0, the trials stop early once the p-value is clearly
+ *  above or below it, that is, once P_THRESHOLD falls outside the
+ *  RANDOMIZATION_STOP_Z confidence interval of the estimate; the
+ *  p-value returned then is only good for comparing with the
+ *  threshold.
+ */
+typedef struct {
+    unsigned num_trials;
+    unsigned long long seed;
+    double p_threshold;
+} randomization_opts_t;
+
+#define RANDOMIZATION_DEFAULT_NUM_TRIALS 10000
+#define RANDOMIZATION_DEFAULT_SEED 1ULL
+
+/* the z score of the interval for stopping early (99.9%, two-sided),
+ * and how many trials there are between checks */
+#define RANDOMIZATION_STOP_Z 3.29
+#define RANDOMIZATION_STOP_INTERVAL 100
+
+/*
+ *  Set OPTS to the defaults, which do not stop early.
+ */
+void randomization_opts_init(randomization_opts_t * opts);
+
+#endif /* RANDOMIZATION_H */
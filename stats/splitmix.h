@@ -0,0 +1,18 @@
+#ifndef SPLITMIX_H
+#define SPLITMIX_H
+
+/*
+ *  The SplitMix64 generator, as a function of its counter, so that
+ *  any draw can be made independently of the others.  The same SEED
+ *  and COUNTER always give the same value, whatever thread draws it.
+ */
+static inline unsigned long long splitmix64(unsigned long long seed,
+  unsigned long long counter) {
+    unsigned long long z = seed + (counter + 1) * 0x9e3779b97f4a7c15ULL;
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+#endif /* SPLITMIX_H */
@@ -11,10 +11,46 @@ double paired_t_test(double * dist_x, double * dist_y, unsigned dist_size);
 /*
  *  Determine significane of one-tailed, paired T-test.
  *
- *  The function does not return the exact p value, but the value
- *  from the lookup-table that the calculate t value exceeds.
+ *  The function returns the exact p value, the probability of a t at
+ *  least that calculated for DIST_SIZE - 1 degrees of freedom.  With
+ *  fewer than two values, or no differences, it is 1.0.
  */
 double paired_t_test_p(double * dist_x, double * dist_y, unsigned dist_size,
   void * data);
 
+/*
+ *  The CDF of Student's t distribution with DF degrees of freedom,
+ *  P(T <= t), by the regularised incomplete beta function.
+ */
+double t_cdf(double t, double df);
+
+/*
+ *  The sum and sum of squares of a run's scores.
+ */
+typedef struct {
+    double sum;
+    double sum_sq;
+} t_sums_t;
+
+/*
+ *  Calculate the sums of each of the NUM_RUNS rows of NUM_QIDS
+ *  scores in SCORES, into SUMS.
+ */
+void t_run_sums(const double * scores, unsigned num_runs,
+  unsigned num_qids, t_sums_t * sums);
+
+/*
+ *  Run the paired t-test between every pair of the NUM_RUNS rows of
+ *  NUM_QIDS scores in SCORES, whose sums (from t_run_sums) are SUMS.
+ *  The p-value that run a has the higher mean than run b is written
+ *  to PS[a * NUM_RUNS + b], which must have space for NUM_RUNS^2
+ *  values; the diagonal is 1.0.
+ *
+ *  Nothing is allocated.  The variance of the differences of a pair
+ *  comes from the runs' sums, sums of squares and the dot product of
+ *  their scores, so each pair takes a single pass over the topics.
+ */
+void paired_t_test_p_matrix(const double * scores, const t_sums_t * sums,
+  unsigned num_runs, unsigned num_qids, double * ps);
+
 #endif /* T_H */
@@ -13,11 +13,17 @@
  *  $c$ is therefore the count of concordant elements.  The
  *  complexity of the algorithm is $n$ * the complexity of
  *  lines 5. and 6.  Using a binary tree for T makes these
- *  operations O(log n)
+ *  operations O(log n), but only if it stays balanced, which
+ *  CtBNode does not on sorted input.  tau_ap therefore uses a
+ *  RankCounter for T, which is O(log n) for any input; and
+ *  rather than summing $c$, it divides each step's count by the
+ *  number of elements above $s$, as tau_ap weights them.
  */
 
 #include "tau_ap.h"
 
+#include <algorithm>
+
 using namespace rbp;
 
 void CtBNode::add_descendant(int val) {
@@ -43,3 +49,68 @@ CtBNode::~CtBNode() {
     if (right_ != NULL)
         delete(right_);
 }
+
+/*
+ *  Orders positions in a score array by descending score, ties by
+ *  position.
+ */
+class ByScoreDesc {
+    private:
+        const double * scores_;
+
+    public:
+        ByScoreDesc(const double * scores) : scores_(scores) { }
+        bool operator()(unsigned a, unsigned b) const {
+            if (scores_[a] != scores_[b])
+                return scores_[a] > scores_[b];
+            return a < b;
+        }
+};
+
+/*
+ *  Rank the positions of $scores$, of $size$, into $order$.
+ */
+static void rank_by_score(const double * scores, unsigned size,
+  std::vector<unsigned> &order) {
+    order.resize(size);
+    for (unsigned i = 0; i < size; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), ByScoreDesc(scores));
+}
+
+void rbp::tau_ap_batch(const double * ref, const double * const * dats,
+  unsigned num_dats, unsigned size, double * taus) {
+    std::vector<unsigned> order;
+    std::vector<unsigned> ref_rank(size);
+    RankCounter above(size);
+
+    rank_by_score(ref, size, order);
+    for (unsigned r = 0; r < size; r++)
+        ref_rank[order[r]] = r;
+    for (unsigned d = 0; d < num_dats; d++) {
+        double sum = 0.0;
+
+        if (size < 2) {
+            taus[d] = 1.0;
+            continue;
+        }
+        rank_by_score(dats[d], size, order);
+        above.clear();
+        above.add(ref_rank[order[0]]);
+        for (unsigned i = 1; i < size; i++) {
+            unsigned rank = ref_rank[order[i]];
+
+            /* the proportion of those above that are rightly so */
+            sum += (double) above.count_below(rank) / i;
+            above.add(rank);
+        }
+        taus[d] = 2.0 * sum / (size - 1) - 1.0;
+    }
+}
+
+double rbp::tau_ap(const double * ref, const double * dat, unsigned size) {
+    double tau;
+
+    tau_ap_batch(ref, &dat, 1, size, &tau);
+    return tau;
+}
@@ -6,6 +6,7 @@
 #define TAU_AP_H
 
 #include <cstddef> /* for NULL */
+#include <vector>
 
 namespace rbp {
 
@@ -23,6 +24,60 @@ class CtBNode {
         int get_st_count() const { return st_count_; }
 };
 
+/*
+ *  Counts of the ranks 0 to size - 1 added so far, as a binary
+ *  indexed (Fenwick) tree, so that adding a rank, and counting those
+ *  below a rank, each take O(log n) time whatever the order of the
+ *  ranks.  Unlike CtBNode, the tree is a single array, allocated
+ *  once, and reusable after clear().
+ */
+class RankCounter {
+    private:
+        std::vector<unsigned> tree_;
+
+    public:
+        RankCounter(unsigned size) : tree_(size + 1, 0) { }
+        void add(unsigned rank) {
+            for (rank++; rank < tree_.size(); rank += rank & -rank)
+                tree_[rank]++;
+        }
+        /* the number of ranks added that are less than $rank$ */
+        unsigned count_below(unsigned rank) const {
+            unsigned count = 0;
+
+            for (; rank > 0; rank -= rank & -rank)
+                count += tree_[rank];
+            return count;
+        }
+        void clear() { tree_.assign(tree_.size(), 0); }
+};
+
+/*
+ *  Calculate the AP correlation coefficient, tau_ap, of Yilmaz,
+ *  Aslam and Robertson, ``A new rank correlation coefficient for
+ *  information retrieval'', SIGIR (2008).
+ *
+ *  $ref$ and $dat$ give the scores of the same $size$ items (for
+ *  instance, systems) by the reference measure and by the compared
+ *  one; each ranks the items by descending score.  Ties are broken
+ *  by position in the arrays, earlier first.  tau_ap is not
+ *  symmetric: it weights errors by their depth in the ranking by
+ *  $dat$, with errors at the top costing most.  It ranges from -1
+ *  (reversed) to 1 (identical); fewer than two items give 1.
+ *
+ *  Calculated in O(n log n) time, with a RankCounter.
+ */
+double tau_ap(const double * ref, const double * dat, unsigned size);
+
+/*
+ *  Calculate tau_ap of each of the $num_dats$ score lists $dats$
+ *  against the reference $ref$, all of $size$ items, writing them
+ *  into $taus$.  The reference is ranked, and working space
+ *  allocated, only once for the whole batch.
+ */
+void tau_ap_batch(const double * ref, const double * const * dats,
+  unsigned num_dats, unsigned size, double * taus);
+
 };
 
 #endif /* TAU_AP_H */
@@ -0,0 +1,91 @@
+extern "C" {
+#include "bootstrap.h"
+}
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <stdlib.h>
+
+/* random pairs of N values, X being higher by SHIFT on average */
+static void random_pairs(unsigned n, double shift, std::vector<double> &x,
+  std::vector<double> &y) {
+    x.resize(n);
+    y.resize(n);
+    for (unsigned i = 0; i < n; i++) {
+        y[i] = random() % 1000 / 1000.0;
+        x[i] = y[i] + shift + (random() % 1000 - 500) / 1000.0;
+    }
+}
+
+int main(void) {
+    static const unsigned thread_counts[] = { 1, 2, 3, 4, 7, 16 };
+    const unsigned num_counts = sizeof(thread_counts)
+        / sizeof(thread_counts[0]);
+    const unsigned num_dists = 6;
+    const unsigned size = 50;
+    std::vector<double> x, y;
+    std::vector<std::vector<double> > ys(num_dists);
+    std::vector<double *> y_ptrs;
+    std::vector<double> ps(num_dists), batch_ps(num_dists);
+    bootstrap_opts_t opts;
+    bootstrap_t * bs;
+
+    srandom(1);
+    random_pairs(size, 0.0, x, y);
+    for (unsigned d = 0; d < num_dists; d++) {
+        /* from much better than x to much worse */
+        random_pairs(size, (d - 2.5) / 10.0, ys[d], y);
+        for (unsigned i = 0; i < size; i++)
+            ys[d][i] = x[i] - (ys[d][i] - y[i]);
+        y_ptrs.push_back(&ys[d][0]);
+    }
+
+    /* the same seed gives the same p-values, for any number of
+     * threads, by single calls or by the batch */
+    bootstrap_opts_init(&opts);
+    opts.num_trials = 2001;
+    opts.seed = 42;
+    bs = new_bootstrap(size, &opts);
+    for (unsigned d = 0; d < num_dists; d++)
+        ps[d] = bootstrap_test_p(bs, &x[0], y_ptrs[d]);
+    bootstrap_delete(&bs);
+    for (unsigned c = 0; c < num_counts; c++) {
+        opts.num_threads = thread_counts[c];
+        bs = new_bootstrap(size, &opts);
+        bootstrap_test_p_batch(bs, &x[0], &y_ptrs[0], num_dists,
+          &batch_ps[0]);
+        for (unsigned d = 0; d < num_dists; d++) {
+            assert(batch_ps[d] == ps[d]);
+            assert(bootstrap_test_p(bs, &x[0], y_ptrs[d]) == ps[d]);
+            assert(paired_bootstrap_test_p(&x[0], y_ptrs[d], size, &opts)
+              == ps[d]);
+        }
+        bootstrap_delete(&bs);
+    }
+    for (unsigned d = 0; d < num_dists; d++)
+        std::cout << "shift " << (d - 2.5) / 10.0 << ": p " << ps[d]
+            << std::endl;
+
+    /* x is clearly better than the last, and worse than the first */
+    assert(ps[0] > 0.99);
+    assert(ps[num_dists - 1] < 0.01);
+
+    /* another seed draws other resamples */
+    bool differs = false;
+    opts.num_threads = 1;
+    opts.seed = 43;
+    for (unsigned d = 0; d < num_dists; d++) {
+        if (paired_bootstrap_test_p(&x[0], y_ptrs[d], size, &opts)
+          != ps[d])
+            differs = true;
+    }
+    assert(differs);
+
+    /* identical distributions, no trials, and no values */
+    assert(paired_bootstrap_test_p(&x[0], &x[0], size, NULL) == 1.0);
+    opts.num_trials = 0;
+    assert(paired_bootstrap_test_p(&x[0], y_ptrs[0], size, &opts) == 1.0);
+    assert(paired_bootstrap_test_p(&x[0], y_ptrs[0], 0, NULL) == 1.0);
+    return 0;
+}
@@ -0,0 +1,112 @@
+extern "C" {
+#include "randomization.h"
+}
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <stdlib.h>
+
+/* the p-value of the differences DIFF by enumerating every assignment
+ * of signs to them */
+static double randomization_brute_force(const std::vector<double> &diff) {
+    unsigned n = diff.size();
+    double observed = 0.0, tot_abs = 0.0;
+    unsigned long long at_least = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        observed += diff[i];
+        tot_abs += fabs(diff[i]);
+    }
+    for (unsigned long long m = 0; m < (1ULL << n); m++) {
+        double sum = 0.0;
+
+        for (unsigned i = 0; i < n; i++)
+            sum += m & (1ULL << i) ? -diff[i] : diff[i];
+        if (sum >= observed - tot_abs * 1e-12)
+            at_least++;
+    }
+    return (double) at_least / (1ULL << n);
+}
+
+/* random pairs of N values, with some zero and some tied differences */
+static void random_pairs(unsigned n, std::vector<double> &x,
+  std::vector<double> &y) {
+    x.resize(n);
+    y.resize(n);
+    for (unsigned i = 0; i < n; i++) {
+        y[i] = random() % 10 / 10.0;
+        x[i] = y[i] + (random() % 9 - 4) / 10.0;
+    }
+}
+
+int main(void) {
+    randomization_opts_t exact, sampled;
+    std::vector<double> x, y, diff;
+    double max_sampled_err = 0.0;
+
+    randomization_opts_init(&exact);
+    exact.num_trials = 1U << 20;
+    randomization_opts_init(&sampled);
+    sampled.num_trials = 20000;
+    srandom(1);
+
+    /* with no more assignments than trials, every one is tried, as by
+     * the brute force; with fewer trials, they are sampled, near it */
+    for (unsigned t = 0; t < 200; t++) {
+        unsigned n = 1 + random() % 18;
+
+        random_pairs(n, x, y);
+        diff.clear();
+        for (unsigned i = 0; i < n; i++) {
+            if (x[i] != y[i])
+                diff.push_back(x[i] - y[i]);
+        }
+        double brute = diff.size() > 0
+            ? randomization_brute_force(diff) : 1.0;
+        double p_exact = paired_randomization_test_p(&x[0], &y[0], n,
+          &exact);
+        double p_sampled = paired_randomization_test_p(&x[0], &y[0], n,
+          &sampled);
+
+        assert(p_exact == brute);
+        if (fabs(p_sampled - brute) > max_sampled_err)
+            max_sampled_err = fabs(p_sampled - brute);
+    }
+    std::cout << "sampling error, 20000 trials: " << max_sampled_err
+        << std::endl;
+    assert(max_sampled_err < 0.02);
+
+    /* more differences than could be enumerated: the same seed gives
+     * the same p-value, and the default options are used if none */
+    random_pairs(200, x, y);
+    double p = paired_randomization_test_p(&x[0], &y[0], 200, &sampled);
+    assert(paired_randomization_test_p(&x[0], &y[0], 200, &sampled) == p);
+    randomization_opts_t defaults;
+    randomization_opts_init(&defaults);
+    assert(paired_randomization_test_p(&x[0], &y[0], 200, NULL)
+      == paired_randomization_test_p(&x[0], &y[0], 200, &defaults));
+
+    /* stopping early lands on the same side of the threshold */
+    randomization_opts_t early = sampled;
+    for (unsigned t = 0; t < 20; t++) {
+        random_pairs(40, x, y);
+        for (unsigned i = 0; i < 40; i++)
+            x[i] += (t % 5) / 20.0;
+        p = paired_randomization_test_p(&x[0], &y[0], 40, &sampled);
+        early.p_threshold = 0.05;
+        double p_early = paired_randomization_test_p(&x[0], &y[0], 40,
+          &early);
+
+        if (fabs(p - 0.05) > 0.01)
+            assert((p < 0.05) == (p_early < 0.05));
+    }
+
+    /* identical distributions, no trials, and no values */
+    assert(paired_randomization_test_p(&x[0], &x[0], 40, NULL) == 1.0);
+    sampled.num_trials = 0;
+    assert(paired_randomization_test_p(&x[0], &y[0], 40, &sampled) == 1.0);
+    assert(paired_randomization_test_p(&x[0], &y[0], 0, NULL) == 1.0);
+    return 0;
+}
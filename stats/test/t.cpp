@@ -0,0 +1,106 @@
+extern "C" {
+#include "t.h"
+}
+
+#include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <stdlib.h>
+
+/* critical values of Student's t, as tabulated to six decimal places */
+static const struct {
+    double df;
+    double cdf;
+    double t;
+} critical[] = {
+    { 1, 0.95, 6.313752 }, { 1, 0.975, 12.706205 }, { 1, 0.995, 63.656741 },
+    { 2, 0.95, 2.919986 }, { 2, 0.975, 4.302653 }, { 2, 0.995, 9.924843 },
+    { 5, 0.95, 2.015048 }, { 5, 0.975, 2.570582 }, { 5, 0.995, 4.032143 },
+    { 10, 0.95, 1.812461 }, { 10, 0.975, 2.228139 },
+    { 10, 0.995, 3.169273 }, { 30, 0.95, 1.697261 },
+    { 30, 0.975, 2.042272 }, { 30, 0.995, 2.749996 },
+    { 100, 0.95, 1.660234 }, { 100, 0.975, 1.983972 },
+    { 100, 0.995, 2.625891 },
+};
+
+/* NUM_RUNS rows of NUM_QIDS random scores, the last two rows being
+ * a copy of the first and the first shifted by a constant */
+static void random_scores(unsigned num_runs, unsigned num_qids,
+  std::vector<double> &scores) {
+    scores.resize(num_runs * num_qids);
+    for (unsigned r = 0; r < num_runs; r++) {
+        for (unsigned q = 0; q < num_qids; q++) {
+            double s = random() % 1000 / 1000.0;
+
+            if (r == num_runs - 2)
+                s = scores[q];
+            else if (r == num_runs - 1)
+                s = scores[q] + 0.25;
+            scores[r * num_qids + q] = s;
+        }
+    }
+}
+
+int main(void) {
+    const unsigned num_critical = sizeof(critical) / sizeof(critical[0]);
+    const double ts[] = { 0.0, 0.3, 1.0, 2.5, 10.0 };
+    static const unsigned num_qids_tried[] = { 1, 2, 3, 10, 50 };
+    const unsigned num_runs = 8;
+    double max_err = 0.0;
+
+    /* the CDF at tabulated critical values */
+    for (unsigned c = 0; c < num_critical; c++) {
+        double err = fabs(t_cdf(critical[c].t, critical[c].df)
+          - critical[c].cdf);
+
+        if (err > max_err)
+            max_err = err;
+        assert(fabs(t_cdf(-critical[c].t, critical[c].df)
+            - (1.0 - critical[c].cdf)) < 1e-6);
+    }
+    std::cout << "largest error at critical values: " << max_err
+        << std::endl;
+    assert(max_err < 1e-6);
+
+    /* and against the closed forms for 1 and 2 degrees of freedom */
+    for (unsigned i = 0; i < sizeof(ts) / sizeof(ts[0]); i++) {
+        double t = ts[i];
+
+        assert(fabs(t_cdf(t, 1) - (0.5 + atan(t) / M_PI)) < 1e-12);
+        assert(fabs(t_cdf(t, 2) - (0.5 + t / (2 * sqrt(2 + t * t))))
+          < 1e-12);
+        assert(fabs(t_cdf(t, 7) + t_cdf(-t, 7) - 1.0) < 1e-12);
+    }
+    assert(t_cdf(INFINITY, 5) == 1.0 && t_cdf(-INFINITY, 5) == 0.0);
+
+    /* the matrix of all pairs agrees with testing each pair */
+    srandom(1);
+    for (unsigned n = 0; n < sizeof(num_qids_tried)
+      / sizeof(num_qids_tried[0]); n++) {
+        unsigned num_qids = num_qids_tried[n];
+        std::vector<double> scores;
+        std::vector<t_sums_t> sums(num_runs);
+        std::vector<double> ps(num_runs * num_runs);
+
+        random_scores(num_runs, num_qids, scores);
+        t_run_sums(&scores[0], num_runs, num_qids, &sums[0]);
+        paired_t_test_p_matrix(&scores[0], &sums[0], num_runs, num_qids,
+          &ps[0]);
+        for (unsigned a = 0; a < num_runs; a++) {
+            assert(ps[a * num_runs + a] == 1.0);
+            for (unsigned b = 0; b < num_runs; b++) {
+                double p;
+
+                if (a == b)
+                    continue;
+                p = paired_t_test_p(&scores[a * num_qids],
+                  &scores[b * num_qids], num_qids, NULL);
+                assert(fabs(ps[a * num_runs + b] - p) < 1e-9);
+            }
+        }
+        /* a copy, with no differences, is no better */
+        assert(ps[(num_runs - 2) * num_runs] == 1.0);
+    }
+    return 0;
+}
@@ -1,9 +1,46 @@
 #include "tau_ap.h"
 
 #include <iostream>
+#include <vector>
+#include <cassert>
+#include <cmath>
+#include <ctime>
+#include <stdlib.h>
 
 using namespace rbp;
 
+/* tau_ap straight from its definition, comparing every pair */
+static double tau_ap_pairwise(const double * ref, const double * dat,
+  unsigned size) {
+    std::vector<unsigned> order;
+    double sum = 0.0;
+
+    if (size < 2)
+        return 1.0;
+    for (unsigned i = 0; i < size; i++)
+        order.push_back(i);
+    /* by descending score, ties by position */
+    for (unsigned i = 1; i < size; i++) {
+        for (unsigned j = i; j > 0 && (dat[order[j - 1]] < dat[order[j]]
+              || (dat[order[j - 1]] == dat[order[j]]
+                && order[j - 1] > order[j])); j--)
+            std::swap(order[j - 1], order[j]);
+    }
+    for (unsigned i = 1; i < size; i++) {
+        unsigned correct = 0;
+        unsigned a = order[i];
+
+        for (unsigned j = 0; j < i; j++) {
+            unsigned b = order[j];
+
+            if (ref[b] > ref[a] || (ref[b] == ref[a] && b < a))
+                correct++;
+        }
+        sum += (double) correct / i;
+    }
+    return 2.0 * sum / (size - 1) - 1.0;
+}
+
 int main(int argc, char ** argv) {
     CtBNode * n;
 
@@ -13,5 +50,57 @@ int main(int argc, char ** argv) {
     n->add_descendant(6);
     std::cout << n->get_st_count() << std::endl;
     delete(n);
+
+    /* identical and reversed rankings */
+    double up[] = { 1, 2, 3, 4, 5 };
+    double down[] = { 5, 4, 3, 2, 1 };
+    assert(tau_ap(up, up, 5) == 1.0);
+    assert(fabs(tau_ap(up, down, 5) + 1.0) < 1e-12);
+    assert(tau_ap(up, down, 1) == 1.0);
+    /* an error at the top costs more than one at the bottom */
+    double top_swap[] = { 1, 2, 3, 5, 4 };
+    double bottom_swap[] = { 2, 1, 3, 4, 5 };
+    assert(tau_ap(up, top_swap, 5) < tau_ap(up, bottom_swap, 5));
+
+    /* random scores, with ties, against the definition; and the batch
+     * against single calls */
+    srandom(1);
+    for (unsigned t = 0; t < 200; t++) {
+        unsigned size = random() % 40;
+        unsigned num_dats = 1 + random() % 5;
+        std::vector<double> ref(size);
+        std::vector<std::vector<double> > dats(num_dats,
+          std::vector<double>(size));
+        std::vector<const double *> dat_ptrs;
+        std::vector<double> taus(num_dats);
+
+        for (unsigned i = 0; i < size; i++)
+            ref[i] = random() % 10;
+        for (unsigned d = 0; d < num_dats; d++) {
+            for (unsigned i = 0; i < size; i++)
+                dats[d][i] = random() % 10;
+            dat_ptrs.push_back(size > 0 ? &dats[d][0] : NULL);
+        }
+        const double * ref_ptr = size > 0 ? &ref[0] : NULL;
+
+        tau_ap_batch(ref_ptr, &dat_ptrs[0], num_dats, size, &taus[0]);
+        for (unsigned d = 0; d < num_dats; d++) {
+            double tau = tau_ap(ref_ptr, dat_ptrs[d], size);
+
+            assert(taus[d] == tau);
+            assert(fabs(tau - tau_ap_pairwise(ref_ptr, dat_ptrs[d], size))
+              < 1e-12);
+        }
+    }
+
+    /* sorted input, which would degenerate an unbalanced tree */
+    std::vector<double> sorted(1000000);
+    for (unsigned i = 0; i < sorted.size(); i++)
+        sorted[i] = i;
+    clock_t start = clock();
+    assert(fabs(tau_ap(&sorted[0], &sorted[0], sorted.size()) - 1.0)
+      < 1e-9);
+    std::cout << "tau_ap of " << sorted.size() << " sorted items: "
+        << (double) (clock() - start) / CLOCKS_PER_SEC << "s" << std::endl;
     return 0;
 }
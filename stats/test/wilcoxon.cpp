@@ -0,0 +1,141 @@
+extern "C" {
+#include "wilcoxon.h"
+}
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <cassert>
+#include <cmath>
+#include <stdlib.h>
+
+/* the p-value of the non-zero differences DIFF by enumerating every
+ * assignment of signs to them, ranks being averaged over ties */
+static double wilcoxon_brute_force(const std::vector<double> &diff) {
+    unsigned n = diff.size();
+    std::vector<double> ranks(n);
+    double w_pve = 0.0;
+    unsigned long long at_least = 0;
+
+    for (unsigned i = 0; i < n; i++) {
+        unsigned below = 0, tied = 0;
+
+        for (unsigned j = 0; j < n; j++) {
+            if (fabs(diff[j]) < fabs(diff[i]))
+                below++;
+            else if (fabs(diff[j]) == fabs(diff[i]))
+                tied++;
+        }
+        ranks[i] = below + (tied + 1) / 2.0;
+        if (diff[i] > 0.0)
+            w_pve += ranks[i];
+    }
+    for (unsigned long long m = 0; m < (1ULL << n); m++) {
+        double w = 0.0;
+
+        for (unsigned i = 0; i < n; i++) {
+            if (m & (1ULL << i))
+                w += ranks[i];
+        }
+        if (w >= w_pve - 1e-9)
+            at_least++;
+    }
+    return (double) at_least / (1ULL << n);
+}
+
+/* random pairs of N values, every difference non-zero, and distinct
+ * in magnitude unless TIES */
+static void random_pairs(unsigned n, bool ties, std::vector<double> &x,
+  std::vector<double> &y) {
+    x.resize(n);
+    y.resize(n);
+    for (unsigned i = 0; i < n; i++) {
+        double mag = ties ? 1 + random() % 4 : i + 1 + random() % 100
+            / 1000.0;
+
+        y[i] = random() % 10;
+        x[i] = y[i] + (random() % 2 ? mag : -mag);
+    }
+}
+
+int main(void) {
+    wilcoxon_opts_t exact, approx;
+    std::vector<double> x, y, diff;
+    double max_approx_err = 0.0;
+
+    exact.max_exact = WILCOXON_MAX_EXACT_LIMIT;
+    approx.max_exact = 0;
+    srandom(1);
+
+    /* without ties, the cached exact distribution is the brute-force
+     * one; with them, the normal approximation is near it */
+    for (unsigned t = 0; t < 300; t++) {
+        unsigned n = 1 + random() % 16;
+        bool ties = t % 2;
+
+        random_pairs(n, ties, x, y);
+        diff.clear();
+        for (unsigned i = 0; i < n; i++)
+            diff.push_back(x[i] - y[i]);
+        double brute = wilcoxon_brute_force(diff);
+        double p_exact = paired_wilcoxon_test_p(&x[0], &y[0], n, &exact);
+        double p_approx = paired_wilcoxon_test_p(&x[0], &y[0], n,
+          &approx);
+
+        if (!ties)
+            assert(fabs(p_exact - brute) < 1e-12);
+        if (n >= 10 && fabs(p_approx - brute) > max_approx_err)
+            max_approx_err = fabs(p_approx - brute);
+    }
+    std::cout << "normal approximation error, 10 to 16 values: "
+        << max_approx_err << std::endl;
+    assert(max_approx_err < 0.05);
+
+    /* identical distributions, and the default options */
+    random_pairs(20, false, x, y);
+    assert(paired_wilcoxon_test_p(&x[0], &x[0], 20, NULL) == 1.0);
+    assert(paired_wilcoxon_test_p(&x[0], &y[0], 20, NULL)
+      == paired_wilcoxon_test_p(&x[0], &y[0], 20, &exact));
+
+    /* options beyond the limit are clamped to it */
+    wilcoxon_opts_t huge;
+    huge.max_exact = 100000;
+    random_pairs(WILCOXON_MAX_EXACT_LIMIT + 20, false, x, y);
+    assert(paired_wilcoxon_test_p(&x[0], &y[0], x.size(), &huge)
+      == paired_wilcoxon_test_p(&x[0], &y[0], x.size(), &approx));
+
+    /* the batch, and threads filling the cache at once, agree with
+     * single calls */
+    const unsigned num_dists = 8;
+    const unsigned size = 120;
+    std::vector<std::vector<double> > ys(num_dists);
+    std::vector<double *> y_ptrs;
+    std::vector<double> ps(num_dists), thread_ps(num_dists);
+    std::vector<std::thread> threads;
+
+    random_pairs(size, true, x, y);
+    for (unsigned d = 0; d < num_dists; d++) {
+        random_pairs(size, d % 2, ys[d], y);
+        y_ptrs.push_back(&ys[d][0]);
+    }
+    for (unsigned d = 0; d < num_dists; d++) {
+        threads.push_back(std::thread([&, d]() {
+            /* each on a different number of topics */
+            thread_ps[d] = paired_wilcoxon_test_p(&x[0], y_ptrs[d],
+              size - d, &exact);
+        }));
+    }
+    for (unsigned d = 0; d < num_dists; d++)
+        threads[d].join();
+    for (unsigned d = 0; d < num_dists; d++) {
+        assert(thread_ps[d] == paired_wilcoxon_test_p(&x[0], y_ptrs[d],
+              size - d, &exact));
+    }
+    paired_wilcoxon_test_p_batch(&x[0], &y_ptrs[0], num_dists, size,
+      &exact, &ps[0]);
+    for (unsigned d = 0; d < num_dists; d++) {
+        assert(ps[d] == paired_wilcoxon_test_p(&x[0], y_ptrs[d], size,
+              &exact));
+    }
+    return 0;
+}
@@ -1,3 +1,4 @@
+#include "config.h"
 #include "util.h"
 #include "wilcoxon.h"
 #include <math.h>
@@ -5,6 +6,11 @@
 
 #include <stdio.h>
 
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_LIBPTHREAD)
+#define WILCOXON_THREADS
+#include <pthread.h>
+#endif /* HAVE_PTHREAD_H && HAVE_LIBPTHREAD */
+
 #define NUM_OUTCOMES(d_sz) (((d_sz) * ((d_sz) + 1)) / 2 + 1)
 
 static void generate_wilcoxon_outcomes_next(unsigned curr_dist_size,
@@ -54,7 +60,7 @@ unsigned generate_wilcoxon_outcomes(unsigned dist_size,
     return num_outcomes;
 }
 
-int abs_cmp(const void * va, const void * vb) {
+static int _abs_cmp(const void * va, const void * vb) {
     double a = fabs(* (double *) va);
     double b = fabs(* (double *) vb);
     if (a > b) {
@@ -66,105 +72,260 @@ int abs_cmp(const void * va, const void * vb) {
     }
 }
 
-#define MAX_CACHED_DIST_SIZE 51
+/*
+ *  The cache of exact distributions.  tail_tables[n][w] is the
+ *  probability that W+ is at least w for n non-zero differences, for
+ *  each of the NUM_OUTCOMES(n) values of w.  The tables are built in
+ *  turn from the point probabilities of the largest so far, which
+ *  are held as probabilities rather than counts of outcomes so that
+ *  they cannot overflow; up to 52 differences, every probability and
+ *  tail sum is a multiple of 2^-n less than one, and so is exact.
+ *  Once built, a table does not change, so it can be read without
+ *  holding the lock.  The tables for n differences take O(n^3) space
+ *  in all, which WILCOXON_MAX_EXACT_LIMIT bounds.
+ */
+static double ** tail_tables = NULL;
+static unsigned num_tail_tables = 0;
+static double * last_probs = NULL;
+#ifdef WILCOXON_THREADS
+static pthread_mutex_t tail_tables_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif /* WILCOXON_THREADS */
 
-double paired_wilcoxon_test_p(double * dist_x, double * dist_y,
-  unsigned dist_size, void * data) {
-    double * diff;
+static double * _make_tail_table(double * probs, unsigned dist_size) {
+    unsigned num_outcomes = NUM_OUTCOMES(dist_size);
+    double * tail = util_malloc_or_die(sizeof(*tail) * num_outcomes);
+    double sum = 0.0;
     unsigned i;
-    unsigned diff_dist_size = 0;
-    unsigned diff_num_outcomes;
-    unsigned long long * outcomes_table = NULL;
-    double wlc_pve;
-    double critical_region_size;
-    /* double rem; */
-    static unsigned long long * outcomes_tables[MAX_CACHED_DIST_SIZE];
-    static int outcomes_tables_inited = 0;
-
-    if (!outcomes_tables_inited) {
-        for (i = 0; i < MAX_CACHED_DIST_SIZE; i++) {
-            outcomes_tables[i] = NULL;
-        }
-        outcomes_tables_inited = 1;
+
+    for (i = num_outcomes; i > 0; i--) {
+        sum += probs[i - 1];
+        tail[i - 1] = sum;
     }
+    return tail;
+}
 
-    diff = util_malloc_or_die(sizeof(*diff) * dist_size);
-    for (i = 0; i < dist_size; i++) {
-        if (dist_x[i] != dist_y[i]) {
-            diff[diff_dist_size++] = dist_x[i] - dist_y[i];
+/*
+ *  Get the tail table for DIST_SIZE differences, building it (and
+ *  those for all smaller sizes) if it has not been already.
+ */
+static const double * _get_tail_table(unsigned dist_size) {
+    const double * tail;
+
+#ifdef WILCOXON_THREADS
+    pthread_mutex_lock(&tail_tables_lock);
+#endif /* WILCOXON_THREADS */
+    if (dist_size >= num_tail_tables) {
+        unsigned d;
+
+        tail_tables = util_realloc_or_die(tail_tables,
+          sizeof(*tail_tables) * (dist_size + 1));
+        if (num_tail_tables == 0) {
+            last_probs = util_malloc_or_die(sizeof(*last_probs));
+            last_probs[0] = 1.0;
+            tail_tables[0] = _make_tail_table(last_probs, 0);
+            num_tail_tables = 1;
         }
+        for (d = num_tail_tables; d <= dist_size; d++) {
+            unsigned prev_num_outcomes = NUM_OUTCOMES(d - 1);
+            unsigned num_outcomes = NUM_OUTCOMES(d);
+            double * probs = util_malloc_or_die(sizeof(*probs)
+              * num_outcomes);
+            unsigned i;
+
+            /* the d'th difference is either negative, or positive
+             * and adds d to W+, with even odds */
+            for (i = 0; i < num_outcomes; i++) {
+                probs[i] = i < prev_num_outcomes ? last_probs[i] : 0.0;
+                if (i >= d && i - d < prev_num_outcomes)
+                    probs[i] += last_probs[i - d];
+                probs[i] /= 2.0;
+            }
+            free(last_probs);
+            last_probs = probs;
+            tail_tables[d] = _make_tail_table(probs, d);
+        }
+        num_tail_tables = dist_size + 1;
     }
-    if (diff_dist_size == 0) {
-        free(diff);
-        return 1.0;
-    }
-    diff_num_outcomes = NUM_OUTCOMES(diff_dist_size);
-    if (diff_dist_size < MAX_CACHED_DIST_SIZE) {
-        outcomes_table = outcomes_tables[diff_dist_size];
-    }
-    if (outcomes_table == NULL)
-        outcomes_table = util_malloc_or_die(sizeof(*outcomes_table) 
-          * diff_num_outcomes);
-    generate_wilcoxon_outcomes(diff_dist_size, outcomes_table);
-    qsort(diff, diff_dist_size, sizeof(*diff), abs_cmp);
+    tail = tail_tables[dist_size];
+#ifdef WILCOXON_THREADS
+    pthread_mutex_unlock(&tail_tables_lock);
+#endif /* WILCOXON_THREADS */
+    return tail;
+}
+
+/*
+ *  The probability of a W+ at least W_PVE for DIST_SIZE differences,
+ *  TIES_SUM being the sum of (t^3 - t) over the runs of t tied
+ *  absolute differences, by the normal approximation with a
+ *  continuity correction.
+ */
+static double _normal_approx_p(double wlc_pve, unsigned dist_size,
+  double ties_sum) {
+    double n = dist_size;
+    double mean = n * (n + 1) / 4.0;
+    double var = n * (n + 1) * (2 * n + 1) / 24.0 - ties_sum / 48.0;
+    double z;
+
+    if (var <= 0.0)
+        return wlc_pve >= mean ? 1.0 : 0.0;
+    z = (wlc_pve - 0.5 - mean) / sqrt(var);
+    return 0.5 * erfc(z / sqrt(2.0));
+}
+
+/*
+ *  Calculate the p-value for the DIST_SIZE non-zero differences of
+ *  DIFF, which are sorted in place by their magnitude.
+ */
+static double _wilcoxon_p(double * diff, unsigned dist_size,
+  unsigned max_exact) {
+    unsigned i;
+    double wlc_pve;
+    double ties_sum;
+    unsigned w;
+
+    qsort(diff, dist_size, sizeof(*diff), _abs_cmp);
     wlc_pve = 0.0;
-    for (i = 0; i < diff_dist_size; ) {
+    ties_sum = 0.0;
+    for (i = 0; i < dist_size; ) {
         unsigned j;
         double abs_diff = fabs(diff[i]);
         double mean_rank;
-        for (j = i + 1; j < diff_dist_size && fabs(diff[j]) == abs_diff;
+        double run;
+        for (j = i + 1; j < dist_size && fabs(diff[j]) == abs_diff;
           j++)
             ;
         mean_rank = (double)(i + j + 1) / 2.0;
+        run = j - i;
+        ties_sum += run * run * run - run;
         for ( ; i < j; i++) {
             if (diff[i] > 0.0) {
                 wlc_pve += mean_rank;
             }
         }
     }
-    critical_region_size = 0.0;
+    if (dist_size > max_exact)
+        return _normal_approx_p(wlc_pve, dist_size, ties_sum);
     /* The description of the Wilcoxon test are unclear on what should
      * be done in the case of half-values (that can occur due to tied
-     * ranks).  We round up to the next whole value.  The commented-out
-     * code took half of the previous value. */
-    /*rem = fmod(wlc_pve, 1.0);
-    critical_region_size = rem * outcomes_table[(unsigned) floor(wlc_pve)];*/
-    for (i = (unsigned) ceil(wlc_pve); i < diff_num_outcomes; i++) {
-        critical_region_size += outcomes_table[i];
+     * ranks).  We round up to the next whole value. */
+    w = (unsigned) ceil(wlc_pve);
+    if (w >= NUM_OUTCOMES(dist_size))
+        return 0.0;
+    return _get_tail_table(dist_size)[w];
+}
+
+static unsigned _max_exact(void * data) {
+    unsigned max_exact;
+
+    if (data == NULL)
+        return WILCOXON_DEFAULT_MAX_EXACT;
+    max_exact = ((wilcoxon_opts_t *) data)->max_exact;
+    return max_exact > WILCOXON_MAX_EXACT_LIMIT ? WILCOXON_MAX_EXACT_LIMIT
+        : max_exact;
+}
+
+/*
+ *  Gather the non-zero differences of DIST_X and DIST_Y into DIFF,
+ *  returning how many there are.
+ */
+static unsigned _diffs(double * dist_x, double * dist_y,
+  unsigned dist_size, double * diff) {
+    unsigned i;
+    unsigned diff_dist_size = 0;
+
+    for (i = 0; i < dist_size; i++) {
+        if (dist_x[i] != dist_y[i]) {
+            diff[diff_dist_size++] = dist_x[i] - dist_y[i];
+        }
     }
-    free(diff);
-    if (diff_dist_size < MAX_CACHED_DIST_SIZE) {
-        outcomes_tables[diff_dist_size] = outcomes_table;
-    } else {
-        free(outcomes_table);
+    return diff_dist_size;
+}
+
+double paired_wilcoxon_test_p(double * dist_x, double * dist_y,
+  unsigned dist_size, void * data) {
+    double p;
+
+    paired_wilcoxon_test_p_batch(dist_x, &dist_y, 1, dist_size, data, &p);
+    return p;
+}
+
+void paired_wilcoxon_test_p_batch(double * dist_x, double ** dists_y,
+  unsigned num_dists, unsigned dist_size, void * data, double * ps) {
+    unsigned max_exact = _max_exact(data);
+    double * diff = util_malloc_array_or_die(dist_size, sizeof(*diff));
+    unsigned d;
+
+    for (d = 0; d < num_dists; d++) {
+        unsigned diff_dist_size = _diffs(dist_x, dists_y[d], dist_size,
+          diff);
+
+        if (diff_dist_size == 0)
+            ps[d] = 1.0;
+        else
+            ps[d] = _wilcoxon_p(diff, diff_dist_size, max_exact);
     }
-    return critical_region_size / pow(2.0, diff_dist_size);
+    free(diff);
 }
 
 #ifdef WILCOXON_MAIN
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-#define MAX_DIST_SIZE 1000
 #define LINE_BUF_SIZE 1024
+#define INIT_DIST_SIZE 1024
 
-int main(void) {
+/*
+ *  Read lines of paired values from stdin, and print the p-value.
+ *  There is no limit on the number of lines.  "-e N" sets the most
+ *  differences for which the exact distribution is used.
+ */
+int main(int argc, char ** argv) {
     char line_buf[LINE_BUF_SIZE];
-    double dist_x[MAX_DIST_SIZE];
-    double dist_y[MAX_DIST_SIZE];
+    double * dist_x = NULL;
+    double * dist_y = NULL;
+    unsigned x_sz = 0, y_sz = 0;
     unsigned d;
     double p;
+    wilcoxon_opts_t opts;
+    long max_exact;
+    char * end;
+    int optflag;
+
+    opts.max_exact = WILCOXON_DEFAULT_MAX_EXACT;
+    while ( (optflag = getopt(argc, argv, "e:")) != -1) {
+        switch (optflag) {
+        case 'e':
+            max_exact = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || max_exact < 0
+              || max_exact > WILCOXON_MAX_EXACT_LIMIT) {
+                fprintf(stderr, "max_exact (-e) must be an integer "
+                  "from 0 to %u\n", WILCOXON_MAX_EXACT_LIMIT);
+                return 1;
+            }
+            opts.max_exact = max_exact;
+            break;
+        default:
+            fprintf(stderr, "USAGE: %s [-e max_exact] < pairs\n", argv[0]);
+            return 1;
+        }
+    }
 
-    for (d = 0; d < MAX_DIST_SIZE && fgets(line_buf, LINE_BUF_SIZE, 
-          stdin) != NULL; d++) {
-        if (!sscanf(line_buf, "%lf %lf", &dist_x[d], &dist_y[d])) {
+    for (d = 0; fgets(line_buf, LINE_BUF_SIZE, stdin) != NULL; d++) {
+        util_ensure_array_space((void **) &dist_x, &x_sz, d,
+          sizeof(*dist_x), INIT_DIST_SIZE, 2.0);
+        util_ensure_array_space((void **) &dist_y, &y_sz, d,
+          sizeof(*dist_y), INIT_DIST_SIZE, 2.0);
+        if (sscanf(line_buf, "%lf %lf", &dist_x[d], &dist_y[d]) != 2) {
             fprintf(stderr, "Error on line %d of input\n", d + 1);
             return 1;
         }
     }
-    p = paired_wilcoxon_test_p(dist_x, dist_y, d, NULL);
+    p = paired_wilcoxon_test_p(dist_x, dist_y, d, &opts);
     fprintf(stdout, "%lf\n", p);
+    free(dist_x);
+    free(dist_y);
     return 0;
 }
 
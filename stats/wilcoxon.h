@@ -20,6 +20,33 @@
 double paired_wilcoxon_test_p(double * dist_x, double * dist_y,
   unsigned dist_size, void * data);
 
+/*
+ *  Test DIST_X against each of the NUM_DISTS distributions of
+ *  DISTS_Y, as by paired_wilcoxon_test_p, writing the p-values to PS.
+ */
+void paired_wilcoxon_test_p_batch(double * dist_x, double ** dists_y,
+  unsigned num_dists, unsigned dist_size, void * data, double * ps);
+
+/*
+ *  Options for the Wilcoxon test, passed as its DATA; if DATA is
+ *  NULL, the defaults are used.
+ *
+ *  The p-value is calculated from the exact distribution of W+ for up
+ *  to MAX_EXACT non-zero differences.  The exact distributions are
+ *  built once and cached, and the cache is safe to share between
+ *  threads.  Beyond MAX_EXACT differences, the p-value is found by
+ *  the normal approximation, with a correction for tied ranks and a
+ *  continuity correction.  MAX_EXACT is taken as at most
+ *  WILCOXON_MAX_EXACT_LIMIT, as the cached distributions for up to n
+ *  differences take O(n^3) space (about 4.5MB at the limit).
+ */
+typedef struct {
+    unsigned max_exact;
+} wilcoxon_opts_t;
+
+#define WILCOXON_DEFAULT_MAX_EXACT 100
+#define WILCOXON_MAX_EXACT_LIMIT 150
+
 /*
  *  Generate a Wilcoxon distribution table for N values.
  *